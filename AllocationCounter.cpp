@@ -0,0 +1,37 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+
+#ifdef COUNT_ALLOCATIONS
+
+	static std::atomic< unsigned long long > totalAllocations( 0 );
+	static thread_local unsigned long long threadAllocations = 0;
+	
+	static void* countedAllocate( size_t size ) {
+		threadAllocations++;
+		totalAllocations++;
+		void *memory = malloc( size > 0 ? size : 1 );
+		if( memory == NULL )
+			throw std::bad_alloc();
+		return memory;
+	}
+	
+	void* operator new( size_t size ) { return countedAllocate( size ); }
+	void* operator new[]( size_t size ) { return countedAllocate( size ); }
+	void operator delete( void *memory ) noexcept { free( memory ); }
+	void operator delete[]( void *memory ) noexcept { free( memory ); }
+	
+	bool AllocationCounter::isEnabled() { return true; }
+	unsigned long long AllocationCounter::getThreadCount() { return threadAllocations; }
+	unsigned long long AllocationCounter::getTotalCount() { return totalAllocations; }
+
+#else
+
+	bool AllocationCounter::isEnabled() { return false; }
+	unsigned long long AllocationCounter::getThreadCount() { return 0; }
+	unsigned long long AllocationCounter::getTotalCount() { return 0; }
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef _ALLOCATION_COUNTER_H_
+#define _ALLOCATION_COUNTER_H_ 1
+
+
+
+	/* counts heap allocations made through operator new, per thread and */
+	/* overall, so a frame's allocations can be measured by taking the */
+	/* difference around it; the counting operator new is only built with */
+	/* -DCOUNT_ALLOCATIONS (COUNT_ALLOCATIONS = 1 in the Makefile), */
+	/* otherwise every count stays 0 */
+	class AllocationCounter {
+	public:
+		static bool isEnabled();
+		
+		/* allocations made by the calling thread */
+		static unsigned long long getThreadCount();
+		/* allocations made by every thread */
+		static unsigned long long getTotalCount();
+	};
+
+
+#endif
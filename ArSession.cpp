@@ -0,0 +1,141 @@
+#include "ArSession.h"
+
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+
+
+	ArSession::ArSession( const string &name, FrameSource *source, FrameScheduler *renderSignal, unsigned int queueDepth )
+		: _ring( 4 ),
+		  _capture( source, &_ring ),
+		  _pipeline( &_ring, &_frameSignal, renderSignal, queueDepth ) {
+		_name = name;
+		_renderSignal = renderSignal;
+		_calibration = NULL;
+		_pool = NULL;
+		_scheduled = false;
+		_stopping = false;
+		_hasLatest = false;
+		_numProcessed = 0;
+		_numSuperseded = 0;
+		_busySeconds = 0;
+		_statsStart = FrameRing::now();
+	}
+	
+	ArSession::~ArSession() {
+		stop();
+	}
+	
+	bool ArSession::isOpened() { return _capture.isOpened(); }
+	const string& ArSession::getName() { return _name; }
+	
+	void ArSession::setCalibration( CameraCalibration *calibration, float markerLength, bool rectify ) {
+		_calibration = calibration;
+		_pipeline.setCalibration( calibration, markerLength, rectify );
+	}
+	
+	CameraCalibration* ArSession::getCalibration() { return _calibration; }
+	
+	DetectionPipeline* ArSession::getPipeline() { return &_pipeline; }
+	CaptureThread* ArSession::getCapture() { return &_capture; }
+	
+	void ArSession::start( WorkerPool *pool ) {
+		_pool = pool;
+		_stopping = false;
+		if( _pool == NULL ) {
+			_capture.setFrameCallback( [this] { _frameSignal.notifyFrameReady(); } );
+			_pipeline.start();
+		} else {
+			_capture.setFrameCallback( [this] { schedule(); } );
+		}
+		_statsStart = FrameRing::now();
+		_capture.start();
+	}
+	
+	void ArSession::stop() {
+		_stopping = true;
+		_capture.stop();
+		if( _pool == NULL ) {
+			_pipeline.stop();
+		} else {
+			// let a queued or running detection finish with the session
+			while( _scheduled )
+				std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		}
+	}
+	
+	/*
+	 * At most one detection task per session is ever queued or running:
+	 * the detector tracks from frame to frame, so a session's frames must
+	 * be handled in order, and one busy camera can't crowd the others out
+	 * of the pool.  A frame that arrives meanwhile is picked up by the
+	 * running task before it lets go.
+	 */
+	void ArSession::schedule() {
+		if( _stopping || _scheduled.exchange( true ) )
+			return;
+		_pool->submit( [this] { runDetection(); } );
+	}
+	
+	void ArSession::runDetection() {
+		while( true ) {
+			double start = FrameRing::now();
+			while( !_stopping && _pipeline.processNext( _working ) ) {
+				{
+					std::lock_guard< std::mutex > lock( _latestMutex );
+					std::swap( _latest, _working );
+					if( _hasLatest )
+						_numSuperseded++;
+					_hasLatest = true;
+				}
+				_numProcessed++;
+				if( _renderSignal != NULL )
+					_renderSignal->notifyFrameReady();
+			}
+			// printStats clears the total from the render thread, so add with
+			// a compare-exchange; a load and a store could undo the clear or
+			// lose this run's time
+			double busy = FrameRing::now() - start;
+			double total = _busySeconds.load();
+			while( !_busySeconds.compare_exchange_weak( total, total + busy ) )
+				;
+			
+			_scheduled = false;
+			// a frame published after the last processNext() but before the
+			// flag dropped would otherwise wait for the next one
+			if( _stopping || _ring.getOccupancy() == 0 || _scheduled.exchange( true ) )
+				return;
+		}
+	}
+	
+	bool ArSession::takeResult( FrameResult &result ) {
+		if( _pool == NULL )
+			return _pipeline.takeResult( result );
+		
+		std::lock_guard< std::mutex > lock( _latestMutex );
+		if( !_hasLatest )
+			return false;
+		std::swap( result, _latest );
+		_hasLatest = false;
+		return true;
+	}
+	
+	void ArSession::printStats() {
+		double elapsed = FrameRing::now() - _statsStart;
+		if( _pool != NULL ) {
+			// taken and cleared in one step, so work the detection task adds
+			// meanwhile counts towards the next report
+			unsigned long numProcessed = _numProcessed.exchange( 0 );
+			unsigned long numSuperseded = _numSuperseded.exchange( 0 );
+			double busySeconds = _busySeconds.exchange( 0 );
+			printf( "[session %s]: %.1f frames/s  busy %.0f%%  superseded %lu\n",
+					_name.c_str(), elapsed > 0 ? numProcessed / elapsed : 0.0,
+					elapsed > 0 ? busySeconds / elapsed * 100.0 : 0.0, numSuperseded );
+		} else {
+			printf( "[session %s]:\n", _name.c_str() );
+		}
+		_ring.printStats();
+		_pipeline.printStats();
+		
+		_statsStart = FrameRing::now();
+	}
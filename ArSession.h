@@ -0,0 +1,81 @@
+#ifndef _AR_SESSION_H_
+#define _AR_SESSION_H_ 1
+
+#include "CameraCalibration.h"
+#include "CaptureThread.h"
+#include "DetectionPipeline.h"
+#include "FrameRing.h"
+#include "FrameScheduler.h"
+#include "FrameSource.h"
+#include "WorkerPool.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+using namespace std;
+
+
+
+	/* everything one camera needs: its frame source and capture thread, */
+	/* intrinsics, detector state and the latest poses; detection runs on */
+	/* the session's own pipeline thread, or as tasks on a WorkerPool */
+	/* shared with other sessions */
+	class ArSession {
+	public:
+		/* takes ownership of source; renderSignal is notified whenever a */
+		/* new result is ready */
+		ArSession( const string &name, FrameSource *source, FrameScheduler *renderSignal, unsigned int queueDepth = 2 );
+		~ArSession();
+		
+		bool isOpened();
+		const string& getName();
+		
+		/* calibration may be shared between sessions; see */
+		/* DetectionPipeline::setCalibration() for rectify */
+		void setCalibration( CameraCalibration *calibration, float markerLength, bool rectify );
+		CameraCalibration* getCalibration();
+		
+		/* detector and replay settings; configure before start() */
+		DetectionPipeline* getPipeline();
+		CaptureThread* getCapture();
+		
+		/* pool NULL runs detection on the session's own thread */
+		void start( WorkerPool *pool = NULL );
+		void stop();
+		
+		/* replace result with the newest finished frame; false if there */
+		/* has been none since the last call */
+		bool takeResult( FrameResult &result );
+		
+		void printStats();
+		
+	private:
+		string _name;
+		FrameRing _ring;
+		FrameScheduler _frameSignal;
+		CaptureThread _capture;
+		DetectionPipeline _pipeline;
+		FrameScheduler *_renderSignal;
+		CameraCalibration *_calibration;
+		
+		WorkerPool *_pool;
+		std::atomic< bool > _scheduled;		// a detection task is queued or running
+		std::atomic< bool > _stopping;
+		
+		// pool mode hands results over through a single slot, newest wins
+		FrameResult _working;
+		FrameResult _latest;
+		bool _hasLatest;
+		std::mutex _latestMutex;
+		
+		std::atomic< unsigned long > _numProcessed;
+		std::atomic< unsigned long > _numSuperseded;
+		std::atomic< double > _busySeconds;
+		double _statsStart;
+		
+		void schedule();
+		void runDetection();
+	};
+
+
+#endif
@@ -0,0 +1,477 @@
+/*
+ * batchPose: marker poses for a whole recording, without a window.
+ *
+ *   batchPose [options] <video file | image directory> <output.jsonl | output.bin>
+ *
+ * The recording is split into chunks of consecutive frames that are
+ * decoded and detected in parallel, each worker seeking its own reader to
+ * the start of its chunk; results are written in frame order.  A video
+ * whose length the container doesn't give is decoded on one thread and
+ * its frames handed out one at a time instead.
+ *
+ * JSON lines output has one object per frame:
+ *   {"frame":12,"time":0.400,"markers":[{"id":3,"corners":[[x,y],...],"rvec":[...],"tvec":[...]}]}
+ *
+ * Binary output, little-endian whatever the host, starts with the 8 bytes
+ * "ARPOSE01", then
+ * per frame:
+ *   uint32 frame, float64 time, uint32 marker count
+ * and per marker:
+ *   int32 id, float32 corners[8] (x,y clockwise from top left),
+ *   float64 rvec[3], float64 tvec[3]
+ *
+ * --compare-poses solves every frame's markers with each pose solver as
+ * well and reports their time per marker and reprojection error at the
+ * end; the output still comes from --pose-solver.
+ */
+
+#include "DetectorProfile.h"
+#include "FrameRing.h"
+#include "FrameSource.h"
+#include "SquarePoseSolver.h"
+#include "WorkerPool.h"
+
+#include <opencv2/aruco.hpp>
+#include <opencv2/core.hpp>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+struct MarkerPose {
+	int id;
+	cv::Point2f corners[4];
+	cv::Vec3d rvec, tvec;
+};
+
+struct FramePoses {
+	unsigned long frame;
+	double time;
+	vector< MarkerPose > markers;
+};
+
+/* a run of consecutive frames handled by one task */
+struct Chunk {
+	unsigned long first;
+	unsigned long count;
+	cv::Mat image;                  // frame sharding: the already decoded frame
+	double time;
+	vector< FramePoses > frames;
+	bool done;
+};
+
+/* per pose solver totals for --compare-poses */
+static const int NUM_POSE_METHODS = 3;
+static const char* POSE_METHOD_NAMES[ NUM_POSE_METHODS ] = { "iterative", "ippe", "ippe-refine" };
+struct PoseComparison {
+	unsigned long markers;
+	double seconds[ NUM_POSE_METHODS ];
+	double error[ NUM_POSE_METHODS ];		// sum of per-marker RMS pixels
+};
+
+/* writes FramePoses as JSON lines or binary, chosen by file extension */
+class PoseWriter {
+public:
+	PoseWriter() : _file( NULL ), _binary( false ) {}
+	~PoseWriter() { close(); }
+
+	bool open( const string &filename ) {
+		size_t dot = filename.find_last_of( '.' );
+		string extension = dot == string::npos ? "" : filename.substr( dot + 1 );
+		_binary = !( extension == "jsonl" || extension == "json" );
+		_file = fopen( filename.c_str(), _binary ? "wb" : "w" );
+		if( _file == NULL ) {
+			fprintf( stderr, "[batch]: [ERROR]: could not open %s for writing\n", filename.c_str() );
+			return false;
+		}
+		if( _binary )
+			fwrite( "ARPOSE01", 1, 8, _file );
+		return true;
+	}
+
+	void write( const FramePoses &poses ) {
+		if( _binary )
+			writeBinary( poses );
+		else
+			writeJson( poses );
+	}
+
+	void close() {
+		if( _file != NULL )
+			fclose( _file );
+		_file = NULL;
+	}
+
+private:
+	FILE *_file;
+	bool _binary;
+
+	void writeJson( const FramePoses &poses ) {
+		fprintf( _file, "{\"frame\":%lu,\"time\":%.4f,\"markers\":[", poses.frame, poses.time );
+		for( unsigned int i = 0; i < poses.markers.size(); i++ ) {
+			const MarkerPose &marker = poses.markers[i];
+			fprintf( _file, "%s{\"id\":%d,\"corners\":[", i > 0 ? "," : "", marker.id );
+			for( int c = 0; c < 4; c++ )
+				fprintf( _file, "%s[%.2f,%.2f]", c > 0 ? "," : "", marker.corners[c].x, marker.corners[c].y );
+			fprintf( _file, "],\"rvec\":[%.6f,%.6f,%.6f],\"tvec\":[%.6f,%.6f,%.6f]}",
+					 marker.rvec[0], marker.rvec[1], marker.rvec[2], marker.tvec[0], marker.tvec[1], marker.tvec[2] );
+		}
+		fprintf( _file, "]}\n" );
+	}
+
+	/* every field a byte at a time, least significant first */
+	void writeUint32( uint32_t value ) {
+		unsigned char bytes[4];
+		for( int b = 0; b < 4; b++ )
+			bytes[b] = (unsigned char)( value >> ( 8 * b ) );
+		fwrite( bytes, 1, 4, _file );
+	}
+
+	void writeUint64( uint64_t value ) {
+		unsigned char bytes[8];
+		for( int b = 0; b < 8; b++ )
+			bytes[b] = (unsigned char)( value >> ( 8 * b ) );
+		fwrite( bytes, 1, 8, _file );
+	}
+
+	void writeFloat32( float value ) {
+		uint32_t bits;
+		memcpy( &bits, &value, sizeof( bits ) );
+		writeUint32( bits );
+	}
+
+	void writeFloat64( double value ) {
+		uint64_t bits;
+		memcpy( &bits, &value, sizeof( bits ) );
+		writeUint64( bits );
+	}
+
+	void writeBinary( const FramePoses &poses ) {
+		writeUint32( (uint32_t)poses.frame );
+		writeFloat64( poses.time );
+		writeUint32( (uint32_t)poses.markers.size() );
+		for( unsigned int i = 0; i < poses.markers.size(); i++ ) {
+			const MarkerPose &marker = poses.markers[i];
+			writeUint32( (uint32_t)(int32_t)marker.id );
+			for( int c = 0; c < 4; c++ ) {
+				writeFloat32( marker.corners[c].x );
+				writeFloat32( marker.corners[c].y );
+			}
+			for( int k = 0; k < 3; k++ )
+				writeFloat64( marker.rvec[k] );
+			for( int k = 0; k < 3; k++ )
+				writeFloat64( marker.tvec[k] );
+		}
+	}
+};
+
+
+cv::Ptr< cv::aruco::Dictionary > dictionary = cv::aruco::getPredefinedDictionary( cv::aruco::DICT_4X4_100 );
+cv::Ptr< cv::aruco::DetectorParameters > detectorParams = cv::aruco::DetectorParameters::create();
+cv::Mat K, distCoeffs;
+float markerLength = 1.75f;
+PoseMethod poseMethod = POSE_ITERATIVE;
+bool comparePoses = false;
+
+string input;
+double imageFps = 30.0;
+
+// readers are opened on demand and reused, so there are never more than
+// there are threads
+vector< FrameSource* > idleSources;
+std::mutex sourceMutex;
+
+PoseComparison comparison;
+std::mutex comparisonMutex;
+
+// finished chunks wait here until everything before them is written
+std::mutex chunkMutex;
+std::condition_variable chunkDone;
+
+
+/* SquarePoseSolver keeps scratch of its own, so there is one per thread */
+/* and per refinement setting */
+SquarePoseSolver& getPoseSolver( bool refine ) {
+	thread_local SquarePoseSolver solvers[2];
+	thread_local bool ready = false;
+	if( !ready ) {
+		for( int i = 0; i < 2; i++ ) {
+			solvers[i].setCamera( K, distCoeffs, markerLength );
+			solvers[i].setRefinement( i == 1 );
+		}
+		ready = true;
+	}
+	return solvers[ refine ? 1 : 0 ];
+}
+
+void solvePoses( PoseMethod method, const vector< vector< cv::Point2f > > &corners, vector< cv::Vec3d > &rvecs, vector< cv::Vec3d > &tvecs ) {
+	if( method == POSE_ITERATIVE )
+		cv::aruco::estimatePoseSingleMarkers( corners, markerLength, K, distCoeffs, rvecs, tvecs );
+	else
+		getPoseSolver( method == POSE_IPPE_REFINED ).solve( corners, rvecs, tvecs );
+}
+
+/* time every solver on one frame's markers and add to the totals */
+void comparePoseSolvers( const vector< vector< cv::Point2f > > &corners ) {
+	thread_local vector< cv::Vec3d > rvecs, tvecs;
+	PoseComparison frame;
+	SquarePoseSolver &measure = getPoseSolver( false );
+	for( int method = 0; method < NUM_POSE_METHODS; method++ ) {
+		double start = FrameRing::now();
+		solvePoses( (PoseMethod)method, corners, rvecs, tvecs );
+		frame.seconds[ method ] = FrameRing::now() - start;
+		frame.error[ method ] = 0;
+		for( unsigned int i = 0; i < corners.size(); i++ )
+			frame.error[ method ] += measure.getReprojectionError( corners[i], rvecs[i], tvecs[i] );
+	}
+
+	std::lock_guard< std::mutex > lock( comparisonMutex );
+	comparison.markers += corners.size();
+	for( int method = 0; method < NUM_POSE_METHODS; method++ ) {
+		comparison.seconds[ method ] += frame.seconds[ method ];
+		comparison.error[ method ] += frame.error[ method ];
+	}
+}
+
+/* detect and estimate poses in one frame; the scratch vectors are per */
+/* thread so every frame after the first reuses their storage */
+void detectFrame( const cv::Mat &image, unsigned long frame, double time, FramePoses &poses ) {
+	thread_local vector< int > ids;
+	thread_local vector< vector< cv::Point2f > > corners, rejected;
+	thread_local vector< cv::Vec3d > rvecs, tvecs;
+
+	cv::aruco::detectMarkers( image, dictionary, corners, ids, detectorParams, rejected );
+	rvecs.clear();
+	tvecs.clear();
+	if( !ids.empty() ) {
+		if( comparePoses )
+			comparePoseSolvers( corners );
+		solvePoses( poseMethod, corners, rvecs, tvecs );
+	}
+
+	poses.frame = frame;
+	poses.time = time;
+	poses.markers.resize( ids.size() );
+	for( unsigned int i = 0; i < ids.size(); i++ ) {
+		MarkerPose &marker = poses.markers[i];
+		marker.id = ids[i];
+		for( int c = 0; c < 4; c++ )
+			marker.corners[c] = corners[i][c];
+		marker.rvec = rvecs[i];
+		marker.tvec = tvecs[i];
+	}
+}
+
+FrameSource* acquireSource() {
+	{
+		std::lock_guard< std::mutex > lock( sourceMutex );
+		if( !idleSources.empty() ) {
+			FrameSource *source = idleSources.back();
+			idleSources.pop_back();
+			return source;
+		}
+	}
+	return FrameSource::open( input, imageFps );
+}
+
+void releaseSource( FrameSource *source ) {
+	std::lock_guard< std::mutex > lock( sourceMutex );
+	idleSources.push_back( source );
+}
+
+void processChunk( Chunk *chunk ) {
+	if( !chunk->image.empty() ) {
+		chunk->frames.resize( 1 );
+		detectFrame( chunk->image, chunk->first, chunk->time, chunk->frames[0] );
+		chunk->image.release();
+	} else {
+		FrameSource *source = acquireSource();
+		cv::Mat image;
+		double time;
+		chunk->frames.reserve( chunk->count );
+		if( source->seek( chunk->first ) ) {
+			// a container can overstate its length, so the chunk may end early
+			for( unsigned long i = 0; i < chunk->count && source->read( image, time ); i++ ) {
+				chunk->frames.push_back( FramePoses() );
+				detectFrame( image, chunk->first + i, time, chunk->frames.back() );
+			}
+		} else {
+			fprintf( stderr, "[batch]: [ERROR]: could not seek to frame %lu\n", chunk->first );
+		}
+		releaseSource( source );
+	}
+
+	std::lock_guard< std::mutex > lock( chunkMutex );
+	chunk->done = true;
+	chunkDone.notify_all();
+}
+
+
+int main( int argc, char* argv[] ) {
+	double fx = 675, fy = 675, cx = 320, cy = 240;
+	unsigned int numThreads = 0;
+	long chunkSize = 0;
+	bool shardFrames = false;
+	vector< string > files;
+	for( int i = 1; i < argc; i++ ) {
+		string arg = argv[i];
+		if( arg.compare( 0, 9, "--camera=" ) == 0 )
+			sscanf( arg.c_str() + 9, "%lf,%lf,%lf,%lf", &fx, &fy, &cx, &cy );
+		else if( arg.compare( 0, 16, "--marker-length=" ) == 0 )
+			markerLength = atof( arg.substr( 16 ).c_str() );
+		else if( arg.compare( 0, 19, "--detector-profile=" ) == 0 ) {
+			detectorParams = DetectorProfile::loadSpec( arg.substr( 19 ) );
+			if( detectorParams.empty() )
+				return 1;
+		}
+		else if( arg.compare( 0, 12, "--image-fps=" ) == 0 )
+			imageFps = atof( arg.substr( 12 ).c_str() );
+		else if( arg.compare( 0, 10, "--threads=" ) == 0 )
+			numThreads = atoi( arg.substr( 10 ).c_str() );
+		else if( arg.compare( 0, 8, "--chunk=" ) == 0 )
+			chunkSize = atol( arg.substr( 8 ).c_str() );
+		else if( arg == "--shard=frames" )
+			shardFrames = true;
+		else if( arg == "--shard=chunks" )
+			shardFrames = false;
+		else if( arg == "--pose-solver=iterative" )
+			poseMethod = POSE_ITERATIVE;
+		else if( arg == "--pose-solver=ippe" )
+			poseMethod = POSE_IPPE;
+		else if( arg == "--pose-solver=ippe-refine" )
+			poseMethod = POSE_IPPE_REFINED;
+		else if( arg == "--compare-poses" )
+			comparePoses = true;
+		else
+			files.push_back( arg );
+	}
+	if( files.size() != 2 ) {
+		fprintf( stderr, "usage: %s [options] <video file | image directory> <output.jsonl | output.bin>\n"
+				 "  camera:   [--camera=<fx>,<fy>,<cx>,<cy>] [--marker-length=<length>] [--image-fps=<fps>]\n"
+				 "  detector: [--detector-profile=<profiles.yml>[:fast|balanced|robust]]\n"
+				 "  poses:    [--pose-solver=iterative|ippe|ippe-refine] [--compare-poses]\n"
+				 "  sharding: [--threads=<count>] [--shard=chunks|frames] [--chunk=<frames>]\n", argv[0] );
+		return 1;
+	}
+	input = files[0];
+
+	double K_[3][3] = { { fx, 0, cx }, { 0, fy, cy }, { 0, 0, 1 } };
+	K = cv::Mat( 3, 3, CV_64F, K_ ).clone();
+	distCoeffs = cv::Mat::zeros( 5, 1, CV_64F );
+
+	FrameSource *source = FrameSource::open( input, imageFps );
+	if( !source->isOpened() || source->isLive() ) {
+		fprintf( stderr, "[batch]: [ERROR]: could not open %s as a recording\n", input.c_str() );
+		return 1;
+	}
+	PoseWriter writer;
+	if( !writer.open( files[1] ) )
+		return 1;
+
+	// seeking lands on a keyframe and decodes forward, so video chunks are
+	// long enough to bury that; images cost the same wherever they start
+	long frameCount = source->getFrameCount();
+	if( frameCount < 0 )
+		shardFrames = true;
+	if( shardFrames )
+		chunkSize = 1;
+	else if( chunkSize <= 0 )
+		chunkSize = dynamic_cast< VideoFileSource* >( source ) != NULL ? 256 : 8;
+	string sharding = shardFrames ? "one frame per task" : to_string( chunkSize ) + " frames per task";
+	fprintf( stderr, "[batch]: %s, %s\n", source->describe().c_str(), sharding.c_str() );
+	if( !shardFrames )
+		releaseSource( source );
+
+	WorkerPool pool( numThreads );
+
+	// bound the work in flight so memory stays flat on long recordings
+	unsigned long maxInFlight = 4 * pool.getNumThreads();
+	unsigned long numChunks = shardFrames ? 0 : ( frameCount + chunkSize - 1 ) / chunkSize;
+	map< unsigned long, Chunk* > inFlight;
+	unsigned long nextSubmit = 0, nextWrite = 0;
+	bool endOfInput = false;
+
+	unsigned long numFrames = 0, numMarkers = 0;
+	double startTime = FrameRing::now(), lastReport = startTime;
+	while( true ) {
+		while( !endOfInput && nextSubmit - nextWrite < maxInFlight ) {
+			Chunk *chunk = new Chunk();
+			chunk->done = false;
+			if( shardFrames ) {
+				if( !source->read( chunk->image, chunk->time ) ) {
+					delete chunk;
+					endOfInput = true;
+					break;
+				}
+				chunk->first = nextSubmit;
+				chunk->count = 1;
+			} else {
+				if( nextSubmit >= numChunks ) {
+					delete chunk;
+					endOfInput = true;
+					break;
+				}
+				chunk->first = nextSubmit * chunkSize;
+				chunk->count = min( (unsigned long)chunkSize, frameCount - chunk->first );
+			}
+			{
+				std::lock_guard< std::mutex > lock( chunkMutex );
+				inFlight[ nextSubmit ] = chunk;
+			}
+			pool.submit( [chunk] { processChunk( chunk ); } );
+			nextSubmit++;
+		}
+		if( nextWrite == nextSubmit )
+			break;
+
+		Chunk *chunk;
+		{
+			std::unique_lock< std::mutex > lock( chunkMutex );
+			chunk = inFlight[ nextWrite ];
+			chunkDone.wait( lock, [chunk] { return chunk->done; } );
+			inFlight.erase( nextWrite );
+		}
+		for( unsigned int i = 0; i < chunk->frames.size(); i++ ) {
+			writer.write( chunk->frames[i] );
+			numMarkers += chunk->frames[i].markers.size();
+		}
+		numFrames += chunk->frames.size();
+		delete chunk;
+		nextWrite++;
+
+		double now = FrameRing::now();
+		if( now - lastReport >= 5.0 ) {
+			if( frameCount > 0 )
+				fprintf( stderr, "[batch]: %lu of %ld frames, %.1f frames/s\n", numFrames, frameCount, numFrames / ( now - startTime ) );
+			else
+				fprintf( stderr, "[batch]: %lu frames, %.1f frames/s\n", numFrames, numFrames / ( now - startTime ) );
+			lastReport = now;
+		}
+	}
+	writer.close();
+
+	double elapsed = FrameRing::now() - startTime;
+	fprintf( stderr, "[batch]: %lu frames, %lu markers in %.1fs, %.1f frames/s on %u threads\n",
+			 numFrames, numMarkers, elapsed, elapsed > 0 ? numFrames / elapsed : 0.0, pool.getNumThreads() );
+	pool.printStats();
+	if( comparePoses && comparison.markers > 0 ) {
+		fprintf( stderr, "[batch]: pose solvers over %lu markers:\n", comparison.markers );
+		for( int method = 0; method < NUM_POSE_METHODS; method++ )
+			fprintf( stderr, "[batch]:   %-12s %8.2f us/marker, %.3f px mean reprojection error\n", POSE_METHOD_NAMES[ method ],
+					 1e6 * comparison.seconds[ method ] / comparison.markers, comparison.error[ method ] / comparison.markers );
+	}
+
+	if( shardFrames )
+		delete source;
+	for( unsigned int i = 0; i < idleSources.size(); i++ )
+		delete idleSources[i];
+	return 0;
+}
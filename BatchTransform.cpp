@@ -0,0 +1,255 @@
+#include "BatchTransform.h"
+
+#ifdef __AVX__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <condition_variable>
+#include <math.h>
+#include <mutex>
+
+
+	// below this many points the threads cost more than they save
+	static const size_t PARALLEL_MIN_POINTS = 1 << 16;
+
+	void SoaPoints::gather( const float *xyz, size_t count ) {
+		resize( count );
+		for( size_t i = 0; i < count; i++ ) {
+			x[i] = xyz[ 3*i ];
+			y[i] = xyz[ 3*i + 1 ];
+			z[i] = xyz[ 3*i + 2 ];
+		}
+	}
+
+	void SoaPoints::scatter( float *xyz ) const {
+		for( size_t i = 0; i < size(); i++ ) {
+			xyz[ 3*i ] = x[i];
+			xyz[ 3*i + 1 ] = y[i];
+			xyz[ 3*i + 2 ] = z[i];
+		}
+	}
+
+	void SoaPoints::gather( const vector< Point* > &points ) {
+		resize( points.size() );
+		for( size_t i = 0; i < points.size(); i++ ) {
+			x[i] = (float)points[i]->getX();
+			y[i] = (float)points[i]->getY();
+			z[i] = (float)points[i]->getZ();
+		}
+	}
+
+	/* what the kernel applies: m's rows, and which parts of them to use */
+	struct TransformKernel {
+		float rows[4][4];
+		bool translate;			// points: add the last column
+		bool project;			// points under a projective m: divide by w
+		bool normalise;			// normals: rescale each to unit length
+		const float *x, *y, *z;
+		float *outX, *outY, *outZ;
+	};
+
+#ifdef __AVX__
+#ifdef __FMA__
+#define MADD8( a, b, c ) _mm256_fmadd_ps( a, b, c )
+#else
+#define MADD8( a, b, c ) _mm256_add_ps( _mm256_mul_ps( a, b ), c )
+#endif
+#endif
+#ifdef __SSE2__
+#define MADD4( a, b, c ) _mm_add_ps( _mm_mul_ps( a, b ), c )
+#endif
+
+	/*
+	 * Points begin to end: eight at a time with AVX, then four at a time
+	 * with SSE, then one at a time.  Each output coordinate is one row of
+	 * the matrix, broadcast once, against the x, y and z streams.  Every
+	 * point is loaded before its result is stored, so in and out may be
+	 * the same arrays.
+	 */
+	static void runKernel( const TransformKernel &k, size_t begin, size_t end ) {
+		size_t i = begin;
+#ifdef __AVX__
+		{
+			__m256 m[4][4];
+			for( int r = 0; r < 4; r++ )
+				for( int c = 0; c < 4; c++ )
+					m[r][c] = _mm256_set1_ps( k.translate || c < 3 ? k.rows[r][c] : 0.0f );
+			__m256 tiny = _mm256_set1_ps( 1e-30f ), one = _mm256_set1_ps( 1.0f );
+			for( ; i + 8 <= end; i += 8 ) {
+				__m256 x = _mm256_loadu_ps( k.x + i ), y = _mm256_loadu_ps( k.y + i ), z = _mm256_loadu_ps( k.z + i );
+				__m256 out[3];
+				for( int r = 0; r < 3; r++ )
+					out[r] = MADD8( m[r][0], x, MADD8( m[r][1], y, MADD8( m[r][2], z, m[r][3] ) ) );
+				if( k.project ) {
+					__m256 w = MADD8( m[3][0], x, MADD8( m[3][1], y, MADD8( m[3][2], z, m[3][3] ) ) );
+					__m256 inverse = _mm256_div_ps( one, w );
+					for( int r = 0; r < 3; r++ )
+						out[r] = _mm256_mul_ps( out[r], inverse );
+				}
+				if( k.normalise ) {
+					__m256 length2 = MADD8( out[0], out[0], MADD8( out[1], out[1], _mm256_mul_ps( out[2], out[2] ) ) );
+					__m256 inverse = _mm256_div_ps( one, _mm256_sqrt_ps( _mm256_max_ps( length2, tiny ) ) );
+					for( int r = 0; r < 3; r++ )
+						out[r] = _mm256_mul_ps( out[r], inverse );
+				}
+				_mm256_storeu_ps( k.outX + i, out[0] );
+				_mm256_storeu_ps( k.outY + i, out[1] );
+				_mm256_storeu_ps( k.outZ + i, out[2] );
+			}
+		}
+#endif
+#ifdef __SSE2__
+		{
+			__m128 m[4][4];
+			for( int r = 0; r < 4; r++ )
+				for( int c = 0; c < 4; c++ )
+					m[r][c] = _mm_set1_ps( k.translate || c < 3 ? k.rows[r][c] : 0.0f );
+			__m128 tiny = _mm_set1_ps( 1e-30f ), one = _mm_set1_ps( 1.0f );
+			for( ; i + 4 <= end; i += 4 ) {
+				__m128 x = _mm_loadu_ps( k.x + i ), y = _mm_loadu_ps( k.y + i ), z = _mm_loadu_ps( k.z + i );
+				__m128 out[3];
+				for( int r = 0; r < 3; r++ )
+					out[r] = MADD4( m[r][0], x, MADD4( m[r][1], y, MADD4( m[r][2], z, m[r][3] ) ) );
+				if( k.project ) {
+					__m128 w = MADD4( m[3][0], x, MADD4( m[3][1], y, MADD4( m[3][2], z, m[3][3] ) ) );
+					__m128 inverse = _mm_div_ps( one, w );
+					for( int r = 0; r < 3; r++ )
+						out[r] = _mm_mul_ps( out[r], inverse );
+				}
+				if( k.normalise ) {
+					__m128 length2 = MADD4( out[0], out[0], MADD4( out[1], out[1], _mm_mul_ps( out[2], out[2] ) ) );
+					__m128 inverse = _mm_div_ps( one, _mm_sqrt_ps( _mm_max_ps( length2, tiny ) ) );
+					for( int r = 0; r < 3; r++ )
+						out[r] = _mm_mul_ps( out[r], inverse );
+				}
+				_mm_storeu_ps( k.outX + i, out[0] );
+				_mm_storeu_ps( k.outY + i, out[1] );
+				_mm_storeu_ps( k.outZ + i, out[2] );
+			}
+		}
+#endif
+		for( ; i < end; i++ ) {
+			float x = k.x[i], y = k.y[i], z = k.z[i];
+			float out[3];
+			for( int r = 0; r < 3; r++ )
+				out[r] = k.rows[r][0] * x + k.rows[r][1] * y + k.rows[r][2] * z + ( k.translate ? k.rows[r][3] : 0.0f );
+			if( k.project ) {
+				float inverse = 1.0f / ( k.rows[3][0] * x + k.rows[3][1] * y + k.rows[3][2] * z + k.rows[3][3] );
+				for( int r = 0; r < 3; r++ )
+					out[r] *= inverse;
+			}
+			if( k.normalise ) {
+				float length2 = out[0] * out[0] + out[1] * out[1] + out[2] * out[2];
+				float inverse = 1.0f / sqrtf( length2 > 1e-30f ? length2 : 1e-30f );
+				for( int r = 0; r < 3; r++ )
+					out[r] *= inverse;
+			}
+			k.outX[i] = out[0];
+			k.outY[i] = out[1];
+			k.outZ[i] = out[2];
+		}
+	}
+
+	/* split the points into a slice per pool thread plus one for the */
+	/* caller, rounded to whole SIMD blocks, and wait for them all */
+	static void runSliced( const TransformKernel &k, size_t count, WorkerPool *pool ) {
+		if( pool == NULL || count < PARALLEL_MIN_POINTS ) {
+			runKernel( k, 0, count );
+			return;
+		}
+
+		size_t numSlices = pool->getNumThreads() + 1;
+		size_t sliceSize = ( ( count + numSlices - 1 ) / numSlices + 7 ) & ~(size_t)7;
+		std::mutex mutex;
+		std::condition_variable finished;
+		unsigned int remaining = 0;
+		for( size_t begin = sliceSize; begin < count; begin += sliceSize ) {
+			size_t end = min( count, begin + sliceSize );
+			{
+				std::lock_guard< std::mutex > lock( mutex );
+				remaining++;
+			}
+			pool->submit( [&k, begin, end, &mutex, &finished, &remaining] {
+				runKernel( k, begin, end );
+				std::lock_guard< std::mutex > lock( mutex );
+				if( --remaining == 0 )
+					finished.notify_one();
+			} );
+		}
+		runKernel( k, 0, min( count, sliceSize ) );
+
+		std::unique_lock< std::mutex > lock( mutex );
+		finished.wait( lock, [&remaining] { return remaining == 0; } );
+	}
+
+	static void setOutput( TransformKernel &k, const SoaPoints &in, SoaPoints &out ) {
+		out.resize( in.size() );
+		k.x = in.x.data();
+		k.y = in.y.data();
+		k.z = in.z.data();
+		k.outX = out.x.data();
+		k.outY = out.y.data();
+		k.outZ = out.z.data();
+	}
+
+	void transformPoints( const Mat4f &m, const SoaPoints &in, SoaPoints &out, WorkerPool *pool ) {
+		TransformKernel k;
+		for( int r = 0; r < 4; r++ )
+			for( int c = 0; c < 4; c++ )
+				k.rows[r][c] = m( r, c );
+		k.translate = true;
+		k.project = !m.isAffine();
+		k.normalise = false;
+		setOutput( k, in, out );
+		runSliced( k, in.size(), pool );
+	}
+
+	bool transformNormals( const Mat4f &m, const SoaPoints &in, SoaPoints &out, WorkerPool *pool ) {
+		Mat3f inverse;
+		if( !invert( m.block< 3, 3 >(), inverse ) )
+			return false;
+
+		// rows of the inverse-transpose are the inverse's columns
+		TransformKernel k;
+		for( int r = 0; r < 4; r++ )
+			for( int c = 0; c < 4; c++ )
+				k.rows[r][c] = r < 3 && c < 3 ? inverse( c, r ) : 0.0f;
+		k.translate = false;
+		k.project = false;
+		k.normalise = true;
+		setOutput( k, in, out );
+		runSliced( k, in.size(), pool );
+		return true;
+	}
+	
+	bool transformArrays( const Mat4f &m, const vector< XyzArrays > &levels, WorkerPool *pool, size_t *numTransformed ) {
+		// checked before any level changes, so a singular m leaves them all whole
+		Mat3f inverse;
+		if( !invert( m.block< 3, 3 >(), inverse ) )
+			return false;
+		
+		SoaPoints streams;
+		size_t count = 0;
+		for( size_t level = 0; level < levels.size(); level++ ) {
+			vector< float > &positions = *levels[level].positions;
+			if( positions.empty() )
+				continue;
+			streams.gather( &positions[0], positions.size() / 3 );
+			transformPoints( m, streams, streams, pool );
+			streams.scatter( &positions[0] );
+			count += streams.size();
+			
+			vector< float > *normals = levels[level].normals;
+			if( normals == NULL || normals->empty() )
+				continue;
+			streams.gather( &(*normals)[0], normals->size() / 3 );
+			transformNormals( m, streams, streams, pool );
+			streams.scatter( &(*normals)[0] );
+			count += streams.size();
+		}
+		if( numTransformed != NULL )
+			*numTransformed = count;
+		return true;
+	}
@@ -0,0 +1,52 @@
+#ifndef _BATCH_TRANSFORM_H_
+#define _BATCH_TRANSFORM_H_ 1
+
+#include "FixedMatrix.h"
+#include "Point.h"
+#include "WorkerPool.h"
+
+#include <stddef.h>
+#include <vector>
+using namespace std;
+
+
+
+	/* points or normals as three separate coordinate streams, so the */
+	/* transform kernels load eight x's (AVX) or four (SSE) at a time */
+	/* instead of picking coordinates out of xyz triples */
+	struct SoaPoints {
+		vector< float > x, y, z;
+
+		size_t size() const { return x.size(); }
+		void resize( size_t count ) { x.resize( count ); y.resize( count ); z.resize( count ); }
+
+		/* from and back to interleaved xyz, as the GL vertex arrays are */
+		void gather( const float *xyz, size_t count );
+		void scatter( float *xyz ) const;
+		void gather( const vector< Point* > &points );
+	};
+
+	/* out = m ( x, y, z, 1 ), divided through by w when m is projective; */
+	/* out may be in; with a pool, large arrays are split across its */
+	/* threads, the caller taking a share (so never call from a pool task) */
+	void transformPoints( const Mat4f &m, const SoaPoints &in, SoaPoints &out, WorkerPool *pool = NULL );
+
+	/* out = the inverse-transpose of m's upper 3x3 applied to in, each */
+	/* renormalised, which keeps normals perpendicular to their surface */
+	/* under non-uniform scale; false, out untouched, if m is singular */
+	bool transformNormals( const Mat4f &m, const SoaPoints &in, SoaPoints &out, WorkerPool *pool = NULL );
+
+	/* one level of a model: interleaved xyz positions and their normals, */
+	/* as the GL vertex arrays are; normals may be empty */
+	struct XyzArrays {
+		vector< float > *positions;
+		vector< float > *normals;
+	};
+
+	/* transformPoints and transformNormals over every level, in place; */
+	/* false, every array untouched, if m is singular; numTransformed, */
+	/* if given, counts the points and normals */
+	bool transformArrays( const Mat4f &m, const vector< XyzArrays > &levels, WorkerPool *pool = NULL, size_t *numTransformed = NULL );
+
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * transformBench: points per second through the batch transform kernels,
+ * against transforming the interleaved arrays one point at a time.
+ *
+ *   transformBench [points] [threads]
+ *
+ * Compares, for points and for normals:
+ *   per point  transformPoint over interleaved xyz; normals through the
+ *              inverse-transpose and renormalised one at a time
+ *   kernel     transformPoints / transformNormals on streams already
+ *              gathered, on the calling thread
+ *   pooled     the same, sliced across a WorkerPool of threads (0, the
+ *              default, for one per hardware thread)
+ *   arrays     transformArrays, as Object::transform calls it: gather,
+ *              transform and scatter, pooled
+ * Each is the best of a few runs.  Build once as is and once with
+ * USING_AVX=1 to compare the kernels; the first line says which this
+ * binary uses.  The Makefile builds without optimisation, so pass CFLAGS
+ * with -O2 for representative numbers.
+ */
+
+#include "BatchTransform.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+using namespace std;
+
+
+static const int RUNS = 5;
+
+static double now() {
+	return chrono::duration< double >( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static const char* simdPath() {
+#if defined(__AVX__)
+	return "AVX";
+#elif defined(__SSE2__)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+/* millions of points a second, the best of RUNS */
+static double measure( size_t count, const function< void() > &run ) {
+	double best = 1e30;
+	for( int r = 0; r < RUNS; r++ ) {
+		double start = now();
+		run();
+		best = min( best, now() - start );
+	}
+	return count / best / 1e6;
+}
+
+int main( int argc, char* argv[] ) {
+	long count = argc > 1 ? atol( argv[1] ) : 4000000;
+	int numThreads = argc > 2 ? atoi( argv[2] ) : 0;
+	if( count <= 0 || numThreads < 0 ) {
+		fprintf( stderr, "usage: %s [points] [threads]\n", argv[0] );
+		return 1;
+	}
+
+	WorkerPool pool( numThreads );
+	printf( "[transformBench]: %s kernels, %ld points, %u pool threads plus the caller\n",
+			simdPath(), count, pool.getNumThreads() );
+
+	Mat4f m = Mat4f::identity();
+	float angle = 0.6f, c = cosf( angle ), s = sinf( angle );
+	m( 0, 0 ) = 2.0f * c;	m( 0, 1 ) = -s;			m( 0, 3 ) = 0.5f;
+	m( 1, 0 ) = 2.0f * s;	m( 1, 1 ) = c;			m( 1, 3 ) = -1.0f;
+	m( 2, 2 ) = 0.5f;								m( 2, 3 ) = 3.0f;
+	Mat3f inverse;
+	invert( m.block< 3, 3 >(), inverse );
+
+	vector< float > positions( 3 * count ), normals( 3 * count );
+	for( size_t i = 0; i < positions.size(); i++ ) {
+		positions[i] = rand() / (float)RAND_MAX * 2.0f - 1.0f;
+		normals[i] = positions[i];
+	}
+	SoaPoints streams;
+	streams.gather( &positions[0], count );
+
+	double perPoint = measure( count, [&] {
+		float out[3];
+		for( long i = 0; i < count; i++ ) {
+			transformPoint( m, &positions[ 3*i ], out );
+			positions[ 3*i ] = out[0];
+			positions[ 3*i + 1 ] = out[1];
+			positions[ 3*i + 2 ] = out[2];
+		}
+	} );
+	double kernel = measure( count, [&] { transformPoints( m, streams, streams, NULL ); } );
+	double pooled = measure( count, [&] { transformPoints( m, streams, streams, &pool ); } );
+	printf( "[transformBench]: points   Mpoints/s: per point %7.1f  kernel %7.1f  pooled %7.1f\n", perPoint, kernel, pooled );
+
+	double perNormal = measure( count, [&] {
+		for( long i = 0; i < count; i++ ) {
+			float *n = &normals[ 3*i ], out[3];
+			for( int r = 0; r < 3; r++ )
+				out[r] = inverse( 0, r ) * n[0] + inverse( 1, r ) * n[1] + inverse( 2, r ) * n[2];
+			float length2 = out[0] * out[0] + out[1] * out[1] + out[2] * out[2];
+			float scale = 1.0f / sqrtf( length2 > 1e-30f ? length2 : 1e-30f );
+			for( int r = 0; r < 3; r++ )
+				n[r] = out[r] * scale;
+		}
+	} );
+	kernel = measure( count, [&] { transformNormals( m, streams, streams, NULL ); } );
+	pooled = measure( count, [&] { transformNormals( m, streams, streams, &pool ); } );
+	printf( "[transformBench]: normals  Mpoints/s: per point %7.1f  kernel %7.1f  pooled %7.1f\n", perNormal, kernel, pooled );
+
+	vector< XyzArrays > levels( 1 );
+	levels[0].positions = &positions;
+	levels[0].normals = &normals;
+	double arrays = measure( 2 * count, [&] { transformArrays( m, levels, &pool ); } );
+	printf( "[transformBench]: arrays   Mpoints/s: positions and normals, gathered and scattered %7.1f\n", arrays );
+	return 0;
+}
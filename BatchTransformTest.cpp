@@ -0,0 +1,239 @@
+/*
+ * transformTest: checks the batch transform kernels against Matrix's
+ * double precision math, without a window.
+ *
+ *   transformTest
+ *
+ * For point counts either side of every SIMD width, and counts large
+ * enough to be sliced across a WorkerPool:
+ *   points come out as m ( x, y, z, 1 ), divided by w when m is projective;
+ *   normals come out through the inverse-transpose of m's upper 3x3, unit
+ *   length and perpendicular to the transformed surface;
+ *   transforming in place gives what transforming into a copy does.
+ * Then a singular m: transformNormals refuses it leaving out untouched,
+ * and transformArrays refuses it before any level changes.
+ *
+ * Build once as is and once with USING_AVX=1 to check both kernels; the
+ * first line says which this binary uses.  Exits 1 if any check fails.
+ */
+
+#include "BatchTransform.h"
+#include "Matrix.h"
+#include "WorkerPool.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+using namespace std;
+
+
+static int failures = 0;
+
+static void check( bool passed, const char *what, size_t count ) {
+	if( !passed ) {
+		fprintf( stderr, "[transformTest]: FAILED %s (%lu points)\n", what, (unsigned long)count );
+		failures++;
+	}
+}
+
+static const char* simdPath() {
+#if defined(__AVX__)
+	return "AVX";
+#elif defined(__SSE2__)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+static float randomFloat() {
+	return rand() / (float)RAND_MAX * 2.0f - 1.0f;
+}
+
+static void randomPoints( size_t count, SoaPoints &points ) {
+	points.resize( count );
+	for( size_t i = 0; i < count; i++ ) {
+		points.x[i] = randomFloat();
+		points.y[i] = randomFloat();
+		points.z[i] = randomFloat();
+	}
+}
+
+/* rotation, non-uniform scale and translation; projective adds a */
+/* bottom row that keeps w well away from zero over the unit cube */
+static Mat4f makeTransform( bool projective ) {
+	Matrix rotation, scale, translation;
+	rotation.makeRotation( 0.7, 0.6, 0.0, 0.8 );
+	scale.set( 0, 0, 2.5 );
+	scale.set( 1, 1, 0.5 );
+	scale.set( 2, 2, 1.5 );
+	translation.makeTranslation( 0.25, -3.0, 7.0 );
+	for( unsigned int i = 0; i < 3; i++ )
+		translation.set( i, i, 1 );
+	Mat4 m = ( translation * rotation * scale ).toMat4();
+	if( projective ) {
+		m( 3, 0 ) = 0.1;
+		m( 3, 1 ) = -0.2;
+		m( 3, 2 ) = 0.15;
+		m( 3, 3 ) = 2.0;
+	}
+	Mat4f mf;
+	for( int r = 0; r < 4; r++ )
+		for( int c = 0; c < 4; c++ )
+			mf( r, c ) = (float)m( r, c );
+	return mf;
+}
+
+static Matrix toMatrix( const Mat4f &m ) {
+	Matrix result( 4, 4 );
+	for( unsigned int r = 0; r < 4; r++ )
+		for( unsigned int c = 0; c < 4; c++ )
+			result.set( r, c, m( r, c ) );
+	return result;
+}
+
+static double distance( double ax, double ay, double az, double bx, double by, double bz ) {
+	return sqrt( ( ax - bx ) * ( ax - bx ) + ( ay - by ) * ( ay - by ) + ( az - bz ) * ( az - bz ) );
+}
+
+static void checkPoints( const Mat4f &m, size_t count, WorkerPool *pool ) {
+	SoaPoints in, out;
+	randomPoints( count, in );
+	transformPoints( m, in, out, pool );
+	check( out.size() == count, "points out sized as in", count );
+
+	Matrix reference = toMatrix( m ), point( 4, 1 );
+	double worst = 0;
+	for( size_t i = 0; i < count; i++ ) {
+		point.set( 0, 0, in.x[i] );
+		point.set( 1, 0, in.y[i] );
+		point.set( 2, 0, in.z[i] );
+		point.set( 3, 0, 1.0 );
+		Matrix expected = reference * point;
+		double w = expected.get( 3, 0 );
+		worst = fmax( worst, distance( out.x[i], out.y[i], out.z[i],
+									   expected.get( 0, 0 ) / w, expected.get( 1, 0 ) / w, expected.get( 2, 0 ) / w ) );
+	}
+	check( worst < 1e-4, m.isAffine() ? "affine points match Matrix" : "projective points match Matrix", count );
+
+	SoaPoints inPlace = in;
+	transformPoints( m, inPlace, inPlace, pool );
+	check( inPlace.x == out.x && inPlace.y == out.y && inPlace.z == out.z, "points in place match points into a copy", count );
+}
+
+static void checkNormals( const Mat4f &m, size_t count, WorkerPool *pool ) {
+	SoaPoints in, out;
+	randomPoints( count, in );
+	check( transformNormals( m, in, out, pool ), "normals of an invertible m are transformed", count );
+	check( out.size() == count, "normals out sized as in", count );
+
+	Matrix upper = toMatrix( m ).getSubMatrix( 3, 3 ), inverse;
+	upper.inverse( inverse );
+	inverse.transpose();
+	Matrix normal( 3, 1 ), tangent( 3, 1 );
+	double worstDirection = 0, worstLength = 0, worstDot = 0;
+	for( size_t i = 0; i < count; i++ ) {
+		normal.set( 0, 0, in.x[i] );
+		normal.set( 1, 0, in.y[i] );
+		normal.set( 2, 0, in.z[i] );
+		Matrix expected = inverse * normal;
+		double length = sqrt( expected.get( 0, 0 ) * expected.get( 0, 0 ) + expected.get( 1, 0 ) * expected.get( 1, 0 )
+							  + expected.get( 2, 0 ) * expected.get( 2, 0 ) );
+		if( length < 1e-3 )
+			continue;			// too short for a direction to compare
+		worstDirection = fmax( worstDirection, distance( out.x[i], out.y[i], out.z[i], expected.get( 0, 0 ) / length,
+														 expected.get( 1, 0 ) / length, expected.get( 2, 0 ) / length ) );
+		worstLength = fmax( worstLength, fabs( distance( out.x[i], out.y[i], out.z[i], 0, 0, 0 ) - 1.0 ) );
+
+		// a tangent of the surface, perpendicular to the normal, carried by m
+		tangent.set( 0, 0, in.y[i] );
+		tangent.set( 1, 0, -in.x[i] );
+		tangent.set( 2, 0, 0 );
+		Matrix moved = upper * tangent;
+		double dot = out.x[i] * moved.get( 0, 0 ) + out.y[i] * moved.get( 1, 0 ) + out.z[i] * moved.get( 2, 0 );
+		worstDot = fmax( worstDot, fabs( dot ) );
+	}
+	check( worstDirection < 1e-5, "normals match Matrix's inverse-transpose", count );
+	check( worstLength < 1e-5, "normals are unit length", count );
+	check( worstDot < 1e-5, "normals stay perpendicular to transformed tangents", count );
+
+	SoaPoints inPlace = in;
+	transformNormals( m, inPlace, inPlace, pool );
+	check( inPlace.x == out.x && inPlace.y == out.y && inPlace.z == out.z, "normals in place match normals into a copy", count );
+}
+
+static void checkSingular( WorkerPool *pool ) {
+	Mat4f flatten = makeTransform( false );
+	for( int c = 0; c < 4; c++ )
+		flatten( 2, c ) = 0;			// everything onto z = 0
+
+	SoaPoints in, out;
+	randomPoints( 37, in );
+	randomPoints( 5, out );
+	SoaPoints before = out;
+	check( !transformNormals( flatten, in, out, pool ), "singular m refused for normals", 37 );
+	check( out.x == before.x && out.y == before.y && out.z == before.z, "refused normals leave out untouched", 37 );
+
+	// two levels, the second without normals; none may change
+	vector< float > positions[2], normals[2];
+	for( int level = 0; level < 2; level++ ) {
+		for( int i = 0; i < 3 * ( 20 + 7 * level ); i++ )
+			positions[level].push_back( randomFloat() );
+		if( level == 0 )
+			normals[level] = positions[level];
+	}
+	vector< XyzArrays > levels( 2 );
+	for( int level = 0; level < 2; level++ ) {
+		levels[level].positions = &positions[level];
+		levels[level].normals = &normals[level];
+	}
+	vector< float > positionsBefore[2] = { positions[0], positions[1] }, normalsBefore = normals[0];
+	size_t numTransformed = 12345;
+	check( !transformArrays( flatten, levels, pool, &numTransformed ), "singular m refused for a model", 47 );
+	check( positions[0] == positionsBefore[0] && positions[1] == positionsBefore[1] && normals[0] == normalsBefore,
+		   "refused model left untouched", 47 );
+
+	// and an invertible m transforms every level, counting what it did
+	check( transformArrays( makeTransform( false ), levels, pool, &numTransformed ), "invertible m accepted for a model", 47 );
+	check( positions[0] != positionsBefore[0] && positions[1] != positionsBefore[1] && normals[0] != normalsBefore,
+		   "every level transformed", 47 );
+	check( numTransformed == 20 + 27 + 20, "points and normals counted", 47 );
+
+	// an empty level is skipped, not indexed
+	vector< float > empty;
+	levels[1].positions = &empty;
+	levels[1].normals = &empty;
+	check( transformArrays( makeTransform( false ), levels, pool, &numTransformed ) && numTransformed == 40,
+		   "empty level skipped", 0 );
+}
+
+int main( int argc, char* argv[] ) {
+	srand( 441 );
+	printf( "[transformTest]: %s kernels\n", simdPath() );
+
+	// either side of 4 and 8, then either side of the 1 << 16 points a
+	// pool starts slicing at, with slices that end mid SIMD block
+	size_t counts[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 12, 15, 16, 17, 31, 33, 1000,
+						( 1 << 16 ) - 1, 1 << 16, ( 1 << 16 ) + 1, 3 * ( 1 << 16 ) + 13 };
+	WorkerPool pool( 3 );
+	Mat4f affine = makeTransform( false ), projective = makeTransform( true );
+	check( affine.isAffine() && !projective.isAffine(), "test transforms are affine and projective", 0 );
+	for( size_t i = 0; i < sizeof( counts ) / sizeof( counts[0] ); i++ ) {
+		for( int pooled = 0; pooled < 2; pooled++ ) {
+			WorkerPool *p = pooled ? &pool : NULL;
+			checkPoints( affine, counts[i], p );
+			checkPoints( projective, counts[i], p );
+			checkNormals( affine, counts[i], p );
+		}
+	}
+	checkSingular( NULL );
+	checkSingular( &pool );
+
+	if( failures > 0 ) {
+		fprintf( stderr, "[transformTest]: %d checks failed\n", failures );
+		return 1;
+	}
+	printf( "[transformTest]: all checks passed\n" );
+	return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef _BOUNDED_QUEUE_H_
+#define _BOUNDED_QUEUE_H_ 1
+
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+
+
+	/* fixed capacity FIFO handing items between threads; a full queue */
+	/* blocks the producer, which is what bounds the pipeline's latency */
+	/* items are moved in and out of preallocated slots, so passing them */
+	/* through never allocates */
+	template< typename T >
+	class BoundedQueue {
+	public:
+		BoundedQueue( unsigned int capacity ) {
+			_capacity = capacity < 1 ? 1 : capacity;
+			_items.resize( _capacity );
+			_head = 0;
+			_count = 0;
+			_closed = false;
+		}
+		
+		/* wait for room, then move item in; false if the queue was closed */
+		bool push( T &item ) {
+			std::unique_lock< std::mutex > lock( _mutex );
+			_notFull.wait( lock, [this] { return _closed || _count < _capacity; } );
+			if( _closed )
+				return false;
+			_items[ ( _head + _count ) % _capacity ] = std::move( item );
+			_count++;
+			_notEmpty.notify_one();
+			return true;
+		}
+		
+		/* move item in only if there is room right now */
+		bool tryPush( T &item ) {
+			std::lock_guard< std::mutex > lock( _mutex );
+			if( _closed || _count >= _capacity )
+				return false;
+			_items[ ( _head + _count ) % _capacity ] = std::move( item );
+			_count++;
+			_notEmpty.notify_one();
+			return true;
+		}
+		
+		/* move the oldest item out if there is one */
+		bool tryPop( T &item ) {
+			std::lock_guard< std::mutex > lock( _mutex );
+			if( _count == 0 )
+				return false;
+			item = std::move( _items[ _head ] );
+			_head = ( _head + 1 ) % _capacity;
+			_count--;
+			_notFull.notify_one();
+			return true;
+		}
+		
+		/* wake every waiter and refuse further pushes */
+		void close() {
+			std::lock_guard< std::mutex > lock( _mutex );
+			_closed = true;
+			_notFull.notify_all();
+			_notEmpty.notify_all();
+		}
+		
+		unsigned int size() {
+			std::lock_guard< std::mutex > lock( _mutex );
+			return _count;
+		}
+		
+		unsigned int capacity() { return _capacity; }
+		
+	private:
+		std::mutex _mutex;
+		std::condition_variable _notFull;
+		std::condition_variable _notEmpty;
+		std::vector< T > _items;
+		unsigned int _capacity;
+		unsigned int _head;
+		unsigned int _count;
+		bool _closed;
+	};
+
+
+#endif
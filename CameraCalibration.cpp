@@ -0,0 +1,171 @@
+#include "CameraCalibration.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+	#include <direct.h>
+#else
+	#include <sys/stat.h>
+#endif
+
+	/* map cache file layout: header, then map1 (CV_16SC2) and map2 */
+	/* (CV_16UC1) rows back to back */
+	struct UndistortMapHeader {
+		char magic[4];
+		unsigned int version;
+		unsigned int width;
+		unsigned int height;
+		unsigned long long key;
+	};
+
+	static const char MAP_MAGIC[4] = { 'U', 'D', 'M', 'P' };
+	static const unsigned int MAP_VERSION = 1;
+
+	CameraCalibration::CameraCalibration( cv::Mat cameraMatrix, cv::Mat distCoeffs, string cacheDirectory ) {
+		_cameraMatrix = cameraMatrix.clone();
+		_distCoeffs = distCoeffs.clone();
+		_cacheDirectory = cacheDirectory;
+	}
+	
+	bool CameraCalibration::load( const string &filename ) {
+		cv::FileStorage storage;
+		if( !storage.open( filename, cv::FileStorage::READ ) ) {
+			fprintf( stderr, "[calibration]: [ERROR]: could not open %s\n", filename.c_str() );
+			return false;
+		}
+		cv::Mat cameraMatrix, distCoeffs;
+		storage[ "camera_matrix" ] >> cameraMatrix;
+		storage[ "distortion_coefficients" ] >> distCoeffs;
+		if( cameraMatrix.rows != 3 || cameraMatrix.cols != 3 ) {
+			fprintf( stderr, "[calibration]: [ERROR]: %s has no 3x3 camera_matrix\n", filename.c_str() );
+			return false;
+		}
+		cameraMatrix.convertTo( _cameraMatrix, CV_64F );
+		if( distCoeffs.empty() )
+			_distCoeffs = cv::Mat::zeros( 5, 1, CV_64F );
+		else
+			distCoeffs.reshape( 1, (int)distCoeffs.total() ).convertTo( _distCoeffs, CV_64F );
+		
+		int width = 0, height = 0;
+		if( !storage[ "image_width" ].empty() )
+			storage[ "image_width" ] >> width;
+		if( !storage[ "image_height" ].empty() )
+			storage[ "image_height" ] >> height;
+		_imageSize = cv::Size( width, height );
+		_filename = filename;
+		return true;
+	}
+	
+	/* calibrations hold for any frame size with the same aspect ratio */
+	cv::Mat CameraCalibration::getCameraMatrix( cv::Size frameSize ) {
+		if( _imageSize.area() == 0 || frameSize == _imageSize )
+			return _cameraMatrix;
+		cv::Mat scaled = _cameraMatrix.clone();
+		scaled.row( 0 ) *= (double)frameSize.width / _imageSize.width;
+		scaled.row( 1 ) *= (double)frameSize.height / _imageSize.height;
+		return scaled;
+	}
+	
+	cv::Mat CameraCalibration::getDistCoeffs() { return _distCoeffs; }
+	bool CameraCalibration::hasDistortion() { return cv::countNonZero( _distCoeffs ) > 0; }
+	
+	string CameraCalibration::describe() {
+		return _filename.empty() ? "built-in calibration" : "calibration " + _filename;
+	}
+	
+	/* 64-bit FNV-1a over everything the maps depend on */
+	unsigned long long CameraCalibration::mapKey( const cv::Mat &cameraMatrix, cv::Size frameSize ) {
+		unsigned long long hash = 14695981039346656037ULL;
+		const cv::Mat *inputs[2] = { &cameraMatrix, &_distCoeffs };
+		for( int i = 0; i < 2; i++ ) {
+			cv::Mat values = inputs[i]->isContinuous() ? *inputs[i] : inputs[i]->clone();
+			const unsigned char *bytes = values.ptr();
+			for( size_t b = 0; b < values.total() * values.elemSize(); b++ ) {
+				hash ^= bytes[b];
+				hash *= 1099511628211ULL;
+			}
+		}
+		int size[2] = { frameSize.width, frameSize.height };
+		for( size_t b = 0; b < sizeof( size ); b++ ) {
+			hash ^= ( (const unsigned char*)size )[b];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+	
+	/*
+	 * CV_16SC2 + CV_16UC1 is remap()'s fixed-point form: integer source
+	 * pixels plus an index into a 32x32 table of interpolation weights, which
+	 * is several times faster than float maps.  Building them means
+	 * undistorting every pixel, so they're kept on disk.
+	 */
+	void CameraCalibration::getUndistortMaps( cv::Size frameSize, cv::Mat &map1, cv::Mat &map2 ) {
+		std::lock_guard< std::mutex > lock( _mapMutex );
+		cv::Mat cameraMatrix = getCameraMatrix( frameSize );
+		unsigned long long key = mapKey( cameraMatrix, frameSize );
+		char name[64];
+		sprintf( name, "/%016llx_%dx%d.map", key, frameSize.width, frameSize.height );
+		string filename = _cacheDirectory + name;
+		
+		if( readMaps( filename, key, frameSize, map1, map2 ) ) {
+			printf( "[calibration]: undistortion maps for %dx%d read from %s\n", frameSize.width, frameSize.height, filename.c_str() );
+			return;
+		}
+		cv::initUndistortRectifyMap( cameraMatrix, _distCoeffs, cv::Mat(), cameraMatrix, frameSize, CV_16SC2, map1, map2 );
+		writeMaps( filename, key, map1, map2 );
+		printf( "[calibration]: undistortion maps for %dx%d built and cached in %s\n", frameSize.width, frameSize.height, filename.c_str() );
+	}
+	
+	bool CameraCalibration::readMaps( const string &filename, unsigned long long key, cv::Size frameSize, cv::Mat &map1, cv::Mat &map2 ) {
+		FILE *fp = fopen( filename.c_str(), "rb" );
+		if( fp == NULL )
+			return false;
+		
+		UndistortMapHeader header;
+		bool valid = fread( &header, sizeof( header ), 1, fp ) == 1
+					 && memcmp( header.magic, MAP_MAGIC, 4 ) == 0 && header.version == MAP_VERSION && header.key == key
+					 && (int)header.width == frameSize.width && (int)header.height == frameSize.height;
+		if( valid ) {
+			map1.create( frameSize, CV_16SC2 );
+			map2.create( frameSize, CV_16UC1 );
+			valid = fread( map1.ptr(), map1.elemSize(), map1.total(), fp ) == map1.total()
+					&& fread( map2.ptr(), map2.elemSize(), map2.total(), fp ) == map2.total();
+		}
+		fclose( fp );
+		return valid;
+	}
+	
+	void CameraCalibration::writeMaps( const string &filename, unsigned long long key, const cv::Mat &map1, const cv::Mat &map2 ) {
+	#ifdef _WIN32
+		_mkdir( _cacheDirectory.c_str() );
+	#else
+		mkdir( _cacheDirectory.c_str(), 0755 );
+	#endif
+		
+		// write through a temporary file so a crash never leaves a torn map
+		string tempFilename = filename + ".tmp";
+		FILE *fp = fopen( tempFilename.c_str(), "wb" );
+		if( fp == NULL ) {
+			fprintf( stderr, "[calibration]: [WARNING]: could not write %s\n", tempFilename.c_str() );
+			return;
+		}
+		UndistortMapHeader header;
+		memcpy( header.magic, MAP_MAGIC, 4 );
+		header.version = MAP_VERSION;
+		header.width = map1.cols;
+		header.height = map1.rows;
+		header.key = key;
+		bool written = fwrite( &header, sizeof( header ), 1, fp ) == 1
+					   && fwrite( map1.ptr(), map1.elemSize(), map1.total(), fp ) == map1.total()
+					   && fwrite( map2.ptr(), map2.elemSize(), map2.total(), fp ) == map2.total();
+		fclose( fp );
+		
+		remove( filename.c_str() );
+		if( !written || rename( tempFilename.c_str(), filename.c_str() ) != 0 ) {
+			fprintf( stderr, "[calibration]: [WARNING]: could not write %s\n", filename.c_str() );
+			remove( tempFilename.c_str() );
+		}
+	}
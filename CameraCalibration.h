@@ -0,0 +1,50 @@
+#ifndef _CAMERA_CALIBRATION_H_
+#define _CAMERA_CALIBRATION_H_ 1
+
+#include <opencv2/core.hpp>
+
+#include <mutex>
+#include <string>
+using namespace std;
+
+
+
+	/* a camera's intrinsics and lens distortion, as written by OpenCV's */
+	/* calibration tools, plus the remap() tables that undo the distortion */
+	class CameraCalibration {
+	public:
+		/* undistortion maps are cached in cacheDirectory, one file per */
+		/* camera and frame size */
+		CameraCalibration( cv::Mat cameraMatrix, cv::Mat distCoeffs, string cacheDirectory = ".undistortcache" );
+		
+		/* reads camera_matrix, distortion_coefficients and, if present, */
+		/* image_width / image_height from a cv::FileStorage file */
+		bool load( const string &filename );
+		
+		/* the camera matrix scaled to frames of the given size; the */
+		/* calibration's own size if it doesn't record one */
+		cv::Mat getCameraMatrix( cv::Size frameSize );
+		cv::Mat getDistCoeffs();
+		bool hasDistortion();
+		string describe();
+		
+		/* fixed-point maps for cv::remap() that undistort frames of the */
+		/* given size into the same camera matrix with no distortion; */
+		/* built once per size, then read back from the cache */
+		void getUndistortMaps( cv::Size frameSize, cv::Mat &map1, cv::Mat &map2 );
+		
+	private:
+		cv::Mat _cameraMatrix;
+		cv::Mat _distCoeffs;
+		cv::Size _imageSize;
+		string _filename;
+		string _cacheDirectory;
+		std::mutex _mapMutex;		// several sessions can share one calibration
+		
+		unsigned long long mapKey( const cv::Mat &cameraMatrix, cv::Size frameSize );
+		bool readMaps( const string &filename, unsigned long long key, cv::Size frameSize, cv::Mat &map1, cv::Mat &map2 );
+		void writeMaps( const string &filename, unsigned long long key, const cv::Mat &map1, const cv::Mat &map2 );
+	};
+
+
+#endif
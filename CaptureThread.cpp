@@ -0,0 +1,110 @@
+#include "CaptureThread.h"
+
+#include <chrono>
+#include <stdio.h>
+
+
+	CaptureThread::CaptureThread( FrameSource *source, FrameRing *ring, FrameScheduler *scheduler ) {
+		_source = source;
+		_ring = ring;
+		_scheduler = scheduler;
+		_replayMode = REPLAY_PACED;
+		_loop = false;
+		_running = false;
+		_loops = 0;
+	}
+	
+	CaptureThread::~CaptureThread() {
+		stop();
+		delete _source;
+	}
+	
+	bool CaptureThread::isOpened() { return _source->isOpened(); }
+	
+	void CaptureThread::setFrameCallback( std::function< void() > callback ) {
+		_frameCallback = callback;
+	}
+	
+	void CaptureThread::setReplay( ReplayMode mode, bool loop ) {
+		_replayMode = mode;
+		_loop = loop;
+	}
+	
+	void CaptureThread::start() {
+		if( _running )
+			return;
+		_running = true;
+		_thread = std::thread( &CaptureThread::run, this );
+	}
+	
+	void CaptureThread::stop() {
+		_running = false;
+		if( _thread.joinable() )
+			_thread.join();
+	}
+	
+	bool CaptureThread::isRunning() { return _running; }
+	unsigned long CaptureThread::getLoops() { return _loops; }
+	
+	/* sleeps in short steps so stop() is never held up for long */
+	void CaptureThread::waitUntil( double time ) {
+		double remaining;
+		while( _running && ( remaining = time - FrameRing::now() ) > 0 )
+			std::this_thread::sleep_for( std::chrono::duration< double >( remaining < 0.05 ? remaining : 0.05 ) );
+	}
+	
+	/*
+	 * Paced replay maps the recording's timestamps onto the wall clock from
+	 * its first frame, so a slow consumer drops frames just as it would with
+	 * a camera.  Fast replay instead waits for each frame to be taken before
+	 * reading the next, so every frame is processed and throughput is bound
+	 * only by decoding and detection.
+	 */
+	void CaptureThread::run() {
+		bool replay = !_source->isLive();
+		double replayStart = -1;		// wall time of the recording's time 0
+		
+		while( _running ) {
+			if( replay && _replayMode == REPLAY_FAST ) {
+				while( _running && _ring->getOccupancy() > 0 )
+					std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+			}
+			
+			cv::Mat *buffer = _ring->beginWrite();
+			if( buffer == NULL ) {
+				// still pull the frame so the driver's queue doesn't go stale
+				_source->skip();
+				continue;
+			}
+			
+			double timestamp;
+			double readStart = FrameRing::now();
+			if( !_source->read( *buffer, timestamp ) ) {
+				if( replay && _loop && _source->rewind() ) {
+					_loops++;
+					replayStart = -1;
+					continue;
+				}
+				if( replay )
+					fprintf( stdout, "[capture]: end of %s\n", _source->describe().c_str() );
+				else
+					fprintf( stderr, "[capture]: [ERROR]: could not read a frame, stopping capture\n" );
+				_running = false;
+				break;
+			}
+			
+			double readSeconds = FrameRing::now() - readStart;
+			
+			if( replay && _replayMode == REPLAY_PACED ) {
+				if( replayStart < 0 )
+					replayStart = FrameRing::now() - timestamp;
+				waitUntil( replayStart + timestamp );
+			}
+			
+			_ring->endWrite( FrameRing::now(), readSeconds );
+			if( _scheduler != NULL )
+				_scheduler->notifyFrameReady();
+			if( _frameCallback )
+				_frameCallback();
+		}
+	}
@@ -0,0 +1,59 @@
+#ifndef _CAPTURE_THREAD_H_
+#define _CAPTURE_THREAD_H_ 1
+
+#include "FrameRing.h"
+#include "FrameScheduler.h"
+#include "FrameSource.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+
+
+	/* reads a frame source on its own thread, pushing timestamped frames */
+	/* into a FrameRing and waking the scheduler for each one */
+	class CaptureThread {
+	public:
+		enum ReplayMode {
+			REPLAY_PACED,		// recordings play back at their recorded rate
+			REPLAY_FAST			// recordings play as fast as they are consumed, none dropped
+		};
+		
+		/* takes ownership of source */
+		CaptureThread( FrameSource *source, FrameRing *ring, FrameScheduler *scheduler = NULL );
+		~CaptureThread();
+		
+		bool isOpened();
+		
+		/* also called after each frame is published, on the capture thread */
+		void setFrameCallback( std::function< void() > callback );
+		
+		/* how recordings are replayed; live sources ignore both */
+		void setReplay( ReplayMode mode, bool loop );
+		
+		void start();
+		void stop();
+		
+		/* false once the source has ended or failed */
+		bool isRunning();
+		unsigned long getLoops();
+		
+	private:
+		FrameSource *_source;
+		FrameRing *_ring;
+		FrameScheduler *_scheduler;
+		std::function< void() > _frameCallback;
+		ReplayMode _replayMode;
+		bool _loop;
+		
+		std::thread _thread;
+		std::atomic< bool > _running;
+		std::atomic< unsigned long > _loops;
+		
+		void run();
+		void waitUntil( double time );
+	};
+
+
+#endif
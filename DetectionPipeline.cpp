@@ -0,0 +1,319 @@
+#include "DetectionPipeline.h"
+
+#include "AllocationCounter.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <math.h>
+#include <stdio.h>
+
+
+	DetectionPipeline::DetectionPipeline( FrameRing *frames, FrameScheduler *frameSignal, FrameScheduler *renderSignal, unsigned int queueDepth )
+		: _results( queueDepth ), _recycled( queueDepth + 2 ) {
+		_frames = frames;
+		_frameSignal = frameSignal;
+		_renderSignal = renderSignal;
+		_markerLength = 1;
+		_calibration = NULL;
+		_rectify = false;
+		_poseMethod = POSE_ITERATIVE;
+		_poseSolverStale = true;
+		_detectionInterval = 1;
+		_framesSinceDetection = 0;
+		_running = false;
+		_numDetected = 0;
+		_totalDetectSeconds = 0;
+		_detectAllocations = 0;
+	}
+	
+	DetectionPipeline::~DetectionPipeline() {
+		stop();
+	}
+	
+	void DetectionPipeline::setDictionary( cv::Ptr< cv::aruco::Dictionary > dictionary, cv::Ptr< cv::aruco::DetectorParameters > detectorParams ) {
+		_dictionary = dictionary;
+		_detector.setDictionary( dictionary, detectorParams );
+	}
+	
+	void DetectionPipeline::setCamera( cv::Mat cameraMatrix, cv::Mat distCoeffs, float markerLength ) {
+		_cameraMatrix = cameraMatrix;
+		_distCoeffs = distCoeffs;
+		_markerLength = markerLength;
+		_calibration = NULL;
+		_poseSolverStale = true;
+	}
+	
+	void DetectionPipeline::setCalibration( CameraCalibration *calibration, float markerLength, bool rectify ) {
+		_calibration = calibration;
+		_rectify = rectify;
+		_markerLength = markerLength;
+		_calibratedSize = cv::Size();
+	}
+	
+	void DetectionPipeline::setPoseMethod( PoseMethod method ) {
+		_poseMethod = method;
+		_poseSolver.setRefinement( method == POSE_IPPE_REFINED );
+	}
+	
+	MarkerDetector* DetectionPipeline::getDetector() { return &_detector; }
+	
+	void DetectionPipeline::setDetectionInterval( unsigned int interval ) {
+		_detectionInterval = interval < 1 ? 1 : interval;
+	}
+	
+	void DetectionPipeline::setGridBoard( int markersX, int markersY, float boardMarkerLength, float markerSeparation, int firstMarker ) {
+		_board = cv::aruco::GridBoard::create( markersX, markersY, boardMarkerLength, markerSeparation, _dictionary, firstMarker );
+		_charucoBoard.release();
+		_boardAxisLength = 0.5f * min( markersX, markersY ) * ( boardMarkerLength + markerSeparation );
+	}
+	
+	void DetectionPipeline::setCharucoBoard( int squaresX, int squaresY, float squareLength, float boardMarkerLength ) {
+		_charucoBoard = cv::aruco::CharucoBoard::create( squaresX, squaresY, squareLength, boardMarkerLength, _dictionary );
+		_board = _charucoBoard;
+		_boardAxisLength = 0.5f * min( squaresX, squaresY ) * squareLength;
+	}
+	
+	void DetectionPipeline::start() {
+		if( _running )
+			return;
+		_running = true;
+		_thread = std::thread( &DetectionPipeline::run, this );
+	}
+	
+	void DetectionPipeline::stop() {
+		_running = false;
+		_results.close();
+		if( _frameSignal != NULL )
+			_frameSignal->notifyFrameReady();
+		if( _thread.joinable() )
+			_thread.join();
+	}
+	
+	/*
+	 * In the steady state every buffer is reused: a result the renderer has
+	 * finished with comes back with its image, which is swapped into the
+	 * capture ring for the new frame, and its vectors, which keep their
+	 * capacity.
+	 */
+	void DetectionPipeline::run() {
+		FrameResult result;
+		
+		while( _running ) {
+			_frameSignal->waitForWork();
+			
+			if( result.image.empty() )
+				_recycled.tryPop( result );
+			
+			if( !processNext( result ) )
+				continue;
+			
+			// blocks while the renderer is queueDepth frames behind
+			if( !_results.push( result ) )
+				break;
+			result.image.release();		// the queue has its own reference now
+			_renderSignal->notifyFrameReady();
+		}
+	}
+	
+	bool DetectionPipeline::processNext( FrameResult &result ) {
+		double readSeconds;
+		if( !_frames->takeNewest( result.image, result.captureTime, &readSeconds ) )
+			return false;
+		result.timings.clear();
+		result.timings.seconds[ STAGE_CAPTURE ] = readSeconds;
+		result.markerIds.clear();
+		result.poseIds.clear();
+		result.rvecs.clear();
+		result.tvecs.clear();
+		result.axisPoints.clear();
+		if( _calibration != NULL )
+			undistort( result );
+		
+		if( ++_framesSinceDetection >= _detectionInterval ) {
+			detect( result );
+			_framesSinceDetection = 0;
+		} else {
+			passThrough( result );
+		}
+		result.timings.seconds[ STAGE_QUEUE ] = result.detectStartTime - result.captureTime - result.timings.seconds[ STAGE_UNDISTORT ];
+		return true;
+	}
+	
+	void DetectionPipeline::detect( FrameResult &result ) {
+		unsigned long long allocations = AllocationCounter::getThreadCount();
+		result.detectStartTime = FrameRing::now();
+		result.detected = true;
+		
+		_detector.detect( result.image, result.markerCorners, result.markerIds );
+		double poseStart = FrameRing::now();
+		
+		if( _board ) {
+			cv::Vec3d rvec, tvec;
+			if( estimateBoardPose( result, rvec, tvec ) ) {
+				result.poseIds.push_back( BOARD_POSE_ID );
+				result.rvecs.push_back( rvec );
+				result.tvecs.push_back( tvec );
+			}
+		} else if( result.markerIds.size() > 0 && _poseMethod != POSE_ITERATIVE ) {
+			if( _poseSolverStale ) {
+				_poseSolver.setCamera( _cameraMatrix, _distCoeffs, _markerLength );
+				_poseSolverStale = false;
+			}
+			_poseSolver.solve( result.markerCorners, result.rvecs, result.tvecs );
+			result.poseIds = result.markerIds;
+		} else if( result.markerIds.size() > 0 ) {
+			cv::aruco::estimatePoseSingleMarkers(
+				result.markerCorners,	// vector of already detected markers corners
+				_markerLength,			// length of the marker's side
+				_cameraMatrix,			// input 3x3 floating-point instrinsic camera matrix K
+				_distCoeffs,			// vector of distortion coefficients of 4, 5, 8 or 12 elements
+				result.rvecs,			// array of output rotation vectors
+				result.tvecs );			// array of output translation vectors
+			result.poseIds = result.markerIds;
+		}
+		projectAxes( result );
+		
+		result.detectEndTime = FrameRing::now();
+		
+		result.timings.seconds[ STAGE_DETECT ] = poseStart - result.detectStartTime;
+		result.timings.seconds[ STAGE_POSE ] = result.detectEndTime - poseStart;
+		
+		_numDetected++;
+		_totalDetectSeconds = _totalDetectSeconds + (result.detectEndTime - result.detectStartTime);
+		_detectAllocations += AllocationCounter::getThreadCount() - allocations;
+	}
+	
+	/*
+	 * Markers of the board that detection missed are looked for again among
+	 * the rejected candidates, where the board's layout says they should be.
+	 * A grid board is then solved from every marker corner at once; a ChArUco
+	 * board from the chessboard corners interpolated between its markers,
+	 * which are more accurate than the marker corners themselves.
+	 */
+	bool DetectionPipeline::estimateBoardPose( FrameResult &result, cv::Vec3d &rvec, cv::Vec3d &tvec ) {
+		if( result.markerIds.empty() )
+			return false;
+		
+		_rejected = _detector.getRejected();
+		cv::aruco::refineDetectedMarkers( result.image, _board, result.markerCorners, result.markerIds, _rejected,
+										  _cameraMatrix, _distCoeffs );
+		
+		if( _charucoBoard ) {
+			cv::aruco::interpolateCornersCharuco( result.markerCorners, result.markerIds, result.image, _charucoBoard,
+												  _charucoCorners, _charucoIds, _cameraMatrix, _distCoeffs );
+			if( _charucoIds.size() < 4 )
+				return false;
+			return cv::aruco::estimatePoseCharucoBoard( _charucoCorners, _charucoIds, _charucoBoard,
+														_cameraMatrix, _distCoeffs, rvec, tvec );
+		}
+		
+		return cv::aruco::estimatePoseBoard( result.markerCorners, result.markerIds, _board,
+											 _cameraMatrix, _distCoeffs, rvec, tvec ) > 0;
+	}
+	
+	void DetectionPipeline::passThrough( FrameResult &result ) {
+		result.detectStartTime = FrameRing::now();
+		result.detected = false;
+		result.markerCorners.clear();
+		result.detectEndTime = FrameRing::now();
+	}
+	
+	/*
+	 * The renderer draws each pose's axes as GL lines over the video, so it
+	 * needs them in pixels: the same projection cv::aruco::drawAxis does,
+	 * written out for four points so nothing is allocated.  Distortion is
+	 * the standard k1, k2, p1, p2, k3 model; any further terms are small at
+	 * the frame centre and left out.
+	 */
+	void DetectionPipeline::projectAxes( FrameResult &result ) {
+		double fx = _cameraMatrix.at< double >( 0, 0 ), fy = _cameraMatrix.at< double >( 1, 1 );
+		double cx = _cameraMatrix.at< double >( 0, 2 ), cy = _cameraMatrix.at< double >( 1, 2 );
+		double k[5] = { 0, 0, 0, 0, 0 };
+		for( int i = 0; i < 5 && i < (int)_distCoeffs.total(); i++ )
+			k[i] = _distCoeffs.at< double >( i );
+		float axisLength = _board ? _boardAxisLength : 0.5f * _markerLength;
+		
+		for( unsigned int i = 0; i < result.poseIds.size(); i++ ) {
+			// closed-form Rodrigues, as cv::Rodrigues allocates
+			const cv::Vec3d &rvec = result.rvecs[i];
+			cv::Matx33d rotation = cv::Matx33d::eye();
+			double angle = sqrt( rvec.dot( rvec ) );
+			if( angle > 1e-12 ) {
+				cv::Vec3d u = rvec * ( 1.0 / angle );
+				double c = cos( angle ), s = sin( angle ), v = 1.0 - c;
+				rotation = cv::Matx33d( c + u[0]*u[0]*v,      u[0]*u[1]*v - u[2]*s, u[0]*u[2]*v + u[1]*s,
+										u[1]*u[0]*v + u[2]*s, c + u[1]*u[1]*v,      u[1]*u[2]*v - u[0]*s,
+										u[2]*u[0]*v - u[1]*s, u[2]*u[1]*v + u[0]*s, c + u[2]*u[2]*v );
+			}
+			for( int axis = -1; axis < 3; axis++ ) {
+				cv::Vec3d point = result.tvecs[i];
+				if( axis >= 0 )
+					point += axisLength * cv::Vec3d( rotation( 0, axis ), rotation( 1, axis ), rotation( 2, axis ) );
+				double z = point[2] > 1e-9 ? point[2] : 1e-9;
+				double x = point[0] / z, y = point[1] / z;
+				double r2 = x*x + y*y;
+				double radial = 1 + r2 * ( k[0] + r2 * ( k[1] + r2 * k[4] ) );
+				double xd = x * radial + 2*k[2]*x*y + k[3]*( r2 + 2*x*x );
+				double yd = y * radial + k[2]*( r2 + 2*y*y ) + 2*k[3]*x*y;
+				result.axisPoints.push_back( cv::Point2f( (float)( fx * xd + cx ), (float)( fy * yd + cy ) ) );
+			}
+		}
+	}
+	
+	/*
+	 * The camera matrix, and the maps when rectifying, follow the frame size,
+	 * so they're set up on the first frame and again if it changes.  Once
+	 * the frame is rectified the pose calls get no distortion coefficients
+	 * at all, which skips their per-point undistortion.
+	 */
+	void DetectionPipeline::undistort( FrameResult &result ) {
+		double start = FrameRing::now();
+		if( result.image.size() != _calibratedSize ) {
+			_calibratedSize = result.image.size();
+			_cameraMatrix = _calibration->getCameraMatrix( _calibratedSize );
+			if( _rectify && _calibration->hasDistortion() ) {
+				_calibration->getUndistortMaps( _calibratedSize, _undistortMap1, _undistortMap2 );
+				_distCoeffs = cv::Mat();
+			} else {
+				_undistortMap1.release();
+				_undistortMap2.release();
+				_distCoeffs = _rectify ? cv::Mat() : _calibration->getDistCoeffs();
+			}
+			_poseSolverStale = true;
+		}
+		if( _undistortMap1.empty() )
+			return;
+		
+		cv::remap( result.image, _undistorted, _undistortMap1, _undistortMap2, cv::INTER_LINEAR );
+		std::swap( result.image, _undistorted );
+		result.timings.seconds[ STAGE_UNDISTORT ] = FrameRing::now() - start;
+	}
+	
+	bool DetectionPipeline::takeResult( FrameResult &result ) {
+		if( !_results.tryPop( _incoming ) )
+			return false;
+		
+		if( !result.image.empty() )
+			_recycled.tryPush( result );
+		result = std::move( _incoming );
+		_incoming.image.release();
+		return true;
+	}
+	
+	unsigned int DetectionPipeline::getQueuedResults() { return _results.size(); }
+	
+	double DetectionPipeline::getMeanDetectSeconds() {
+		unsigned long numDetected = _numDetected;
+		return numDetected > 0 ? _totalDetectSeconds / numDetected : 0;
+	}
+	
+	void DetectionPipeline::printStats() {
+		printf( "[detect]: frames %lu  mean detect %.1fms  results queued %u/%u\n",
+				(unsigned long)_numDetected, getMeanDetectSeconds() * 1000.0, getQueuedResults(), _results.capacity() );
+		if( AllocationCounter::isEnabled() && _numDetected > 0 )
+			printf( "[alloc]: detect %.1f allocations/frame\n", (double)_detectAllocations / _numDetected );
+		_detectAllocations = 0;
+		_numDetected = 0;
+		_totalDetectSeconds = 0;
+		_detector.printStats();
+	}
@@ -0,0 +1,145 @@
+#ifndef _DETECTION_PIPELINE_H_
+#define _DETECTION_PIPELINE_H_ 1
+
+#include <opencv2/aruco.hpp>
+#include <opencv2/aruco/charuco.hpp>
+#include <opencv2/core.hpp>
+
+#include "BoundedQueue.h"
+#include "CameraCalibration.h"
+#include "FrameRing.h"
+#include "FrameProfiler.h"
+#include "FrameScheduler.h"
+#include "MarkerDetector.h"
+#include "SquarePoseSolver.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+using namespace std;
+
+
+
+	/* pose id of the board in board mode */
+	static const int BOARD_POSE_ID = -1;
+
+	/* one camera frame after detection and pose estimation */
+	struct FrameResult {
+		cv::Mat image;						// the camera frame as captured (BGR), or undistorted
+		vector< int > markerIds;
+		vector< vector< cv::Point2f > > markerCorners;
+		vector< int > poseIds;				// what each pose belongs to: a marker id, or BOARD_POSE_ID
+		vector< cv::Vec3d > rvecs, tvecs;
+		vector< cv::Point2f > axisPoints;	// per pose, in pixels: origin, then the x, y and z axis ends
+		bool detected;						// false for frames passed on without detection
+		
+		double captureTime;					// FrameRing::now() timestamps
+		double detectStartTime;
+		double detectEndTime;
+		FrameTimings timings;				// the detection side's stages; the renderer adds its own
+	};
+
+	/* the detect/pose stage between capture and rendering: runs on its own */
+	/* thread, pulling the newest frame from the capture ring and handing */
+	/* results to the renderer through a bounded queue, so detection of one */
+	/* frame overlaps rendering of the previous */
+	class DetectionPipeline {
+	public:
+		/* frameSignal is notified by the capture thread, renderSignal is */
+		/* notified here for each result; queueDepth results may wait for the */
+		/* renderer before detection stalls */
+		DetectionPipeline( FrameRing *frames, FrameScheduler *frameSignal, FrameScheduler *renderSignal, unsigned int queueDepth = 2 );
+		~DetectionPipeline();
+		
+		void setDictionary( cv::Ptr< cv::aruco::Dictionary > dictionary, cv::Ptr< cv::aruco::DetectorParameters > detectorParams );
+		void setCamera( cv::Mat cameraMatrix, cv::Mat distCoeffs, float markerLength );
+		
+		/* take the camera from a calibration instead, scaled to the frame */
+		/* size; with rectify every frame is undistorted before detection, */
+		/* so poses are solved, and the frame shown, with no distortion */
+		void setCalibration( CameraCalibration *calibration, float markerLength, bool rectify );
+		
+		/* how single-marker poses are found; POSE_ITERATIVE by default */
+		void setPoseMethod( PoseMethod method );
+		
+		/* configure before start() */
+		MarkerDetector* getDetector();
+		
+		/* run detection on one frame in every interval; the others are */
+		/* passed straight on for display; safe to call while running */
+		void setDetectionInterval( unsigned int interval );
+		
+		/* board mode: one pose for a whole board from every visible marker */
+		/* instead of one per marker; lengths are in markerLength's units */
+		void setGridBoard( int markersX, int markersY, float boardMarkerLength, float markerSeparation, int firstMarker = 0 );
+		void setCharucoBoard( int squaresX, int squaresY, float squareLength, float boardMarkerLength );
+		
+		/* run the stage on its own thread, feeding takeResult() */
+		void start();
+		void stop();
+		
+		/* or drive it from outside, one frame at a time: take the newest */
+		/* frame into result and detect it; false if there was none */
+		/* calls must not overlap */
+		bool processNext( FrameResult &result );
+		
+		/* renderer: replace result with the next finished frame, handing */
+		/* result's old buffers back for reuse; false if none is ready */
+		bool takeResult( FrameResult &result );
+		
+		unsigned int getQueuedResults();
+		double getMeanDetectSeconds();
+		
+		void printStats();
+		
+	private:
+		FrameRing *_frames;
+		FrameScheduler *_frameSignal;
+		FrameScheduler *_renderSignal;
+		
+		BoundedQueue< FrameResult > _results;
+		FrameResult _incoming;
+		BoundedQueue< FrameResult > _recycled;		// displayed results, image and vectors reused
+		
+		MarkerDetector _detector;
+		cv::Mat _cameraMatrix;
+		cv::Mat _distCoeffs;
+		float _markerLength;
+		cv::Ptr< cv::aruco::Dictionary > _dictionary;
+		
+		PoseMethod _poseMethod;
+		SquarePoseSolver _poseSolver;
+		bool _poseSolverStale;			// the camera changed since the solver was set up
+		
+		CameraCalibration *_calibration;
+		bool _rectify;
+		cv::Size _calibratedSize;		// frame size the camera and maps were set up for
+		cv::Mat _undistortMap1, _undistortMap2;
+		cv::Mat _undistorted;			// swapped with each frame, so no per-frame allocation
+		
+		cv::Ptr< cv::aruco::Board > _board;
+		cv::Ptr< cv::aruco::CharucoBoard > _charucoBoard;
+		float _boardAxisLength;
+		vector< vector< cv::Point2f > > _rejected;
+		vector< cv::Point2f > _charucoCorners;
+		vector< int > _charucoIds;
+		std::atomic< unsigned int > _detectionInterval;		// may change while running
+		unsigned int _framesSinceDetection;
+		
+		std::thread _thread;
+		std::atomic< bool > _running;
+		
+		std::atomic< unsigned long > _numDetected;
+		std::atomic< double > _totalDetectSeconds;
+		std::atomic< unsigned long long > _detectAllocations;
+		
+		void run();
+		void detect( FrameResult &result );
+		bool estimateBoardPose( FrameResult &result, cv::Vec3d &rvec, cv::Vec3d &tvec );
+		void passThrough( FrameResult &result );
+		void undistort( FrameResult &result );
+		void projectAxes( FrameResult &result );
+	};
+
+
+#endif
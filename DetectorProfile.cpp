@@ -0,0 +1,94 @@
+#include "DetectorProfile.h"
+
+#include <stdio.h>
+
+
+	cv::Ptr< cv::aruco::DetectorParameters > DetectorProfile::load( const string &filename, const string &name ) {
+		cv::FileStorage storage;
+		if( !storage.open( filename, cv::FileStorage::READ ) ) {
+			fprintf( stderr, "[profile]: [ERROR]: could not open %s\n", filename.c_str() );
+			return cv::Ptr< cv::aruco::DetectorParameters >();
+		}
+		cv::FileNode node = storage[ name ];
+		if( node.empty() || !node.isMap() ) {
+			fprintf( stderr, "[profile]: [ERROR]: %s has no profile called %s\n", filename.c_str(), name.c_str() );
+			return cv::Ptr< cv::aruco::DetectorParameters >();
+		}
+		
+		cv::Ptr< cv::aruco::DetectorParameters > params = cv::aruco::DetectorParameters::create();
+		read( node, params );
+		return params;
+	}
+	
+	cv::Ptr< cv::aruco::DetectorParameters > DetectorProfile::loadSpec( const string &spec, const string &defaultName ) {
+		// a ':' after the first character, so "C:\..." still reads as a path
+		size_t colon = spec.find_last_of( ':' );
+		if( colon == string::npos || colon <= 1 )
+			return load( spec, defaultName );
+		return load( spec.substr( 0, colon ), spec.substr( colon + 1 ) );
+	}
+	
+	/* a missing entry reads as an empty node, which leaves the field alone */
+	template< typename T >
+	static void readField( const cv::FileNode &node, const char *key, T &field ) {
+		cv::FileNode entry = node[ key ];
+		if( !entry.empty() )
+			entry >> field;
+	}
+	
+	static void readField( const cv::FileNode &node, const char *key, bool &field ) {
+		cv::FileNode entry = node[ key ];
+		if( !entry.empty() )
+			field = (int)entry != 0;
+	}
+	
+	void DetectorProfile::read( const cv::FileNode &node, const cv::Ptr< cv::aruco::DetectorParameters > &params ) {
+		readField( node, "adaptiveThreshWinSizeMin", params->adaptiveThreshWinSizeMin );
+		readField( node, "adaptiveThreshWinSizeMax", params->adaptiveThreshWinSizeMax );
+		readField( node, "adaptiveThreshWinSizeStep", params->adaptiveThreshWinSizeStep );
+		readField( node, "adaptiveThreshConstant", params->adaptiveThreshConstant );
+		readField( node, "minMarkerPerimeterRate", params->minMarkerPerimeterRate );
+		readField( node, "maxMarkerPerimeterRate", params->maxMarkerPerimeterRate );
+		readField( node, "polygonalApproxAccuracyRate", params->polygonalApproxAccuracyRate );
+		readField( node, "minCornerDistanceRate", params->minCornerDistanceRate );
+		readField( node, "minDistanceToBorder", params->minDistanceToBorder );
+		readField( node, "minMarkerDistanceRate", params->minMarkerDistanceRate );
+		readField( node, "doCornerRefinement", params->doCornerRefinement );
+		readField( node, "cornerRefinementWinSize", params->cornerRefinementWinSize );
+		readField( node, "cornerRefinementMaxIterations", params->cornerRefinementMaxIterations );
+		readField( node, "cornerRefinementMinAccuracy", params->cornerRefinementMinAccuracy );
+		readField( node, "markerBorderBits", params->markerBorderBits );
+		readField( node, "perspectiveRemovePixelPerCell", params->perspectiveRemovePixelPerCell );
+		readField( node, "perspectiveRemoveIgnoredMarginPerCell", params->perspectiveRemoveIgnoredMarginPerCell );
+		readField( node, "maxErroneousBitsInBorderRate", params->maxErroneousBitsInBorderRate );
+		readField( node, "minOtsuStdDev", params->minOtsuStdDev );
+		readField( node, "errorCorrectionRate", params->errorCorrectionRate );
+	}
+	
+	void DetectorProfile::beginWrite( cv::FileStorage &storage, const string &name, const cv::Ptr< cv::aruco::DetectorParameters > &params ) {
+		storage << name << "{";
+		storage << "adaptiveThreshWinSizeMin" << params->adaptiveThreshWinSizeMin;
+		storage << "adaptiveThreshWinSizeMax" << params->adaptiveThreshWinSizeMax;
+		storage << "adaptiveThreshWinSizeStep" << params->adaptiveThreshWinSizeStep;
+		storage << "adaptiveThreshConstant" << params->adaptiveThreshConstant;
+		storage << "minMarkerPerimeterRate" << params->minMarkerPerimeterRate;
+		storage << "maxMarkerPerimeterRate" << params->maxMarkerPerimeterRate;
+		storage << "polygonalApproxAccuracyRate" << params->polygonalApproxAccuracyRate;
+		storage << "minCornerDistanceRate" << params->minCornerDistanceRate;
+		storage << "minDistanceToBorder" << params->minDistanceToBorder;
+		storage << "minMarkerDistanceRate" << params->minMarkerDistanceRate;
+		storage << "doCornerRefinement" << (int)params->doCornerRefinement;
+		storage << "cornerRefinementWinSize" << params->cornerRefinementWinSize;
+		storage << "cornerRefinementMaxIterations" << params->cornerRefinementMaxIterations;
+		storage << "cornerRefinementMinAccuracy" << params->cornerRefinementMinAccuracy;
+		storage << "markerBorderBits" << params->markerBorderBits;
+		storage << "perspectiveRemovePixelPerCell" << params->perspectiveRemovePixelPerCell;
+		storage << "perspectiveRemoveIgnoredMarginPerCell" << params->perspectiveRemoveIgnoredMarginPerCell;
+		storage << "maxErroneousBitsInBorderRate" << params->maxErroneousBitsInBorderRate;
+		storage << "minOtsuStdDev" << params->minOtsuStdDev;
+		storage << "errorCorrectionRate" << params->errorCorrectionRate;
+	}
+	
+	void DetectorProfile::endWrite( cv::FileStorage &storage ) {
+		storage << "}";
+	}
@@ -0,0 +1,32 @@
+#ifndef _DETECTOR_PROFILE_H_
+#define _DETECTOR_PROFILE_H_ 1
+
+#include <opencv2/aruco.hpp>
+#include <opencv2/core.hpp>
+
+#include <string>
+using namespace std;
+
+
+
+	/* named sets of aruco::DetectorParameters kept in a cv::FileStorage */
+	/* file (YAML or XML); written by tuneDetector, read by the app */
+	class DetectorProfile {
+	public:
+		/* the profile called name in filename, or NULL if either is missing */
+		/* fields the profile leaves out keep their defaults */
+		static cv::Ptr< cv::aruco::DetectorParameters > load( const string &filename, const string &name );
+		
+		/* "<file>" or "<file>:<name>"; name defaults to defaultName */
+		static cv::Ptr< cv::aruco::DetectorParameters > loadSpec( const string &spec, const string &defaultName = "balanced" );
+		
+		/* writes the profile as a map called name; the caller may add */
+		/* more entries (measurements, say) before closing the map */
+		static void beginWrite( cv::FileStorage &storage, const string &name, const cv::Ptr< cv::aruco::DetectorParameters > &params );
+		static void endWrite( cv::FileStorage &storage );
+		
+		static void read( const cv::FileNode &node, const cv::Ptr< cv::aruco::DetectorParameters > &params );
+	};
+
+
+#endif
@@ -0,0 +1,349 @@
+/*
+ * tuneDetector: finds aruco::DetectorParameters that trade recall for
+ * speed on a recorded clip, and writes the best of them as profiles the
+ * app can load with --detector-profile.
+ *
+ *   tuneDetector [options] <video file | image directory> <profiles.yml>
+ *
+ * Every combination in the sweep below is run over the clip and scored on
+ * mean detection time per frame, recall against the labels, and mean
+ * corner error of the markers it found.  Labels are batchPose JSON lines
+ * output for the same clip (hand corrected, ideally); without them the
+ * slowest, most thorough configuration in the sweep stands in.
+ *
+ * The configurations no other beats on all three scores form the Pareto
+ * front, from which three profiles are picked:
+ *   robust    the highest recall, then the lowest corner error
+ *   balanced  the fastest within 1% of robust's recall
+ *   fast      the fastest within 10% of robust's recall (--fast-recall)
+ */
+
+#include "DetectorProfile.h"
+#include "FrameRing.h"
+#include "FrameSource.h"
+#include "WorkerPool.h"
+
+#include <opencv2/aruco.hpp>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+
+struct LabelledMarker {
+	int id;
+	cv::Point2f corners[4];
+};
+
+struct Candidate {
+	cv::Ptr< cv::aruco::DetectorParameters > params;
+	char description[96];
+	double msPerFrame;
+	double recall;
+	double cornerError;             // pixels, mean over matched corners
+	unsigned long falsePositives;
+	bool pareto;
+};
+
+cv::Ptr< cv::aruco::Dictionary > dictionary = cv::aruco::getPredefinedDictionary( cv::aruco::DICT_4X4_100 );
+
+vector< cv::Mat > frames;                       // grayscale, converted once
+vector< vector< LabelledMarker > > labels;      // per frame
+
+
+/* reads batchPose JSON lines; only the fields the tuner needs */
+bool readLabels( const string &filename, const vector< unsigned long > &frameIndices ) {
+	FILE *file = fopen( filename.c_str(), "r" );
+	if( file == NULL ) {
+		fprintf( stderr, "[tuner]: [ERROR]: could not open labels %s\n", filename.c_str() );
+		return false;
+	}
+	map< unsigned long, vector< LabelledMarker > > byFrame;
+	vector< char > line( 1 << 16 );
+	while( fgets( &line[0], (int)line.size(), file ) != NULL ) {
+		unsigned long frame;
+		if( sscanf( &line[0], "{\"frame\":%lu", &frame ) != 1 )
+			continue;
+		vector< LabelledMarker > &markers = byFrame[ frame ];
+		for( const char *p = strstr( &line[0], "{\"id\":" ); p != NULL; p = strstr( p + 1, "{\"id\":" ) ) {
+			LabelledMarker marker;
+			cv::Point2f *c = marker.corners;
+			if( sscanf( p, "{\"id\":%d,\"corners\":[[%f,%f],[%f,%f],[%f,%f],[%f,%f]]", &marker.id,
+						&c[0].x, &c[0].y, &c[1].x, &c[1].y, &c[2].x, &c[2].y, &c[3].x, &c[3].y ) == 9 )
+				markers.push_back( marker );
+		}
+	}
+	fclose( file );
+
+	labels.assign( frameIndices.size(), vector< LabelledMarker >() );
+	for( unsigned int i = 0; i < frameIndices.size(); i++ ) {
+		map< unsigned long, vector< LabelledMarker > >::iterator found = byFrame.find( frameIndices[i] );
+		if( found != byFrame.end() )
+			labels[i] = found->second;
+	}
+	return true;
+}
+
+/* the sweep: every combination of the settings that cost the most time */
+void buildSweep( vector< Candidate > &candidates ) {
+	// adaptive threshold passes: min, max, step
+	const int windows[][3] = { { 3, 33, 5 }, { 3, 23, 10 }, { 5, 25, 10 }, { 3, 13, 10 }, { 3, 23, 20 }, { 7, 7, 10 }, { 13, 13, 10 } };
+	const double approxRates[] = { 0.03, 0.05, 0.08 };
+	const int pixelsPerCell[] = { 8, 4, 2 };
+	const double perimeterRates[] = { 0.03, 0.06 };
+	const bool refinements[] = { true, false };
+
+	for( unsigned int w = 0; w < sizeof( windows ) / sizeof( windows[0] ); w++ )
+	for( unsigned int a = 0; a < sizeof( approxRates ) / sizeof( approxRates[0] ); a++ )
+	for( unsigned int p = 0; p < sizeof( pixelsPerCell ) / sizeof( pixelsPerCell[0] ); p++ )
+	for( unsigned int m = 0; m < sizeof( perimeterRates ) / sizeof( perimeterRates[0] ); m++ )
+	for( unsigned int r = 0; r < sizeof( refinements ) / sizeof( refinements[0] ); r++ ) {
+		Candidate candidate;
+		candidate.params = cv::aruco::DetectorParameters::create();
+		candidate.params->adaptiveThreshWinSizeMin = windows[w][0];
+		candidate.params->adaptiveThreshWinSizeMax = windows[w][1];
+		candidate.params->adaptiveThreshWinSizeStep = windows[w][2];
+		candidate.params->polygonalApproxAccuracyRate = approxRates[a];
+		candidate.params->perspectiveRemovePixelPerCell = pixelsPerCell[p];
+		candidate.params->minMarkerPerimeterRate = perimeterRates[m];
+		candidate.params->doCornerRefinement = refinements[r];
+		sprintf( candidate.description, "win %d-%d/%d approx %.2f cell %dpx perimeter %.2f%s",
+				 windows[w][0], windows[w][1], windows[w][2], approxRates[a], pixelsPerCell[p], perimeterRates[m],
+				 refinements[r] ? " subpix" : "" );
+		candidates.push_back( candidate );
+	}
+}
+
+/* detect in every frame, optionally keeping what was found as the labels */
+void evaluate( Candidate &candidate, double maxMatchError, bool makeLabels ) {
+	vector< int > ids;
+	vector< vector< cv::Point2f > > corners, rejected;
+	unsigned long numLabelled = 0, numMatched = 0;
+	double totalError = 0;
+	candidate.falsePositives = 0;
+
+	double totalSeconds = 0;
+	for( unsigned int f = 0; f < frames.size(); f++ ) {
+		double start = FrameRing::now();
+		cv::aruco::detectMarkers( frames[f], dictionary, corners, ids, candidate.params, rejected );
+		totalSeconds += FrameRing::now() - start;
+
+		if( makeLabels ) {
+			labels[f].resize( ids.size() );
+			for( unsigned int i = 0; i < ids.size(); i++ ) {
+				labels[f][i].id = ids[i];
+				for( int c = 0; c < 4; c++ )
+					labels[f][i].corners[c] = corners[i][c];
+			}
+		}
+
+		// ids are unique within a frame for a well-formed clip; a marker
+		// found far from its label is a miss and a false positive both
+		vector< bool > matched( ids.size(), false );
+		for( unsigned int l = 0; l < labels[f].size(); l++ ) {
+			const LabelledMarker &label = labels[f][l];
+			numLabelled++;
+			for( unsigned int i = 0; i < ids.size(); i++ ) {
+				if( ids[i] != label.id || matched[i] )
+					continue;
+				double error = 0;
+				for( int c = 0; c < 4; c++ )
+					error += cv::norm( corners[i][c] - label.corners[c] ) / 4.0;
+				if( error <= maxMatchError ) {
+					matched[i] = true;
+					numMatched++;
+					totalError += error;
+				}
+				break;
+			}
+		}
+		for( unsigned int i = 0; i < ids.size(); i++ )
+			if( !matched[i] )
+				candidate.falsePositives++;
+	}
+
+	candidate.msPerFrame = frames.empty() ? 0 : totalSeconds / frames.size() * 1000.0;
+	candidate.recall = numLabelled > 0 ? (double)numMatched / numLabelled : 1.0;
+	candidate.cornerError = numMatched > 0 ? totalError / numMatched : 0;
+}
+
+bool dominates( const Candidate &a, const Candidate &b ) {
+	if( a.msPerFrame > b.msPerFrame || a.recall < b.recall || a.cornerError > b.cornerError )
+		return false;
+	return a.msPerFrame < b.msPerFrame || a.recall > b.recall || a.cornerError < b.cornerError;
+}
+
+/* the fastest point on the front with at least minRecall */
+int fastestWithRecall( const vector< Candidate > &candidates, double minRecall ) {
+	int best = -1;
+	for( unsigned int i = 0; i < candidates.size(); i++ )
+		if( candidates[i].pareto && candidates[i].recall >= minRecall
+			&& ( best < 0 || candidates[i].msPerFrame < candidates[best].msPerFrame ) )
+			best = i;
+	return best;
+}
+
+void writeProfile( cv::FileStorage &storage, const char *name, const Candidate &candidate ) {
+	DetectorProfile::beginWrite( storage, name, candidate.params );
+	storage << "measuredMsPerFrame" << candidate.msPerFrame;
+	storage << "measuredRecall" << candidate.recall;
+	storage << "measuredCornerError" << candidate.cornerError;
+	DetectorProfile::endWrite( storage );
+	printf( "[tuner]: %-8s %7.2fms/frame  recall %5.1f%%  corner error %.2fpx  %s\n", name,
+			candidate.msPerFrame, candidate.recall * 100.0, candidate.cornerError, candidate.description );
+}
+
+
+int main( int argc, char* argv[] ) {
+	string labelFile;
+	unsigned int maxFrames = 300;
+	unsigned int frameStep = 1;
+	unsigned int numThreads = 1;
+	double maxMatchError = 4.0;
+	double fastRecall = 0.9;
+	vector< string > files;
+	bool badOption = false;
+	for( int i = 1; i < argc; i++ ) {
+		string arg = argv[i];
+		if( arg.compare( 0, 9, "--labels=" ) == 0 )
+			labelFile = arg.substr( 9 );
+		else if( arg.compare( 0, 9, "--frames=" ) == 0 )
+			maxFrames = atoi( arg.substr( 9 ).c_str() );
+		else if( arg.compare( 0, 8, "--every=" ) == 0 )
+			frameStep = max( 1, atoi( arg.substr( 8 ).c_str() ) );
+		else if( arg.compare( 0, 10, "--threads=" ) == 0 )
+			numThreads = atoi( arg.substr( 10 ).c_str() );
+		else if( arg.compare( 0, 14, "--match-error=" ) == 0 )
+			maxMatchError = atof( arg.substr( 14 ).c_str() );
+		else if( arg.compare( 0, 14, "--fast-recall=" ) == 0 ) {
+			// a fraction of robust's recall; above 1 nothing on the front qualifies
+			fastRecall = atof( arg.substr( 14 ).c_str() );
+			if( !( fastRecall > 0 && fastRecall <= 1 ) ) {
+				fprintf( stderr, "[tuner]: [ERROR]: --fast-recall must be in (0, 1], not %s\n", arg.substr( 14 ).c_str() );
+				badOption = true;
+			}
+		}
+		else
+			files.push_back( arg );
+	}
+	if( files.size() != 2 || badOption ) {
+		fprintf( stderr, "usage: %s [options] <video file | image directory> <profiles.yml>\n"
+				 "  clip:    [--labels=<batchPose .jsonl>] [--frames=<count>] [--every=<frames>] [--match-error=<pixels>]\n"
+				 "  sweep:   [--threads=<count>] [--fast-recall=<fraction of best recall>]\n", argv[0] );
+		return 1;
+	}
+
+	// the whole clip is decoded up front so only detection is timed
+	FrameSource *source = FrameSource::open( files[0] );
+	if( !source->isOpened() || source->isLive() ) {
+		fprintf( stderr, "[tuner]: [ERROR]: could not open %s as a recording\n", files[0].c_str() );
+		return 1;
+	}
+	vector< unsigned long > frameIndices;
+	cv::Mat image;
+	double time;
+	for( unsigned long index = 0; frames.size() < maxFrames; index++ ) {
+		if( index % frameStep != 0 ) {
+			if( !source->skip() )
+				break;
+			continue;
+		}
+		if( !source->read( image, time ) )
+			break;
+		frames.push_back( cv::Mat() );
+		cv::cvtColor( image, frames.back(), cv::COLOR_BGR2GRAY );
+		frameIndices.push_back( index );
+	}
+	printf( "[tuner]: %u frames from %s\n", (unsigned int)frames.size(), source->describe().c_str() );
+	delete source;
+	if( frames.empty() )
+		return 1;
+
+	vector< Candidate > candidates;
+	buildSweep( candidates );
+
+	if( !labelFile.empty() ) {
+		if( !readLabels( labelFile, frameIndices ) )
+			return 1;
+	} else {
+		printf( "[tuner]: no labels, using the first configuration's detections\n" );
+		labels.assign( frames.size(), vector< LabelledMarker >() );
+		evaluate( candidates[0], maxMatchError, true );
+	}
+
+	// several configurations at once is quicker but their timings share
+	// the memory bus, so the default is one at a time; detectMarkers'
+	// own threading is turned off so it doesn't fight the pool
+	double start = FrameRing::now();
+	if( numThreads > 1 ) {
+		cv::setNumThreads( 1 );
+		WorkerPool pool( numThreads );
+		std::atomic< unsigned int > remaining( (unsigned int)candidates.size() );
+		for( unsigned int i = 0; i < candidates.size(); i++ ) {
+			Candidate *candidate = &candidates[i];
+			pool.submit( [candidate, maxMatchError, &remaining] {
+				evaluate( *candidate, maxMatchError, false );
+				remaining--;
+			} );
+		}
+		while( remaining > 0 )
+			std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+	} else {
+		for( unsigned int i = 0; i < candidates.size(); i++ )
+			evaluate( candidates[i], maxMatchError, false );
+	}
+	printf( "[tuner]: %u configurations in %.1fs\n", (unsigned int)candidates.size(), FrameRing::now() - start );
+
+	unsigned int robust = 0;
+	for( unsigned int i = 0; i < candidates.size(); i++ ) {
+		candidates[i].pareto = true;
+		for( unsigned int j = 0; j < candidates.size() && candidates[i].pareto; j++ )
+			if( dominates( candidates[j], candidates[i] ) )
+				candidates[i].pareto = false;
+		if( !candidates[i].pareto )
+			continue;
+		const Candidate &best = candidates[robust];
+		if( !best.pareto || candidates[i].recall > best.recall
+			|| ( candidates[i].recall == best.recall && candidates[i].cornerError < best.cornerError ) )
+			robust = i;
+	}
+
+	printf( "[tuner]: Pareto front:\n" );
+	for( unsigned int i = 0; i < candidates.size(); i++ )
+		if( candidates[i].pareto )
+			printf( "          %7.2fms/frame  recall %5.1f%%  corner error %.2fpx  false positives %lu  %s\n",
+					candidates[i].msPerFrame, candidates[i].recall * 100.0, candidates[i].cornerError,
+					candidates[i].falsePositives, candidates[i].description );
+
+	int balanced = fastestWithRecall( candidates, candidates[robust].recall * 0.99 );
+	int fast = fastestWithRecall( candidates, candidates[robust].recall * fastRecall );
+	// robust always meets its own recall, but not always a rounded fraction of it
+	if( balanced < 0 )
+		balanced = robust;
+	if( fast < 0 )
+		fast = robust;
+
+	cv::FileStorage storage( files[1], cv::FileStorage::WRITE );
+	if( !storage.isOpened() ) {
+		fprintf( stderr, "[tuner]: [ERROR]: could not write %s\n", files[1].c_str() );
+		return 1;
+	}
+	storage << "clip" << files[0];
+	storage << "frames" << (int)frames.size();
+	writeProfile( storage, "fast", candidates[fast] );
+	writeProfile( storage, "balanced", candidates[balanced] );
+	writeProfile( storage, "robust", candidates[robust] );
+	storage.release();
+	printf( "[tuner]: wrote %s\n", files[1].c_str() );
+	return 0;
+}
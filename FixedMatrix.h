@@ -0,0 +1,321 @@
+#ifndef _FIXED_MATRIX_H_
+#define _FIXED_MATRIX_H_ 1
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define FIXED_MATRIX_SSE 1
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include <string.h>
+
+
+
+	/* a matrix whose size is part of its type: the elements live inline, */
+	/* column-major as OpenGL and Matrix keep them, so copies never touch */
+	/* the heap and loops over rows and columns unroll; Mat4 products go */
+	/* through SSE (AVX for doubles when built with it) */
+	template< typename T, int R, int C >
+	class FixedMatrix {
+	public:
+		/* all zero */
+		FixedMatrix() { memset( _data, 0, sizeof( _data ) ); }
+
+		/* from R*C values, column-major */
+		explicit FixedMatrix( const T *values ) { memcpy( _data, values, sizeof( _data ) ); }
+
+		static FixedMatrix identity() {
+			FixedMatrix m;
+			for( int i = 0; i < ( R < C ? R : C ); i++ )
+				m( i, i ) = 1;
+			return m;
+		}
+
+		T& operator()( int row, int col ) { return _data[ col * R + row ]; }
+		const T& operator()( int row, int col ) const { return _data[ col * R + row ]; }
+
+		T get( int row, int col ) const { return _data[ col * R + row ]; }
+		void set( int row, int col, T val ) { _data[ col * R + row ] = val; }
+
+		int getNumRows() const { return R; }
+		int getNumCols() const { return C; }
+
+		/* column-major, ready for glLoadMatrix / glMultMatrix */
+		T* data() { return _data; }
+		const T* data() const { return _data; }
+
+		/* the last row is 0 ... 0 1, so products can skip it */
+		bool isAffine() const {
+			if( R != C )
+				return false;
+			for( int c = 0; c < C - 1; c++ )
+				if( ( *this )( R - 1, c ) != 0 )
+					return false;
+			return ( *this )( R - 1, C - 1 ) == 1;
+		}
+
+		FixedMatrix< T, C, R > transposed() const {
+			FixedMatrix< T, C, R > m;
+			for( int r = 0; r < R; r++ )
+				for( int c = 0; c < C; c++ )
+					m( c, r ) = ( *this )( r, c );
+			return m;
+		}
+
+		/* the top left rows x cols block */
+		template< int Rows, int Cols >
+		FixedMatrix< T, Rows, Cols > block() const {
+			FixedMatrix< T, Rows, Cols > m;
+			for( int c = 0; c < Cols; c++ )
+				for( int r = 0; r < Rows; r++ )
+					m( r, c ) = ( *this )( r, c );
+			return m;
+		}
+
+		FixedMatrix& operator+=( const FixedMatrix &rhs ) {
+			for( int i = 0; i < R * C; i++ )
+				_data[i] += rhs._data[i];
+			return *this;
+		}
+
+		FixedMatrix& operator-=( const FixedMatrix &rhs ) {
+			for( int i = 0; i < R * C; i++ )
+				_data[i] -= rhs._data[i];
+			return *this;
+		}
+
+		FixedMatrix& operator*=( T f ) {
+			for( int i = 0; i < R * C; i++ )
+				_data[i] *= f;
+			return *this;
+		}
+
+	private:
+		alignas( 16 ) T _data[ R * C ];
+	};
+
+	typedef FixedMatrix< double, 3, 3 > Mat3;
+	typedef FixedMatrix< double, 4, 4 > Mat4;
+	typedef FixedMatrix< float, 3, 3 > Mat3f;
+	typedef FixedMatrix< float, 4, 4 > Mat4f;
+
+	/* out = a * b; out must not be a or b */
+	template< typename T, int R, int K, int C >
+	inline void multiply( const FixedMatrix< T, R, K > &a, const FixedMatrix< T, K, C > &b, FixedMatrix< T, R, C > &out ) {
+		for( int c = 0; c < C; c++ ) {
+			for( int r = 0; r < R; r++ ) {
+				T sum = 0;
+				for( int k = 0; k < K; k++ )
+					sum += a( r, k ) * b( k, c );
+				out( r, c ) = sum;
+			}
+		}
+	}
+
+#ifdef FIXED_MATRIX_SSE
+	/* column c of the product is a's columns weighted by b's column c */
+	inline void multiply( const Mat4f &a, const Mat4f &b, Mat4f &out ) {
+		const float *A = a.data(), *B = b.data();
+		float *O = out.data();
+		__m128 a0 = _mm_load_ps( A ), a1 = _mm_load_ps( A + 4 ), a2 = _mm_load_ps( A + 8 ), a3 = _mm_load_ps( A + 12 );
+		for( int c = 0; c < 4; c++ ) {
+			__m128 column = _mm_mul_ps( a0, _mm_set1_ps( B[ 4*c ] ) );
+			column = _mm_add_ps( column, _mm_mul_ps( a1, _mm_set1_ps( B[ 4*c + 1 ] ) ) );
+			column = _mm_add_ps( column, _mm_mul_ps( a2, _mm_set1_ps( B[ 4*c + 2 ] ) ) );
+			column = _mm_add_ps( column, _mm_mul_ps( a3, _mm_set1_ps( B[ 4*c + 3 ] ) ) );
+			_mm_store_ps( O + 4*c, column );
+		}
+	}
+
+	inline void multiply( const Mat4 &a, const Mat4 &b, Mat4 &out ) {
+		const double *A = a.data(), *B = b.data();
+		double *O = out.data();
+#ifdef __AVX__
+		__m256d a0 = _mm256_loadu_pd( A ), a1 = _mm256_loadu_pd( A + 4 ), a2 = _mm256_loadu_pd( A + 8 ), a3 = _mm256_loadu_pd( A + 12 );
+		for( int c = 0; c < 4; c++ ) {
+			__m256d column = _mm256_mul_pd( a0, _mm256_set1_pd( B[ 4*c ] ) );
+			column = _mm256_add_pd( column, _mm256_mul_pd( a1, _mm256_set1_pd( B[ 4*c + 1 ] ) ) );
+			column = _mm256_add_pd( column, _mm256_mul_pd( a2, _mm256_set1_pd( B[ 4*c + 2 ] ) ) );
+			column = _mm256_add_pd( column, _mm256_mul_pd( a3, _mm256_set1_pd( B[ 4*c + 3 ] ) ) );
+			_mm256_storeu_pd( O + 4*c, column );
+		}
+#else
+		// each column in two halves: rows 0-1 and rows 2-3
+		for( int half = 0; half < 4; half += 2 ) {
+			__m128d a0 = _mm_load_pd( A + half ), a1 = _mm_load_pd( A + 4 + half );
+			__m128d a2 = _mm_load_pd( A + 8 + half ), a3 = _mm_load_pd( A + 12 + half );
+			for( int c = 0; c < 4; c++ ) {
+				__m128d column = _mm_mul_pd( a0, _mm_set1_pd( B[ 4*c ] ) );
+				column = _mm_add_pd( column, _mm_mul_pd( a1, _mm_set1_pd( B[ 4*c + 1 ] ) ) );
+				column = _mm_add_pd( column, _mm_mul_pd( a2, _mm_set1_pd( B[ 4*c + 2 ] ) ) );
+				column = _mm_add_pd( column, _mm_mul_pd( a3, _mm_set1_pd( B[ 4*c + 3 ] ) ) );
+				_mm_store_pd( O + 4*c + half, column );
+			}
+		}
+#endif
+	}
+#endif
+
+	/* out = a * b for affine a and b (see isAffine): only the top three */
+	/* rows are computed, and b's translation needs no bottom row */
+	template< typename T >
+	inline void multiplyAffine( const FixedMatrix< T, 4, 4 > &a, const FixedMatrix< T, 4, 4 > &b, FixedMatrix< T, 4, 4 > &out ) {
+		for( int c = 0; c < 4; c++ ) {
+			for( int r = 0; r < 3; r++ )
+				out( r, c ) = a( r, 0 ) * b( 0, c ) + a( r, 1 ) * b( 1, c ) + a( r, 2 ) * b( 2, c );
+			out( 3, c ) = 0;
+		}
+		for( int r = 0; r < 3; r++ )
+			out( r, 3 ) += a( r, 3 );
+		out( 3, 3 ) = 1;
+	}
+
+	/* p' = m p for the point ( x, y, z, 1 ), for affine m */
+	template< typename T >
+	inline void transformPoint( const FixedMatrix< T, 4, 4 > &m, const T in[3], T out[3] ) {
+		for( int r = 0; r < 3; r++ )
+			out[r] = m( r, 0 ) * in[0] + m( r, 1 ) * in[1] + m( r, 2 ) * in[2] + m( r, 3 );
+	}
+
+	/* v' = m v for the direction ( x, y, z, 0 ): translation ignored */
+	template< typename T >
+	inline void transformDirection( const FixedMatrix< T, 4, 4 > &m, const T in[3], T out[3] ) {
+		for( int r = 0; r < 3; r++ )
+			out[r] = m( r, 0 ) * in[0] + m( r, 1 ) * in[1] + m( r, 2 ) * in[2];
+	}
+
+	template< typename T >
+	inline T determinant( const FixedMatrix< T, 3, 3 > &m ) {
+		return m( 0, 0 ) * ( m( 1, 1 ) * m( 2, 2 ) - m( 1, 2 ) * m( 2, 1 ) )
+			 - m( 0, 1 ) * ( m( 1, 0 ) * m( 2, 2 ) - m( 1, 2 ) * m( 2, 0 ) )
+			 + m( 0, 2 ) * ( m( 1, 0 ) * m( 2, 1 ) - m( 1, 1 ) * m( 2, 0 ) );
+	}
+
+	/* the adjugate over the determinant; false, out untouched, if singular */
+	template< typename T >
+	inline bool invert( const FixedMatrix< T, 3, 3 > &m, FixedMatrix< T, 3, 3 > &out ) {
+		T c00 = m( 1, 1 ) * m( 2, 2 ) - m( 1, 2 ) * m( 2, 1 );
+		T c01 = m( 1, 2 ) * m( 2, 0 ) - m( 1, 0 ) * m( 2, 2 );
+		T c02 = m( 1, 0 ) * m( 2, 1 ) - m( 1, 1 ) * m( 2, 0 );
+		T det = m( 0, 0 ) * c00 + m( 0, 1 ) * c01 + m( 0, 2 ) * c02;
+		if( det == 0 )
+			return false;
+		T inv = 1 / det;
+		out( 0, 0 ) = c00 * inv;
+		out( 1, 0 ) = c01 * inv;
+		out( 2, 0 ) = c02 * inv;
+		out( 0, 1 ) = ( m( 0, 2 ) * m( 2, 1 ) - m( 0, 1 ) * m( 2, 2 ) ) * inv;
+		out( 1, 1 ) = ( m( 0, 0 ) * m( 2, 2 ) - m( 0, 2 ) * m( 2, 0 ) ) * inv;
+		out( 2, 1 ) = ( m( 0, 1 ) * m( 2, 0 ) - m( 0, 0 ) * m( 2, 1 ) ) * inv;
+		out( 0, 2 ) = ( m( 0, 1 ) * m( 1, 2 ) - m( 0, 2 ) * m( 1, 1 ) ) * inv;
+		out( 1, 2 ) = ( m( 0, 2 ) * m( 1, 0 ) - m( 0, 0 ) * m( 1, 2 ) ) * inv;
+		out( 2, 2 ) = ( m( 0, 0 ) * m( 1, 1 ) - m( 0, 1 ) * m( 1, 0 ) ) * inv;
+		return true;
+	}
+
+	/*
+	 * 4x4 by Laplace expansion along the top two rows against the bottom
+	 * two: six 2x2 minors of each pair give the determinant and every
+	 * cofactor, about half the multiplies of expanding 3x3 cofactors.
+	 */
+	template< typename T >
+	struct Minors4 {
+		T s[6], c[6], det;
+		explicit Minors4( const FixedMatrix< T, 4, 4 > &m ) {
+			s[0] = m( 0, 0 ) * m( 1, 1 ) - m( 1, 0 ) * m( 0, 1 );
+			s[1] = m( 0, 0 ) * m( 1, 2 ) - m( 1, 0 ) * m( 0, 2 );
+			s[2] = m( 0, 0 ) * m( 1, 3 ) - m( 1, 0 ) * m( 0, 3 );
+			s[3] = m( 0, 1 ) * m( 1, 2 ) - m( 1, 1 ) * m( 0, 2 );
+			s[4] = m( 0, 1 ) * m( 1, 3 ) - m( 1, 1 ) * m( 0, 3 );
+			s[5] = m( 0, 2 ) * m( 1, 3 ) - m( 1, 2 ) * m( 0, 3 );
+			c[0] = m( 2, 0 ) * m( 3, 1 ) - m( 3, 0 ) * m( 2, 1 );
+			c[1] = m( 2, 0 ) * m( 3, 2 ) - m( 3, 0 ) * m( 2, 2 );
+			c[2] = m( 2, 0 ) * m( 3, 3 ) - m( 3, 0 ) * m( 2, 3 );
+			c[3] = m( 2, 1 ) * m( 3, 2 ) - m( 3, 1 ) * m( 2, 2 );
+			c[4] = m( 2, 1 ) * m( 3, 3 ) - m( 3, 1 ) * m( 2, 3 );
+			c[5] = m( 2, 2 ) * m( 3, 3 ) - m( 3, 2 ) * m( 2, 3 );
+			det = s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0];
+		}
+	};
+
+	template< typename T >
+	inline T determinant( const FixedMatrix< T, 4, 4 > &m ) {
+		return Minors4< T >( m ).det;
+	}
+
+	template< typename T >
+	inline bool invert( const FixedMatrix< T, 4, 4 > &m, FixedMatrix< T, 4, 4 > &out ) {
+		Minors4< T > k( m );
+		if( k.det == 0 )
+			return false;
+		const T *s = k.s, *c = k.c;
+		T inv = 1 / k.det;
+		FixedMatrix< T, 4, 4 > r;
+		r( 0, 0 ) = (  m( 1, 1 ) * c[5] - m( 1, 2 ) * c[4] + m( 1, 3 ) * c[3] ) * inv;
+		r( 0, 1 ) = ( -m( 0, 1 ) * c[5] + m( 0, 2 ) * c[4] - m( 0, 3 ) * c[3] ) * inv;
+		r( 0, 2 ) = (  m( 3, 1 ) * s[5] - m( 3, 2 ) * s[4] + m( 3, 3 ) * s[3] ) * inv;
+		r( 0, 3 ) = ( -m( 2, 1 ) * s[5] + m( 2, 2 ) * s[4] - m( 2, 3 ) * s[3] ) * inv;
+		r( 1, 0 ) = ( -m( 1, 0 ) * c[5] + m( 1, 2 ) * c[2] - m( 1, 3 ) * c[1] ) * inv;
+		r( 1, 1 ) = (  m( 0, 0 ) * c[5] - m( 0, 2 ) * c[2] + m( 0, 3 ) * c[1] ) * inv;
+		r( 1, 2 ) = ( -m( 3, 0 ) * s[5] + m( 3, 2 ) * s[2] - m( 3, 3 ) * s[1] ) * inv;
+		r( 1, 3 ) = (  m( 2, 0 ) * s[5] - m( 2, 2 ) * s[2] + m( 2, 3 ) * s[1] ) * inv;
+		r( 2, 0 ) = (  m( 1, 0 ) * c[4] - m( 1, 1 ) * c[2] + m( 1, 3 ) * c[0] ) * inv;
+		r( 2, 1 ) = ( -m( 0, 0 ) * c[4] + m( 0, 1 ) * c[2] - m( 0, 3 ) * c[0] ) * inv;
+		r( 2, 2 ) = (  m( 3, 0 ) * s[4] - m( 3, 1 ) * s[2] + m( 3, 3 ) * s[0] ) * inv;
+		r( 2, 3 ) = ( -m( 2, 0 ) * s[4] + m( 2, 1 ) * s[2] - m( 2, 3 ) * s[0] ) * inv;
+		r( 3, 0 ) = ( -m( 1, 0 ) * c[3] + m( 1, 1 ) * c[1] - m( 1, 2 ) * c[0] ) * inv;
+		r( 3, 1 ) = (  m( 0, 0 ) * c[3] - m( 0, 1 ) * c[1] + m( 0, 2 ) * c[0] ) * inv;
+		r( 3, 2 ) = ( -m( 3, 0 ) * s[3] + m( 3, 1 ) * s[1] - m( 3, 2 ) * s[0] ) * inv;
+		r( 3, 3 ) = (  m( 2, 0 ) * s[3] - m( 2, 1 ) * s[1] + m( 2, 2 ) * s[0] ) * inv;
+		out = r;
+		return true;
+	}
+
+	/* inverse of a rotation plus translation, [ R t ] -> [ R^T -R^T t ]; */
+	/* exact and cheap, but only for an orthonormal R */
+	template< typename T >
+	inline FixedMatrix< T, 4, 4 > invertRigid( const FixedMatrix< T, 4, 4 > &m ) {
+		FixedMatrix< T, 4, 4 > r;
+		for( int row = 0; row < 3; row++ ) {
+			for( int col = 0; col < 3; col++ )
+				r( row, col ) = m( col, row );
+			r( row, 3 ) = -( m( 0, row ) * m( 0, 3 ) + m( 1, row ) * m( 1, 3 ) + m( 2, row ) * m( 2, 3 ) );
+		}
+		r( 3, 3 ) = 1;
+		return r;
+	}
+
+	template< typename T, int R, int K, int C >
+	inline FixedMatrix< T, R, C > operator*( const FixedMatrix< T, R, K > &a, const FixedMatrix< T, K, C > &b ) {
+		FixedMatrix< T, R, C > m;
+		multiply( a, b, m );
+		return m;
+	}
+
+	template< typename T, int R, int C >
+	inline FixedMatrix< T, R, C > operator*( const FixedMatrix< T, R, C > &a, T f ) {
+		FixedMatrix< T, R, C > m = a;
+		return m *= f;
+	}
+
+	template< typename T, int R, int C >
+	inline FixedMatrix< T, R, C > operator*( T f, const FixedMatrix< T, R, C > &a ) {
+		return a * f;
+	}
+
+	template< typename T, int R, int C >
+	inline FixedMatrix< T, R, C > operator+( const FixedMatrix< T, R, C > &a, const FixedMatrix< T, R, C > &b ) {
+		FixedMatrix< T, R, C > m = a;
+		return m += b;
+	}
+
+	template< typename T, int R, int C >
+	inline FixedMatrix< T, R, C > operator-( const FixedMatrix< T, R, C > &a, const FixedMatrix< T, R, C > &b ) {
+		FixedMatrix< T, R, C > m = a;
+		return m -= b;
+	}
+
+
+#endif
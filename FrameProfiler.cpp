@@ -0,0 +1,114 @@
+#include "FrameProfiler.h"
+
+#include <algorithm>
+
+
+	static const char *STAGE_NAMES[ NUM_STAGES ] = {
+		"capture", "queue", "undistort", "detect", "pose", "upload", "overlay", "draw", "swap", "total"
+	};
+	
+	FrameProfiler::FrameProfiler( unsigned int window ) {
+		_window = window < 1 ? 1 : window;
+		for( int s = 0; s < NUM_STAGES; s++ )
+			_samples[s].resize( _window );
+		_sorted.reserve( _window );
+		_next = 0;
+		_numSamples = 0;
+		_log = NULL;
+		_logJson = false;
+		_frameNumber = 0;
+	}
+	
+	FrameProfiler::~FrameProfiler() {
+		closeLog();
+	}
+	
+	const char* FrameProfiler::getStageName( FrameStage stage ) { return STAGE_NAMES[ stage ]; }
+	
+	bool FrameProfiler::openLog( const string &filename ) {
+		closeLog();
+		_log = fopen( filename.c_str(), "w" );
+		if( _log == NULL ) {
+			fprintf( stderr, "[profiler]: [ERROR]: could not open %s for writing\n", filename.c_str() );
+			return false;
+		}
+		
+		_logJson = !( filename.size() >= 4 && filename.compare( filename.size() - 4, 4, ".csv" ) == 0 );
+		if( !_logJson ) {
+			fprintf( _log, "frame" );
+			for( int s = 0; s < NUM_STAGES; s++ )
+				fprintf( _log, ",%s_ms", STAGE_NAMES[s] );
+			fprintf( _log, "\n" );
+		}
+		return true;
+	}
+	
+	void FrameProfiler::closeLog() {
+		if( _log != NULL )
+			fclose( _log );
+		_log = NULL;
+	}
+	
+	void FrameProfiler::addFrame( const FrameTimings &timings ) {
+		for( int s = 0; s < NUM_STAGES; s++ )
+			_samples[s][ _next ] = timings.seconds[s];
+		_next = ( _next + 1 ) % _window;
+		if( _numSamples < _window )
+			_numSamples++;
+		
+		if( _log != NULL )
+			writeLog( timings );
+		_frameNumber++;
+	}
+	
+	void FrameProfiler::writeLog( const FrameTimings &timings ) {
+		if( _logJson ) {
+			fprintf( _log, "{\"frame\":%lu", _frameNumber );
+			for( int s = 0; s < NUM_STAGES; s++ )
+				fprintf( _log, ",\"%s_ms\":%.3f", STAGE_NAMES[s], timings.seconds[s] * 1000.0 );
+			fprintf( _log, "}\n" );
+		} else {
+			fprintf( _log, "%lu", _frameNumber );
+			for( int s = 0; s < NUM_STAGES; s++ )
+				fprintf( _log, ",%.3f", timings.seconds[s] * 1000.0 );
+			fprintf( _log, "\n" );
+		}
+	}
+	
+	unsigned int FrameProfiler::getNumSamples() { return _numSamples; }
+	
+	/* nearest-rank percentiles over a copy of the window */
+	void FrameProfiler::getPercentiles( FrameStage stage, double &p50, double &p95, double &p99 ) {
+		p50 = p95 = p99 = 0;
+		if( _numSamples == 0 )
+			return;
+		
+		_sorted.assign( _samples[ stage ].begin(), _samples[ stage ].begin() + _numSamples );
+		sort( _sorted.begin(), _sorted.end() );
+		p50 = _sorted[ ( _numSamples - 1 ) * 50 / 100 ];
+		p95 = _sorted[ ( _numSamples - 1 ) * 95 / 100 ];
+		p99 = _sorted[ ( _numSamples - 1 ) * 99 / 100 ];
+	}
+	
+	void FrameProfiler::formatTable( vector< string > &lines ) {
+		lines.resize( NUM_STAGES + 1 );
+		char line[64];
+		sprintf( line, "%-8s %7s %7s %7s", "ms", "p50", "p95", "p99" );
+		lines[0] = line;
+		for( int s = 0; s < NUM_STAGES; s++ ) {
+			double p50, p95, p99;
+			getPercentiles( (FrameStage)s, p50, p95, p99 );
+			sprintf( line, "%-8s %7.2f %7.2f %7.2f", STAGE_NAMES[s], p50 * 1000.0, p95 * 1000.0, p99 * 1000.0 );
+			lines[ s + 1 ] = line;
+		}
+	}
+	
+	void FrameProfiler::printStats() {
+		printf( "[profiler]: last %u frames\n", _numSamples );
+		vector< string > lines;
+		formatTable( lines );
+		for( unsigned int i = 0; i < lines.size(); i++ )
+			printf( "[profiler]:   %s\n", lines[i].c_str() );
+		if( _log != NULL )
+			fflush( _log );
+	}
@@ -0,0 +1,73 @@
+#ifndef _FRAME_PROFILER_H_
+#define _FRAME_PROFILER_H_ 1
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+
+	/* where a frame's time goes, from camera to screen */
+	enum FrameStage {
+		STAGE_CAPTURE,			// reading / decoding the frame
+		STAGE_QUEUE,			// waiting in the capture ring for the detection stage
+		STAGE_UNDISTORT,		// remapping the frame to remove lens distortion
+		STAGE_DETECT,			// marker detection or tracking
+		STAGE_POSE,				// pose estimation
+		STAGE_UPLOAD,			// video texture upload and instance setup
+		STAGE_OVERLAY,			// drawing marker outlines and axes over the video
+		STAGE_DRAW,				// drawing the video and models
+		STAGE_SWAP,				// glutSwapBuffers
+		STAGE_TOTAL,			// capture to swap
+		NUM_STAGES
+	};
+
+	/* one frame's time in each stage, in seconds */
+	struct FrameTimings {
+		double seconds[ NUM_STAGES ];
+		
+		FrameTimings() { clear(); }
+		void clear() { for( int i = 0; i < NUM_STAGES; i++ ) seconds[i] = 0; }
+	};
+
+	/* keeps the last window frames' timings for rolling percentiles, and */
+	/* optionally appends every frame to a CSV or JSON-lines log */
+	class FrameProfiler {
+	public:
+		FrameProfiler( unsigned int window = 300 );
+		~FrameProfiler();
+		
+		/* .csv writes CSV, anything else one JSON object per line */
+		bool openLog( const string &filename );
+		void closeLog();
+		
+		void addFrame( const FrameTimings &timings );
+		
+		/* over the current window, in seconds */
+		void getPercentiles( FrameStage stage, double &p50, double &p95, double &p99 );
+		unsigned int getNumSamples();
+		
+		/* one line per stage: name, p50, p95, p99 in milliseconds */
+		void formatTable( vector< string > &lines );
+		
+		void printStats();
+		
+		static const char* getStageName( FrameStage stage );
+		
+	private:
+		unsigned int _window;
+		vector< double > _samples[ NUM_STAGES ];	// ring of the last _window frames
+		unsigned int _next;
+		unsigned int _numSamples;
+		vector< double > _sorted;
+		
+		FILE *_log;
+		bool _logJson;
+		unsigned long _frameNumber;
+		
+		void writeLog( const FrameTimings &timings );
+	};
+
+
+#endif
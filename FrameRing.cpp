@@ -0,0 +1,112 @@
+#include "FrameRing.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <utility>
+
+
+	FrameRing::FrameRing( unsigned int capacity ) {
+		_capacity = capacity < 2 ? 2 : capacity;
+		_slots.resize( _capacity );
+		_head = 0;
+		_tail = 0;
+		_consumerBusy = false;
+		resetStats();
+	}
+	
+	double FrameRing::now() {
+		return std::chrono::duration< double >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+	
+	/*
+	 * One slot past the unread frames is kept back: it is the slot the
+	 * consumer last claimed and may still be swapping out of.  When the ring
+	 * is full the oldest unread frame is reclaimed, unless the consumer is
+	 * in the middle of a take, in which case the new frame is dropped.
+	 */
+	cv::Mat* FrameRing::beginWrite() {
+		unsigned long long head = _head.load();
+		unsigned long long tail = _tail.load();
+		
+		while( head - tail >= _capacity - 1 ) {
+			if( _consumerBusy.load() ) {
+				_dropped++;
+				return NULL;
+			}
+			if( _tail.compare_exchange_weak( tail, tail + 1 ) ) {
+				_dropped++;
+				break;
+			}
+		}
+		
+		return &_slots[ head % _capacity ].image;
+	}
+	
+	void FrameRing::endWrite( double captureTime, double readSeconds ) {
+		unsigned long long head = _head.load();
+		_slots[ head % _capacity ].captureTime = captureTime;
+		_slots[ head % _capacity ].readSeconds = readSeconds;
+		_head.store( head + 1 );
+		_pushed++;
+	}
+	
+	bool FrameRing::takeNewest( cv::Mat &frame, double &captureTime, double *readSeconds ) {
+		_consumerBusy.store( true );
+		
+		// claim every unread frame at once; the producer may race us for the oldest
+		unsigned long long tail = _tail.load();
+		unsigned long long head;
+		do {
+			head = _head.load();
+			if( head == tail ) {
+				_consumerBusy.store( false );
+				return false;
+			}
+		} while( !_tail.compare_exchange_weak( tail, head ) );
+		
+		FrameSlot &slot = _slots[ (head - 1) % _capacity ];
+		std::swap( frame, slot.image );
+		captureTime = slot.captureTime;
+		if( readSeconds != NULL )
+			*readSeconds = slot.readSeconds;
+		
+		_consumerBusy.store( false );
+		
+		_dropped += head - tail - 1;
+		_consumed++;
+		double latency = now() - captureTime;
+		_lastLatency = latency;
+		_totalLatency = _totalLatency + latency;
+		return true;
+	}
+	
+	unsigned long FrameRing::getPushed() { return _pushed; }
+	unsigned long FrameRing::getConsumed() { return _consumed; }
+	unsigned long FrameRing::getDropped() { return _dropped; }
+	
+	unsigned int FrameRing::getOccupancy() {
+		unsigned long long tail = _tail.load();
+		return (unsigned int)( _head.load() - tail );
+	}
+	
+	double FrameRing::getLastLatency() { return _lastLatency; }
+	
+	double FrameRing::getMeanLatency() {
+		unsigned long consumed = _consumed;
+		return consumed > 0 ? _totalLatency / consumed : 0;
+	}
+	
+	void FrameRing::printStats() {
+		printf( "[ring]: pushed %lu  consumed %lu  dropped %lu  occupancy %u/%u  latency %.1fms (mean %.1fms)\n",
+				getPushed(), getConsumed(), getDropped(), getOccupancy(), _capacity - 1,
+				getLastLatency() * 1000.0, getMeanLatency() * 1000.0 );
+		resetStats();
+	}
+	
+	void FrameRing::resetStats() {
+		_pushed = 0;
+		_dropped = 0;
+		_consumed = 0;
+		_lastLatency = 0;
+		_totalLatency = 0;
+	}
@@ -0,0 +1,68 @@
+#ifndef _FRAME_RING_H_
+#define _FRAME_RING_H_ 1
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <vector>
+
+
+
+	/* lock-free single producer / single consumer ring of reusable frames */
+	/* the consumer always takes the newest frame and drops older ones; a */
+	/* producer that finds the ring full reclaims the oldest unread frame */
+	class FrameRing {
+	public:
+		FrameRing( unsigned int capacity = 4 );
+		
+		/* producer: the buffer to fill next, or NULL if the frame must be */
+		/* dropped because the consumer is mid-take on a full ring */
+		cv::Mat* beginWrite();
+		/* producer: publish the buffer from beginWrite(); readSeconds is */
+		/* how long the frame took to read, passed on for profiling */
+		void endWrite( double captureTime, double readSeconds = 0 );
+		
+		/* consumer: swap the newest frame into frame; false if nothing new */
+		/* frame's old buffer goes back into the ring, so keep no other */
+		/* references to it */
+		bool takeNewest( cv::Mat &frame, double &captureTime, double *readSeconds = NULL );
+		
+		/* seconds on a monotonic clock, used for capture timestamps */
+		static double now();
+		
+		unsigned long getPushed();
+		unsigned long getConsumed();
+		unsigned long getDropped();
+		unsigned int getOccupancy();
+		double getLastLatency();
+		double getMeanLatency();
+		
+		void printStats();
+		void resetStats();
+		
+	private:
+		struct FrameSlot {
+			cv::Mat image;
+			double captureTime;
+			double readSeconds;
+		};
+		
+		std::vector< FrameSlot > _slots;
+		unsigned int _capacity;
+		
+		/* frames [_tail, _head) are published and unread */
+		std::atomic< unsigned long long > _head;
+		std::atomic< unsigned long long > _tail;
+		/* set while the consumer claims and swaps out a frame */
+		std::atomic< bool > _consumerBusy;
+		
+		std::atomic< unsigned long > _pushed;
+		std::atomic< unsigned long > _dropped;
+		/* written by the consumer, read and reset by whoever prints stats */
+		std::atomic< unsigned long > _consumed;
+		std::atomic< double > _lastLatency;
+		std::atomic< double > _totalLatency;
+	};
+
+
+#endif
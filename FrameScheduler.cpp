@@ -0,0 +1,86 @@
+#include "FrameScheduler.h"
+
+#include <stdio.h>
+
+
+	FrameScheduler::FrameScheduler( double displayFps ) {
+		_frameReady = false;
+		setDisplayFps( displayFps );
+		_lastWake = Clock::now();
+		_busyStart = _lastWake;
+		resetStats();
+	}
+	
+	void FrameScheduler::setDisplayFps( double displayFps ) {
+		std::lock_guard< std::mutex > lock( _mutex );
+		_displayInterval = std::chrono::duration_cast< Clock::duration >( std::chrono::duration< double >( 1.0 / displayFps ) );
+	}
+	
+	void FrameScheduler::notifyFrameReady() {
+		{
+			std::lock_guard< std::mutex > lock( _mutex );
+			_frameReady = true;
+		}
+		_wake.notify_one();
+	}
+	
+	bool FrameScheduler::waitForWork() {
+		std::unique_lock< std::mutex > lock( _mutex );
+		
+		Clock::time_point waitStart = Clock::now();
+		Clock::time_point deadline = _lastWake + _displayInterval;
+		bool frameReady = _wake.wait_until( lock, deadline, [this] { return _frameReady; } );
+		
+		_lastWake = Clock::now();
+		_idleTime += _lastWake - waitStart;
+		_frameReady = false;
+		
+		if( frameReady )
+			_frameWakeups++;
+		else
+			_intervalWakeups++;
+		return frameReady;
+	}
+	
+	void FrameScheduler::beginBusy() {
+		_busyStart = Clock::now();
+	}
+	
+	void FrameScheduler::endBusy() {
+		std::lock_guard< std::mutex > lock( _mutex );
+		_busyTime += Clock::now() - _busyStart;
+	}
+	
+	double FrameScheduler::getBusySeconds() {
+		std::lock_guard< std::mutex > lock( _mutex );
+		return std::chrono::duration< double >( _busyTime ).count();
+	}
+	
+	double FrameScheduler::getIdleSeconds() {
+		std::lock_guard< std::mutex > lock( _mutex );
+		return std::chrono::duration< double >( _idleTime ).count();
+	}
+	
+	double FrameScheduler::getBusyFraction() {
+		double busy = getBusySeconds(), idle = getIdleSeconds();
+		if( busy + idle <= 0 )
+			return 0;
+		return busy / (busy + idle);
+	}
+	
+	unsigned long FrameScheduler::getFrameWakeups() { return _frameWakeups; }
+	unsigned long FrameScheduler::getIntervalWakeups() { return _intervalWakeups; }
+	
+	void FrameScheduler::printStats() {
+		printf( "[sched]: busy %.3fs  idle %.3fs  (%.1f%% busy)  wakeups: %lu frame, %lu interval\n",
+				getBusySeconds(), getIdleSeconds(), getBusyFraction() * 100.0, _frameWakeups, _intervalWakeups );
+		resetStats();
+	}
+	
+	void FrameScheduler::resetStats() {
+		std::lock_guard< std::mutex > lock( _mutex );
+		_busyTime = Clock::duration::zero();
+		_idleTime = Clock::duration::zero();
+		_frameWakeups = 0;
+		_intervalWakeups = 0;
+	}
@@ -0,0 +1,58 @@
+#ifndef _FRAME_SCHEDULER_H_
+#define _FRAME_SCHEDULER_H_ 1
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+
+
+	/* decides when the render loop should run: as soon as a new frame or */
+	/* pose is ready, or when the display interval runs out, sleeping otherwise */
+	class FrameScheduler {
+	public:
+		FrameScheduler( double displayFps = 30.0 );
+		
+		void setDisplayFps( double displayFps );
+		
+		/* called by producers (any thread) when new work is available */
+		void notifyFrameReady();
+		
+		/* sleep until a frame is ready or the display interval elapses */
+		/* returns true if woken for a new frame, false on the interval */
+		bool waitForWork();
+		
+		/* bracket the work done after each wake up */
+		void beginBusy();
+		void endBusy();
+		
+		/* accounting since the last resetStats() */
+		double getBusySeconds();
+		double getIdleSeconds();
+		double getBusyFraction();
+		unsigned long getFrameWakeups();
+		unsigned long getIntervalWakeups();
+		
+		/* print a one line summary and start a new accounting period */
+		void printStats();
+		void resetStats();
+		
+	private:
+		typedef std::chrono::steady_clock Clock;
+		
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		bool _frameReady;
+		
+		Clock::duration _displayInterval;
+		Clock::time_point _lastWake;
+		Clock::time_point _busyStart;
+		
+		Clock::duration _busyTime;
+		Clock::duration _idleTime;
+		unsigned long _frameWakeups;
+		unsigned long _intervalWakeups;
+	};
+
+
+#endif
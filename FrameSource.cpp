@@ -0,0 +1,181 @@
+#include "FrameSource.h"
+
+#include "FrameRing.h"
+
+#include <opencv2/imgcodecs.hpp>
+
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+
+	FrameSource* FrameSource::open( const string &input, double imageFps ) {
+		// a bare number is a camera index
+		if( !input.empty() && input.find_first_not_of( "0123456789" ) == string::npos )
+			return new CameraSource( atoi( input.c_str() ) );
+		
+		struct stat info;
+		if( stat( input.c_str(), &info ) == 0 && ( info.st_mode & S_IFDIR ) )
+			return new ImageDirectorySource( input, imageFps );
+		
+		return new VideoFileSource( input );
+	}
+	
+	
+	CameraSource::CameraSource( int cameraIndex ) : _capture( cameraIndex ) {
+		_cameraIndex = cameraIndex;
+		_startTime = FrameRing::now();
+	}
+	
+	bool CameraSource::isOpened() { return _capture.isOpened(); }
+	bool CameraSource::isLive() { return true; }
+	
+	bool CameraSource::read( cv::Mat &frame, double &timestamp ) {
+		if( !_capture.read( frame ) || frame.empty() )
+			return false;
+		timestamp = FrameRing::now() - _startTime;
+		return true;
+	}
+	
+	bool CameraSource::skip() { return _capture.grab(); }
+	bool CameraSource::rewind() { return false; }
+	long CameraSource::getFrameCount() { return -1; }
+	bool CameraSource::seek( unsigned long ) { return false; }
+	
+	string CameraSource::describe() {
+		char description[32];
+		sprintf( description, "camera %d", _cameraIndex );
+		return description;
+	}
+	
+	
+	VideoFileSource::VideoFileSource( const string &filename ) : _capture( filename ) {
+		_filename = filename;
+		_fps = _capture.isOpened() ? _capture.get( cv::CAP_PROP_FPS ) : 0;
+		if( _fps <= 0 || _fps > 1000 )
+			_fps = 30.0;
+		_frameIndex = 0;
+	}
+	
+	bool VideoFileSource::isOpened() { return _capture.isOpened(); }
+	bool VideoFileSource::isLive() { return false; }
+	
+	/*
+	 * The container's own position is the recorded time of the frame just
+	 * read; some backends report 0 throughout, so fall back to the frame
+	 * count at the nominal rate.
+	 */
+	bool VideoFileSource::read( cv::Mat &frame, double &timestamp ) {
+		if( !_capture.read( frame ) || frame.empty() )
+			return false;
+		double positionMs = _capture.get( cv::CAP_PROP_POS_MSEC );
+		timestamp = positionMs > 0 ? positionMs / 1000.0 : _frameIndex / _fps;
+		_frameIndex++;
+		return true;
+	}
+	
+	bool VideoFileSource::skip() {
+		if( !_capture.grab() )
+			return false;
+		_frameIndex++;
+		return true;
+	}
+	
+	bool VideoFileSource::rewind() {
+		_frameIndex = 0;
+		if( _capture.set( cv::CAP_PROP_POS_FRAMES, 0 ) )
+			return true;
+		// not every backend can seek; reopening always works
+		_capture.release();
+		return _capture.open( _filename );
+	}
+	
+	/* containers without an index report no count, or a wrong one near 0 */
+	long VideoFileSource::getFrameCount() {
+		double count = _capture.get( cv::CAP_PROP_FRAME_COUNT );
+		return count > 0 ? (long)count : -1;
+	}
+	
+	/*
+	 * The backend seeks to the keyframe before frameIndex and decodes
+	 * forward from there; one that can't seek at all is reopened and
+	 * skipped through, which is slow but exact.
+	 */
+	bool VideoFileSource::seek( unsigned long frameIndex ) {
+		if( frameIndex == _frameIndex )
+			return true;
+		if( _capture.set( cv::CAP_PROP_POS_FRAMES, (double)frameIndex ) ) {
+			_frameIndex = frameIndex;
+			return true;
+		}
+		if( frameIndex < _frameIndex && !rewind() )
+			return false;
+		while( _frameIndex < frameIndex )
+			if( !skip() )
+				return false;
+		return true;
+	}
+	
+	string VideoFileSource::describe() { return "video " + _filename; }
+	
+	
+	ImageDirectorySource::ImageDirectorySource( const string &directory, double fps ) {
+		_directory = directory;
+		_fps = fps > 0 ? fps : 30.0;
+		_next = 0;
+		
+		vector< cv::String > candidates;
+		cv::glob( directory + "/*", candidates, false );
+		for( unsigned int i = 0; i < candidates.size(); i++ ) {
+			string extension = candidates[i].substr( candidates[i].find_last_of( '.' ) + 1 );
+			transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+			if( extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "bmp" || extension == "ppm" )
+				_filenames.push_back( candidates[i] );
+		}
+		sort( _filenames.begin(), _filenames.end() );
+	}
+	
+	bool ImageDirectorySource::isOpened() { return !_filenames.empty(); }
+	bool ImageDirectorySource::isLive() { return false; }
+	
+	bool ImageDirectorySource::read( cv::Mat &frame, double &timestamp ) {
+		if( _next >= _filenames.size() )
+			return false;
+		frame = cv::imread( _filenames[ _next ], cv::IMREAD_COLOR );
+		if( frame.empty() ) {
+			fprintf( stderr, "[capture]: [ERROR]: could not read image %s\n", _filenames[ _next ].c_str() );
+			return false;
+		}
+		timestamp = _next / _fps;
+		_next++;
+		return true;
+	}
+	
+	bool ImageDirectorySource::skip() {
+		if( _next >= _filenames.size() )
+			return false;
+		_next++;
+		return true;
+	}
+	
+	bool ImageDirectorySource::rewind() {
+		_next = 0;
+		return true;
+	}
+	
+	long ImageDirectorySource::getFrameCount() { return (long)_filenames.size(); }
+	
+	bool ImageDirectorySource::seek( unsigned long frameIndex ) {
+		if( frameIndex > _filenames.size() )
+			return false;
+		_next = frameIndex;
+		return true;
+	}
+	
+	string ImageDirectorySource::describe() {
+		char description[64];
+		sprintf( description, "%u images at %.1f fps from ", (unsigned int)_filenames.size(), _fps );
+		return description + _directory;
+	}
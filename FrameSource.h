@@ -0,0 +1,106 @@
+#ifndef _FRAME_SOURCE_H_
+#define _FRAME_SOURCE_H_ 1
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+
+
+	/* where camera frames come from: a live camera, or a recording that */
+	/* can be replayed against its own timestamps */
+	class FrameSource {
+	public:
+		virtual ~FrameSource() {}
+		
+		/* camera index, video file or directory of images */
+		/* imageFps: the rate a directory of images was recorded at */
+		static FrameSource* open( const string &input, double imageFps = 30.0 );
+		
+		virtual bool isOpened() = 0;
+		/* live sources can't be paced, rewound or looped */
+		virtual bool isLive() = 0;
+		
+		/* the next frame and its time in the recording, in seconds from */
+		/* the first frame; false at the end or on an error */
+		virtual bool read( cv::Mat &frame, double &timestamp ) = 0;
+		/* drop the next frame without decoding it, where possible */
+		virtual bool skip() = 0;
+		/* back to the first frame; false if the source can't */
+		virtual bool rewind() = 0;
+		/* number of frames in a recording, or -1 if it isn't known */
+		virtual long getFrameCount() = 0;
+		/* so the next read() returns frame frameIndex; false if the */
+		/* source can't seek */
+		virtual bool seek( unsigned long frameIndex ) = 0;
+		
+		virtual string describe() = 0;
+	};
+
+	/* a webcam through cv::VideoCapture */
+	class CameraSource : public FrameSource {
+	public:
+		CameraSource( int cameraIndex );
+		
+		bool isOpened();
+		bool isLive();
+		bool read( cv::Mat &frame, double &timestamp );
+		bool skip();
+		bool rewind();
+		long getFrameCount();
+		bool seek( unsigned long frameIndex );
+		string describe();
+		
+	private:
+		cv::VideoCapture _capture;
+		int _cameraIndex;
+		double _startTime;
+	};
+
+	/* a recorded video file, timed by the container's timestamps */
+	class VideoFileSource : public FrameSource {
+	public:
+		VideoFileSource( const string &filename );
+		
+		bool isOpened();
+		bool isLive();
+		bool read( cv::Mat &frame, double &timestamp );
+		bool skip();
+		bool rewind();
+		long getFrameCount();
+		bool seek( unsigned long frameIndex );
+		string describe();
+		
+	private:
+		cv::VideoCapture _capture;
+		string _filename;
+		double _fps;
+		unsigned long _frameIndex;
+	};
+
+	/* every image in a directory, in name order, at a fixed frame rate */
+	class ImageDirectorySource : public FrameSource {
+	public:
+		ImageDirectorySource( const string &directory, double fps = 30.0 );
+		
+		bool isOpened();
+		bool isLive();
+		bool read( cv::Mat &frame, double &timestamp );
+		bool skip();
+		bool rewind();
+		long getFrameCount();
+		bool seek( unsigned long frameIndex );
+		string describe();
+		
+	private:
+		string _directory;
+		vector< cv::String > _filenames;
+		double _fps;
+		unsigned int _next;
+	};
+
+
+#endif
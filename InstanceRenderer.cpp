@@ -0,0 +1,34 @@
+#include "InstanceRenderer.h"
+
+
+	InstanceRenderer::InstanceRenderer() {
+		_numInstances = 0;
+	}
+	
+	void InstanceRenderer::clear() {
+		map< Object*, vector< GLfloat > >::iterator iter;
+		for( iter = _transforms.begin(); iter != _transforms.end(); ++iter ) {
+			iter->second.clear();
+		}
+		_numInstances = 0;
+	}
+	
+	void InstanceRenderer::addInstance( Object *model, const GLfloat modelView[16] ) {
+		if( model == NULL )
+			return;
+		
+		vector< GLfloat > &transforms = _transforms[ model ];
+		transforms.insert( transforms.end(), modelView, modelView + 16 );
+		_numInstances++;
+	}
+	
+	unsigned int InstanceRenderer::getNumInstances() { return _numInstances; }
+	
+	void InstanceRenderer::draw() {
+		map< Object*, vector< GLfloat > >::iterator iter;
+		for( iter = _transforms.begin(); iter != _transforms.end(); ++iter ) {
+			if( iter->second.empty() )
+				continue;
+			iter->first->drawInstances( &iter->second[0], iter->second.size() / 16 );
+		}
+	}
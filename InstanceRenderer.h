@@ -0,0 +1,36 @@
+#ifndef _INSTANCE_RENDERER_H_
+#define _INSTANCE_RENDERER_H_ 1
+
+#include <GL/glew.h>
+
+#include "Object.h"
+
+#include <map>
+#include <vector>
+using namespace std;
+
+
+
+	class InstanceRenderer {
+	public:
+		InstanceRenderer();
+		
+		/* forget the previous frame's instances, keeping their buffers for reuse */
+		void clear();
+		
+		/* queue one copy of model placed by a column-major modelview matrix */
+		void addInstance( Object *model, const GLfloat modelView[16] );
+		
+		unsigned int getNumInstances();
+		
+		/* draw every queued instance, one drawInstances call per model */
+		void draw();
+		
+	private:
+		/* per-model packed 4x4 transforms, 16 floats per instance */
+		map< Object*, vector< GLfloat > > _transforms;
+		unsigned int _numInstances;
+	};
+
+
+#endif
@@ -0,0 +1,46 @@
+#include "MarkerCodeTable.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <stdio.h>
+
+
+	MarkerCodes* MarkerCodes::create( const cv::Ptr< cv::aruco::Dictionary > &dictionary, int maxCorrectionBits ) {
+		switch( dictionary->markerSize ) {
+			case 4: return new MarkerCodeTable< 4 >( dictionary, maxCorrectionBits );
+			case 5: return new MarkerCodeTable< 5 >( dictionary, maxCorrectionBits );
+			case 6: return new MarkerCodeTable< 6 >( dictionary, maxCorrectionBits );
+			case 7: return new MarkerCodeTable< 7 >( dictionary, maxCorrectionBits );
+		}
+		fprintf( stderr, "[codes]: [WARNING]: no code table for %dx%d markers\n", dictionary->markerSize, dictionary->markerSize );
+		return NULL;
+	}
+
+	/*
+	 * As detectMarkers reads a candidate: the marker is warped square, split
+	 * by Otsu's threshold, and each cell is white if most of its middle is;
+	 * the edges of every cell are left out, where neighbouring cells bleed in.
+	 */
+	void MarkerCodes::readBits( const cv::Mat &gray, const vector< cv::Point2f > &corners, int markerSize,
+								const cv::aruco::DetectorParameters &params, cv::Mat &bits, cv::Mat &scratch ) {
+		int cellPixels = params.perspectiveRemovePixelPerCell;
+		int cells = markerSize + 2 * params.markerBorderBits;
+		float side = (float)( cells * cellPixels );
+		cv::Point2f square[4] = { cv::Point2f( 0, 0 ), cv::Point2f( side - 1, 0 ),
+								  cv::Point2f( side - 1, side - 1 ), cv::Point2f( 0, side - 1 ) };
+		cv::Mat transform = cv::getPerspectiveTransform( &corners[0], square );
+		cv::warpPerspective( gray, scratch, transform, cv::Size( (int)side, (int)side ), cv::INTER_NEAREST );
+		cv::threshold( scratch, scratch, 125, 255, cv::THRESH_BINARY | cv::THRESH_OTSU );
+
+		int margin = (int)( params.perspectiveRemoveIgnoredMarginPerCell * cellPixels );
+		int inner = cellPixels - 2 * margin;
+		bits.create( markerSize, markerSize, CV_8UC1 );
+		for( int row = 0; row < markerSize; row++ ) {
+			for( int col = 0; col < markerSize; col++ ) {
+				int y = ( row + params.markerBorderBits ) * cellPixels + margin;
+				int x = ( col + params.markerBorderBits ) * cellPixels + margin;
+				int white = cv::countNonZero( scratch( cv::Rect( x, y, inner, inner ) ) );
+				bits.at< unsigned char >( row, col ) = 2 * white > inner * inner ? 1 : 0;
+			}
+		}
+	}
@@ -0,0 +1,171 @@
+#ifndef _MARKER_CODE_TABLE_H_
+#define _MARKER_CODE_TABLE_H_ 1
+
+#include <opencv2/aruco.hpp>
+#include <opencv2/core.hpp>
+
+#include <stdint.h>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+
+
+	/* identifies a marker from its bits without searching the dictionary: */
+	/* every id's code, in all four rotations and with every error the */
+	/* dictionary can correct, is looked up in a table built once */
+	class MarkerCodes {
+	public:
+		virtual ~MarkerCodes() {}
+
+		/* the table for the dictionary's marker size, up to */
+		/* maxCorrectionBits wrong bits; NULL for sizes without one */
+		static MarkerCodes* create( const cv::Ptr< cv::aruco::Dictionary > &dictionary, int maxCorrectionBits );
+
+		/* sample a marker's bits from a grayscale image, white as 1, */
+		/* through the perspective of its four corners, with the border and */
+		/* resampling settings detection uses; scratch is reused between calls */
+		static void readBits( const cv::Mat &gray, const vector< cv::Point2f > &corners, int markerSize,
+							  const cv::aruco::DetectorParameters &params, cv::Mat &bits, cv::Mat &scratch );
+
+		virtual int getMarkerSize() const = 0;
+
+		/* bits: markerSize x markerSize CV_8UC1, nonzero for white; rotation */
+		/* as cv::aruco::Dictionary::identify gives it */
+		virtual bool identify( const cv::Mat &bits, int &id, int &rotation ) const = 0;
+	};
+
+	/* one marker size's table; the code is the bits row by row, first bit */
+	/* highest, in the smallest integer that holds them; 4x4 codes index a */
+	/* dense table of every 16-bit value, larger ones are hashed */
+	template< int N >
+	class MarkerCodeTable : public MarkerCodes {
+	public:
+		typedef typename conditional< N * N <= 16, uint16_t,
+				typename conditional< N * N <= 32, uint32_t, uint64_t >::type >::type Code;
+		static const bool DENSE = N * N <= 16;
+
+		/* larger codes have too many neighbours to list beyond this many */
+		/* errors; codes further out are found by comparing against every id */
+		static const int MAX_HASHED_ERRORS = 1;
+
+		MarkerCodeTable( const cv::Ptr< cv::aruco::Dictionary > &dictionary, int maxCorrectionBits ) {
+			_maxCorrectionBits = maxCorrectionBits < 0 ? 0 : maxCorrectionBits;
+			int listedErrors = DENSE ? _maxCorrectionBits : min( _maxCorrectionBits, (int)MAX_HASHED_ERRORS );
+			if( DENSE )
+				_dense.assign( (size_t)1 << ( DENSE ? N * N : 0 ), Entry() );
+
+			// every exact code first, so a neighbour never displaces one
+			int numIds = dictionary->bytesList.rows;
+			_codes.resize( 4 * numIds );
+			for( int id = 0; id < numIds; id++ )
+				for( int rotation = 0; rotation < 4; rotation++ )
+					_codes[ 4 * id + rotation ] = pack( rotationBits( dictionary, id, rotation ) );
+			for( int errors = 0; errors <= listedErrors; errors++ )
+				for( int id = 0; id < numIds; id++ )
+					for( int rotation = 0; rotation < 4; rotation++ )
+						addNeighbours( _codes[ 4 * id + rotation ], id, rotation, errors, 0 );
+		}
+
+		int getMarkerSize() const { return N; }
+
+		bool identify( const cv::Mat &bits, int &id, int &rotation ) const {
+			return identify( pack( bits ), id, rotation );
+		}
+
+		bool identify( Code code, int &id, int &rotation ) const {
+			const Entry *entry = find( code );
+			if( entry != NULL ) {
+				if( entry->id < 0 )
+					return false;		// as near to two ids, or nowhere near any
+				id = entry->id;
+				rotation = entry->rotation;
+				return true;
+			}
+			if( DENSE || _maxCorrectionBits <= MAX_HASHED_ERRORS )
+				return false;
+
+			// beyond the listed neighbours: nearest code, if it is unique
+			int best = -1, bestErrors = _maxCorrectionBits + 1;
+			bool tied = false;
+			for( unsigned int c = 0; c < _codes.size(); c++ ) {
+				int errors = popcount( _codes[c] ^ code );
+				if( errors < bestErrors ) {
+					best = c;
+					bestErrors = errors;
+					tied = false;
+				} else if( errors == bestErrors && (int)c / 4 != best / 4 ) {
+					tied = true;
+				}
+			}
+			if( best < 0 || tied )
+				return false;
+			id = best / 4;
+			rotation = best % 4;
+			return true;
+		}
+
+		static Code pack( const cv::Mat &bits ) {
+			Code code = 0;
+			for( int row = 0; row < N; row++ )
+				for( int col = 0; col < N; col++ )
+					code = (Code)( ( code << 1 ) | ( bits.at< unsigned char >( row, col ) ? 1 : 0 ) );
+			return code;
+		}
+
+	private:
+		struct Entry {
+			int16_t id;				// -1: no code this near, -2: as near to two ids
+			uint8_t rotation;
+			uint8_t errors;
+			Entry() : id( -1 ), rotation( 0 ), errors( 0xff ) {}
+		};
+
+		int _maxCorrectionBits;
+		vector< Entry > _dense;
+		unordered_map< Code, Entry > _hashed;
+		vector< Code > _codes;			// id * 4 + rotation
+
+		/* an id's row of bytesList holds its code in each rotation, one */
+		/* after another; Dictionary::identify numbers rotations by where */
+		/* they sit in the row, so they are read from there, not turned here */
+		static cv::Mat rotationBits( const cv::Ptr< cv::aruco::Dictionary > &dictionary, int id, int rotation ) {
+			int numBytes = ( N * N + 7 ) / 8;
+			cv::Mat bytes( 1, numBytes, CV_8UC1, (void*)( dictionary->bytesList.ptr( id ) + rotation * numBytes ) );
+			return cv::aruco::Dictionary::getBitsFromByteList( bytes, N );
+		}
+
+		static int popcount( Code code ) {
+			return __builtin_popcountll( (unsigned long long)code );
+		}
+
+		const Entry* find( Code code ) const {
+			if( DENSE )
+				return &_dense[ code ];
+			typename unordered_map< Code, Entry >::const_iterator iter = _hashed.find( code );
+			return iter == _hashed.end() ? NULL : &iter->second;
+		}
+
+		/* every code exactly errors bits from code, flipping bits from */
+		/* firstBit up so each is reached once */
+		void addNeighbours( Code code, int id, int rotation, int errors, int firstBit ) {
+			if( errors == 0 ) {
+				Entry &entry = DENSE ? _dense[ code ] : _hashed[ code ];
+				int distance = popcount( code ^ _codes[ 4 * id + rotation ] );
+				if( distance < entry.errors ) {
+					entry.id = id;
+					entry.rotation = rotation;
+					entry.errors = distance;
+				} else if( distance == entry.errors && entry.id != id ) {
+					entry.id = -2;
+				}
+				return;
+			}
+			for( int bit = firstBit; bit < N * N; bit++ )
+				addNeighbours( (Code)( code ^ ( (Code)1 << bit ) ), id, rotation, errors - 1, bit + 1 );
+		}
+	};
+
+
+#endif
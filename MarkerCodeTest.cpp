@@ -0,0 +1,212 @@
+/*
+ * markerCodeTest: checks the marker code tables against a brute force
+ * search of the dictionary and against cv::aruco::Dictionary::identify,
+ * without a window or a camera.
+ *
+ *   markerCodeTest
+ *
+ * For each predefined dictionary size, with the dictionary's own
+ * correction radius and with two bits more (where codes start to sit as
+ * near to two ids as to one):
+ *   every id in every rotation is identified as that id and rotation,
+ *   as Dictionary::identify numbers them;
+ *   every code within the radius of an id resolves to it, and agrees
+ *   with Dictionary::identify;
+ *   a code past the radius, or as near to two ids, is refused.
+ * The first 250 ids of each are taken through every single bit error and
+ * a sample of larger ones.  Exits 1 if any check fails.
+ */
+
+#include "MarkerCodeTable.h"
+
+#include <opencv2/aruco.hpp>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+using namespace std;
+
+
+static int failures = 0;
+
+static void check( bool passed, const char *what, const char *dictionary, unsigned long long code ) {
+	if( !passed ) {
+		if( failures < 20 )
+			fprintf( stderr, "[markerCodeTest]: FAILED %s (%s, code %llx)\n", what, dictionary, code );
+		failures++;
+	}
+}
+
+/* xorshift, so runs are repeatable and codes up to 49 bits are covered */
+static uint64_t random64() {
+	static uint64_t state = 0x9e3779b97f4a7c15ULL;
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+/* code with errors distinct bits of its N * N flipped */
+template< int N >
+static typename MarkerCodeTable< N >::Code flipBits( typename MarkerCodeTable< N >::Code code, int errors ) {
+	typedef typename MarkerCodeTable< N >::Code Code;
+	Code flipped = 0;
+	for( int e = 0; e < errors && e < N * N; ) {
+		Code bit = (Code)1 << ( random64() % ( N * N ) );
+		if( flipped & bit )
+			continue;
+		flipped |= bit;
+		e++;
+	}
+	return (Code)( code ^ flipped );
+}
+
+/* the bits MarkerCodeTable::pack packs: row by row, first bit highest */
+template< int N >
+static cv::Mat unpack( typename MarkerCodeTable< N >::Code code ) {
+	cv::Mat bits( N, N, CV_8UC1 );
+	for( int row = 0; row < N; row++ )
+		for( int col = 0; col < N; col++ )
+			bits.at< unsigned char >( row, col ) = ( code >> ( N * N - 1 - ( row * N + col ) ) ) & 1;
+	return bits;
+}
+
+/* the nearest code by comparing against every id in every rotation */
+struct Nearest {
+	int distance;
+	int id;
+	int rotation;
+	bool tied;					// as near to another id
+};
+
+template< int N >
+class Oracle {
+public:
+	typedef typename MarkerCodeTable< N >::Code Code;
+
+	Oracle( const cv::Ptr< cv::aruco::Dictionary > &dictionary ) {
+		int numIds = dictionary->bytesList.rows;
+		int numBytes = ( N * N + 7 ) / 8;
+		for( int id = 0; id < numIds; id++ )
+			for( int rotation = 0; rotation < 4; rotation++ ) {
+				// rotation r is the r-th run of bytes in the id's row, as
+				// Dictionary::identify compares them
+				cv::Mat bytes( 1, numBytes, CV_8UC1, (void*)( dictionary->bytesList.ptr( id ) + rotation * numBytes ) );
+				codes.push_back( MarkerCodeTable< N >::pack( cv::aruco::Dictionary::getBitsFromByteList( bytes, N ) ) );
+			}
+	}
+
+	Nearest nearest( Code code ) const {
+		Nearest best = { N * N + 1, -1, -1, false };
+		for( unsigned int c = 0; c < codes.size(); c++ ) {
+			int distance = __builtin_popcountll( (unsigned long long)( codes[c] ^ code ) );
+			if( distance < best.distance ) {
+				best.distance = distance;
+				best.id = c / 4;
+				best.rotation = c % 4;
+				best.tied = false;
+			} else if( distance == best.distance && (int)c / 4 != best.id ) {
+				best.tied = true;
+			}
+		}
+		return best;
+	}
+
+	vector< Code > codes;			// id * 4 + rotation
+};
+
+template< int N >
+static void checkCode( const MarkerCodeTable< N > &table, const Oracle< N > &oracle, int maxCorrectionBits,
+					   const cv::Ptr< cv::aruco::Dictionary > &dictionary, bool compareOpenCV,
+					   typename MarkerCodeTable< N >::Code code, int expectedId, const char *name,
+					   unsigned long &accepted, unsigned long &refused ) {
+	Nearest nearest = oracle.nearest( code );
+	int id = -1, rotation = -1;
+	bool found = table.identify( code, id, rotation );
+	bool expected = nearest.distance <= maxCorrectionBits && !nearest.tied;
+	( found ? accepted : refused )++;
+
+	if( expected ) {
+		check( found, "code within the radius is refused", name, code );
+		check( !found || id == nearest.id, "code resolves to the wrong id", name, code );
+	} else {
+		check( !found, nearest.tied ? "code as near to two ids is accepted" : "code past the radius is accepted", name, code );
+	}
+	// within the dictionary's own radius nothing is nearer than the id
+	// the code was made from
+	if( expectedId >= 0 && !nearest.tied )
+		check( found && id == expectedId, "code within the radius of its id resolves elsewhere", name, code );
+
+	if( compareOpenCV && !nearest.tied ) {
+		int cvId = -1, cvRotation = -1;
+		bool cvFound = dictionary->identify( unpack< N >( code ), cvId, cvRotation, 1.0 );
+		check( cvFound == found, "disagrees with Dictionary::identify on whether", name, code );
+		check( !found || !cvFound || ( cvId == id && cvRotation == rotation ), "disagrees with Dictionary::identify on id or rotation", name, code );
+	}
+}
+
+template< int N >
+static void checkDictionary( const char *name, int predefined ) {
+	typedef typename MarkerCodeTable< N >::Code Code;
+	cv::Ptr< cv::aruco::Dictionary > dictionary = cv::aruco::getPredefinedDictionary( predefined );
+	Oracle< N > oracle( dictionary );
+	int numIds = dictionary->bytesList.rows;
+	// every id is in the oracle, but ARUCO_ORIGINAL's 1024 are too many to
+	// take each through every error
+	int numSeeds = min( numIds, 250 );
+
+	for( int extra = 0; extra <= 2; extra += 2 ) {
+		int maxCorrectionBits = dictionary->maxCorrectionBits + extra;
+		// Dictionary::identify only knows its own radius
+		bool compareOpenCV = extra == 0;
+		MarkerCodeTable< N > table( dictionary, maxCorrectionBits );
+		unsigned long accepted = 0, refused = 0;
+
+		for( int k = 0; k < numSeeds; k++ ) {
+			for( int r = 0; r < 4; r++ ) {
+				Code code = oracle.codes[ 4 * k + r ];
+				int id = -1, rotation = -1;
+				if( !oracle.nearest( code ).tied ) {
+					check( table.identify( code, id, rotation ) && id == k && rotation == r, "exact code is not (id, rotation)", name, code );
+					if( compareOpenCV ) {
+						bool cvFound = dictionary->identify( unpack< N >( code ), id, rotation, 1.0 );
+						check( cvFound && id == k && rotation == r, "Dictionary::identify numbers the rotation differently", name, code );
+					}
+				}
+
+				// every single bit error, then a few of each size up to a bit past the radius
+				int radius = dictionary->maxCorrectionBits;
+				for( int bit = 0; bit < N * N; bit++ )
+					checkCode( table, oracle, maxCorrectionBits, dictionary, compareOpenCV,
+							   (Code)( code ^ ( (Code)1 << bit ) ), 1 <= radius ? k : -1, name, accepted, refused );
+				for( int errors = 2; errors <= maxCorrectionBits + 2; errors++ )
+					for( int sample = 0; sample < 2; sample++ )
+						checkCode( table, oracle, maxCorrectionBits, dictionary, compareOpenCV,
+								   flipBits< N >( code, errors ), errors <= radius ? k : -1, name, accepted, refused );
+			}
+		}
+		// codes from nowhere near any id, mostly
+		for( int sample = 0; sample < 2000; sample++ ) {
+			Code code = (Code)( random64() & ( ( (uint64_t)1 << ( N * N ) ) - 1 ) );
+			checkCode( table, oracle, maxCorrectionBits, dictionary, compareOpenCV, code, -1, name, accepted, refused );
+		}
+
+		printf( "[markerCodeTest]: %-19s %4d ids, correcting %d bits: %lu codes accepted, %lu refused\n",
+				name, numIds, maxCorrectionBits, accepted, refused );
+	}
+}
+
+int main( int argc, char* argv[] ) {
+	checkDictionary< 4 >( "DICT_4X4_250", cv::aruco::DICT_4X4_250 );
+	checkDictionary< 5 >( "DICT_5X5_250", cv::aruco::DICT_5X5_250 );
+	checkDictionary< 5 >( "DICT_ARUCO_ORIGINAL", cv::aruco::DICT_ARUCO_ORIGINAL );
+	checkDictionary< 6 >( "DICT_6X6_250", cv::aruco::DICT_6X6_250 );
+	checkDictionary< 7 >( "DICT_7X7_250", cv::aruco::DICT_7X7_250 );
+
+	if( failures > 0 ) {
+		fprintf( stderr, "[markerCodeTest]: %d checks failed\n", failures );
+		return 1;
+	}
+	printf( "[markerCodeTest]: all checks passed\n" );
+	return 0;
+}
@@ -0,0 +1,455 @@
+#include "MarkerDetector.h"
+
+#include "FrameRing.h"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+
+	static const cv::Size FLOW_WINDOW( 21, 21 );
+	static const int FLOW_LEVELS = 3;
+	
+	MarkerDetector::MarkerDetector() {
+		_roiTracking = false;
+		_fullFrameInterval = 15;
+		_roiMargin = 0.5f;
+		_pyramid = false;
+		_minMarkerSide = 48.0f;
+		_compareInterval = 0;
+		_maxScale = 1.0f;
+		_framesSinceCompare = 0;
+		_framesSinceFullFrame = 0;
+		_flowTracking = false;
+		_flowDetectionInterval = 10;
+		_maxTrackingError = 1.0f;
+		_framesSinceDetection = 0;
+		resetStats();
+	}
+	
+	void MarkerDetector::setDictionary( cv::Ptr< cv::aruco::Dictionary > dictionary, cv::Ptr< cv::aruco::DetectorParameters > detectorParams ) {
+		_dictionary = dictionary;
+		_detectorParams = detectorParams;
+		_codes.release();
+	}
+	
+	void MarkerDetector::setRoiTracking( bool enabled, unsigned int fullFrameInterval, float margin ) {
+		_roiTracking = enabled;
+		_fullFrameInterval = fullFrameInterval < 1 ? 1 : fullFrameInterval;
+		_roiMargin = margin;
+		_tracked.clear();
+	}
+	
+	void MarkerDetector::setPyramid( bool enabled, float minMarkerSide, unsigned int compareInterval ) {
+		_pyramid = enabled;
+		_minMarkerSide = minMarkerSide;
+		_compareInterval = compareInterval;
+		_framesSinceCompare = 0;
+	}
+	
+	/*
+	 * A marker decodes reliably while each of its cells, border included,
+	 * covers about three pixels, so halve the image for as long as the
+	 * smallest wanted marker stays above that.  Stops at 1/8.
+	 */
+	float MarkerDetector::getPyramidScale() {
+		float maxScale = _maxScale;
+		if( !_pyramid || !_dictionary )
+			return maxScale;
+		
+		int cells = _dictionary->markerSize + 2 * _detectorParams->markerBorderBits;
+		float minDecodableSide = 3.0f * cells;
+		
+		float scale = 1.0f;
+		while( scale > 0.125f && _minMarkerSide * scale * 0.5f >= minDecodableSide )
+			scale *= 0.5f;
+		return min( scale, maxScale );
+	}
+	
+	void MarkerDetector::setMaxScale( float maxScale ) {
+		_maxScale = maxScale > 0.0f && maxScale < 1.0f ? maxScale : 1.0f;
+	}
+	
+	void MarkerDetector::setFlowTracking( bool enabled, unsigned int detectionInterval, float maxTrackingError ) {
+		_flowTracking = enabled;
+		_flowDetectionInterval = detectionInterval < 1 ? 1 : detectionInterval;
+		_maxTrackingError = maxTrackingError;
+		_flowIds.clear();
+		_previousFlowPyramid.clear();
+	}
+	
+	void MarkerDetector::detect( const cv::Mat &image, vector< vector< cv::Point2f > > &corners, vector< int > &ids ) {
+		// detectMarkers would convert each call's input itself; do it once
+		if( image.channels() == 3 )
+			cv::cvtColor( image, _gray, cv::COLOR_BGR2GRAY );
+		else
+			_gray = image;
+		_rejected.clear();
+		
+		if( !_flowTracking ) {
+			detectMarkers( corners, ids );
+			return;
+		}
+		
+		// every frame's pyramid is kept for tracking into the next one; never
+		// let it alias _gray, which the next frame overwrites
+		cv::buildOpticalFlowPyramid( _gray, _flowPyramid, FLOW_WINDOW, FLOW_LEVELS, true,
+									 cv::BORDER_REFLECT_101, cv::BORDER_CONSTANT, false );
+		
+		double start = FrameRing::now();
+		if( _framesSinceDetection < _flowDetectionInterval && trackCorners( corners, ids ) ) {
+			_framesSinceDetection++;
+			_numTracked++;
+			_trackingSeconds = _trackingSeconds + ( FrameRing::now() - start );
+			if( _roiTracking )
+				updateTracks( corners, ids );
+		} else {
+			detectMarkers( corners, ids );
+			_framesSinceDetection = 0;
+			_numDetections++;
+			_detectionSeconds = _detectionSeconds + ( FrameRing::now() - start );
+		}
+		
+		// the corners just found are what the next frame tracks
+		_flowIds = ids;
+		_flowPoints.clear();
+		for( unsigned int i = 0; i < corners.size(); i++ )
+			_flowPoints.insert( _flowPoints.end(), corners[i].begin(), corners[i].end() );
+		_previousFlowPyramid.swap( _flowPyramid );
+	}
+	
+	const vector< vector< cv::Point2f > >& MarkerDetector::getRejected() { return _rejected; }
+	
+	void MarkerDetector::detectMarkers( vector< vector< cv::Point2f > > &corners, vector< int > &ids ) {
+		if( !_roiTracking ) {
+			detectFullFrame( corners, ids );
+			return;
+		}
+		
+		// new markers can only be found by a full-frame pass, so run one
+		// every so often, and whenever a tracked marker goes missing
+		bool fullFrame = _tracked.empty() || _framesSinceFullFrame >= _fullFrameInterval;
+		if( !fullFrame && !detectInRois( corners, ids ) ) {
+			_numMisses++;
+			fullFrame = true;
+		}
+		
+		if( fullFrame ) {
+			detectFullFrame( corners, ids );
+			_framesSinceFullFrame = 0;
+		} else {
+			_framesSinceFullFrame++;
+		}
+		
+		updateTracks( corners, ids );
+	}
+	
+	/*
+	 * Every corner is flowed into this frame and back again.  A corner that
+	 * does not come back to where it started, or that flow loses, means the
+	 * corners can no longer be trusted, so the whole frame is re-detected.
+	 */
+	bool MarkerDetector::trackCorners( vector< vector< cv::Point2f > > &corners, vector< int > &ids ) {
+		if( _flowIds.empty() || _previousFlowPyramid.empty() )
+			return false;
+		
+		cv::calcOpticalFlowPyrLK( _previousFlowPyramid, _flowPyramid, _flowPoints, _flowForward, _flowStatus, _flowError, FLOW_WINDOW, FLOW_LEVELS );
+		cv::calcOpticalFlowPyrLK( _flowPyramid, _previousFlowPyramid, _flowForward, _flowBackward, _flowBackStatus, _flowError, FLOW_WINDOW, FLOW_LEVELS );
+		
+		float worstError = 0;
+		for( unsigned int p = 0; p < _flowPoints.size(); p++ ) {
+			if( !_flowStatus[p] || !_flowBackStatus[p] ) {
+				_numTrackingLost++;
+				return false;
+			}
+			cv::Point2f d = _flowBackward[p] - _flowPoints[p];
+			worstError = max( worstError, (float)sqrt( d.x * d.x + d.y * d.y ) );
+		}
+		if( worstError > _maxTrackingError ) {
+			_numTrackingLost++;
+			return false;
+		}
+		ids = _flowIds;
+		corners.resize( ids.size() );
+		for( unsigned int i = 0; i < ids.size(); i++ )
+			corners[i].assign( _flowForward.begin() + 4 * i, _flowForward.begin() + 4 * i + 4 );
+		if( !verifyIds( corners, ids ) ) {
+			_numIdMismatches++;
+			_numTrackingLost++;
+			return false;
+		}
+		_trackingError = _trackingError + worstError;
+		return true;
+	}
+	
+	/*
+	 * Flow can slide a quad onto a neighbouring marker or turn it about one
+	 * without any corner failing the forward-backward check.  Each tracked
+	 * marker's bits are read back through its corners and looked up in the
+	 * dictionary's code table, which has to give the same id, the same way
+	 * up; one lookup per marker, where Dictionary::identify would compare
+	 * against every id in every rotation.
+	 */
+	bool MarkerDetector::verifyIds( const vector< vector< cv::Point2f > > &corners, const vector< int > &ids ) {
+		if( !_codes ) {
+			int maxCorrectionBits = (int)( _dictionary->maxCorrectionBits * _detectorParams->errorCorrectionRate );
+			MarkerCodes *codes = MarkerCodes::create( _dictionary, maxCorrectionBits );
+			if( codes == NULL )
+				return true;
+			_codes = cv::Ptr< MarkerCodes >( codes );
+		}
+		
+		for( unsigned int i = 0; i < ids.size(); i++ ) {
+			int id, rotation;
+			MarkerCodes::readBits( _gray, corners[i], _dictionary->markerSize, *_detectorParams, _codeBits, _codeScratch );
+			if( !_codes->identify( _codeBits, id, rotation ) || id != ids[i] || rotation != 0 )
+				return false;
+		}
+		return true;
+	}
+	
+	void MarkerDetector::detectFullFrame( vector< vector< cv::Point2f > > &corners, vector< int > &ids ) {
+		double start = FrameRing::now();
+		detectCandidates( _gray, corners, ids );
+		_rejected.swap( _candidateRejected );
+		_numFullFrame++;
+		
+		if( _pyramid && _compareInterval > 0 && ++_framesSinceCompare >= _compareInterval ) {
+			compareFullResolution( corners, ids, FrameRing::now() - start );
+			_framesSinceCompare = 0;
+		}
+	}
+	
+	/*
+	 * In pyramid mode the corners found on the small image are mapped back
+	 * through pixel centres, which leaves them up to 1/scale pixels out, so
+	 * cornerSubPix searches a window at least that wide on the full image.
+	 * Rejected candidates, left in _candidateRejected, are only scaled.
+	 */
+	void MarkerDetector::detectCandidates( const cv::Mat &gray, vector< vector< cv::Point2f > > &corners, vector< int > &ids ) {
+		float scale = getPyramidScale();
+		if( scale >= 1.0f ) {
+			cv::aruco::detectMarkers( gray, _dictionary, corners, ids, _detectorParams, _candidateRejected );
+			return;
+		}
+		
+		cv::resize( gray, _small, cv::Size(), scale, scale, cv::INTER_AREA );
+		cv::aruco::detectMarkers( _small, _dictionary, corners, ids, _detectorParams, _candidateRejected );
+		
+		for( unsigned int i = 0; i < _candidateRejected.size(); i++ ) {
+			for( unsigned int c = 0; c < _candidateRejected[i].size(); c++ ) {
+				_candidateRejected[i][c].x = ( _candidateRejected[i][c].x + 0.5f ) / scale - 0.5f;
+				_candidateRejected[i][c].y = ( _candidateRejected[i][c].y + 0.5f ) / scale - 0.5f;
+			}
+		}
+		
+		for( unsigned int i = 0; i < corners.size(); i++ ) {
+			for( unsigned int c = 0; c < corners[i].size(); c++ ) {
+				corners[i][c].x = ( corners[i][c].x + 0.5f ) / scale - 0.5f;
+				corners[i][c].y = ( corners[i][c].y + 0.5f ) / scale - 0.5f;
+			}
+			
+			int halfWindow = max( _detectorParams->cornerRefinementWinSize, (int)ceil( 1.0f / scale ) + 1 );
+			cv::cornerSubPix( gray, corners[i], cv::Size( halfWindow, halfWindow ), cv::Size( -1, -1 ),
+							  cv::TermCriteria( cv::TermCriteria::MAX_ITER | cv::TermCriteria::EPS, 30, 0.01 ) );
+		}
+	}
+	
+	/* times a full resolution pass over the same frame and measures how far */
+	/* the pyramid's corners are from its corners, marker by marker */
+	void MarkerDetector::compareFullResolution( const vector< vector< cv::Point2f > > &corners, const vector< int > &ids, double pyramidSeconds ) {
+		double start = FrameRing::now();
+		cv::aruco::detectMarkers( _gray, _dictionary, _compareCorners, _compareIds, _detectorParams );
+		_fullResSeconds = _fullResSeconds + ( FrameRing::now() - start );
+		_pyramidSeconds = _pyramidSeconds + pyramidSeconds;
+		_numCompared++;
+		
+		for( unsigned int i = 0; i < _compareIds.size(); i++ ) {
+			vector< int >::const_iterator found = find( ids.begin(), ids.end(), _compareIds[i] );
+			if( found == ids.end() ) {
+				_numComparedMissed++;
+				continue;
+			}
+			
+			const vector< cv::Point2f > &pyramidCorners = corners[ found - ids.begin() ];
+			double error = 0;
+			for( unsigned int c = 0; c < 4; c++ ) {
+				cv::Point2f d = pyramidCorners[c] - _compareCorners[i][c];
+				error += sqrt( d.x * d.x + d.y * d.y );
+			}
+			_cornerError = _cornerError + error / 4.0;
+			_numComparedMarkers++;
+		}
+	}
+	
+	/* false if any tracked marker was not found in its window */
+	bool MarkerDetector::detectInRois( vector< vector< cv::Point2f > > &corners, vector< int > &ids ) {
+		predictRois( _gray.size() );
+		
+		// corners keeps its inner vectors, and their capacity, across frames
+		unsigned int numFound = 0;
+		ids.clear();
+		double roiArea = 0;
+		for( unsigned int r = 0; r < _rois.size(); r++ ) {
+			const cv::Rect &roi = _rois[r];
+			roiArea += roi.area();
+			
+			detectCandidates( _gray( roi ), _roiCorners, _roiIds );
+			
+			for( unsigned int i = 0; i < _candidateRejected.size(); i++ ) {
+				for( unsigned int c = 0; c < _candidateRejected[i].size(); c++ ) {
+					_candidateRejected[i][c].x += roi.x;
+					_candidateRejected[i][c].y += roi.y;
+				}
+				_rejected.push_back( _candidateRejected[i] );
+			}
+			
+			// back to full-frame coordinates; windows never overlap, so each
+			// marker can only be found once
+			for( unsigned int i = 0; i < _roiIds.size(); i++ ) {
+				for( unsigned int c = 0; c < _roiCorners[i].size(); c++ ) {
+					_roiCorners[i][c].x += roi.x;
+					_roiCorners[i][c].y += roi.y;
+				}
+				if( corners.size() <= numFound )
+					corners.resize( numFound + 1 );
+				corners[ numFound++ ].assign( _roiCorners[i].begin(), _roiCorners[i].end() );
+				ids.push_back( _roiIds[i] );
+			}
+		}
+		corners.resize( numFound );
+		_numRoi++;
+		_roiAreaFraction = _roiAreaFraction + roiArea / _gray.size().area();
+		
+		for( map< int, TrackedMarker >::iterator iter = _tracked.begin(); iter != _tracked.end(); ++iter ) {
+			if( find( ids.begin(), ids.end(), iter->first ) == ids.end() )
+				return false;
+		}
+		return true;
+	}
+	
+	/*
+	 * Each tracked marker's corners are moved on by its velocity, boxed and
+	 * grown by the margin on every side.  Boxes that overlap are merged, so
+	 * no marker can be found in two windows.
+	 */
+	void MarkerDetector::predictRois( const cv::Size &imageSize ) {
+		const cv::Rect frame( 0, 0, imageSize.width, imageSize.height );
+		
+		_rois.clear();
+		for( map< int, TrackedMarker >::iterator iter = _tracked.begin(); iter != _tracked.end(); ++iter ) {
+			const TrackedMarker &marker = iter->second;
+			
+			float minX = marker.corners[0].x, maxX = minX;
+			float minY = marker.corners[0].y, maxY = minY;
+			for( unsigned int c = 1; c < marker.corners.size(); c++ ) {
+				minX = min( minX, marker.corners[c].x );
+				maxX = max( maxX, marker.corners[c].x );
+				minY = min( minY, marker.corners[c].y );
+				maxY = max( maxY, marker.corners[c].y );
+			}
+			
+			float grow = _roiMargin * max( maxX - minX, maxY - minY ) + 8.0f;
+			cv::Rect roi( cv::Point( (int)( minX + marker.velocity.x - grow ), (int)( minY + marker.velocity.y - grow ) ),
+						  cv::Point( (int)( maxX + marker.velocity.x + grow ) + 1, (int)( maxY + marker.velocity.y + grow ) + 1 ) );
+			roi &= frame;
+			if( roi.area() > 0 )
+				_rois.push_back( roi );
+		}
+		
+		bool merged = true;
+		while( merged ) {
+			merged = false;
+			for( unsigned int a = 0; a < _rois.size() && !merged; a++ ) {
+				for( unsigned int b = a + 1; b < _rois.size() && !merged; b++ ) {
+					if( ( _rois[a] & _rois[b] ).area() > 0 ) {
+						_rois[a] |= _rois[b];
+						_rois.erase( _rois.begin() + b );
+						merged = true;
+					}
+				}
+			}
+		}
+	}
+	
+	void MarkerDetector::updateTracks( const vector< vector< cv::Point2f > > &corners, const vector< int > &ids ) {
+		// updated in place, so only a newly seen marker allocates
+		for( map< int, TrackedMarker >::iterator iter = _tracked.begin(); iter != _tracked.end(); ++iter )
+			iter->second.seen = false;
+		
+		for( unsigned int i = 0; i < ids.size(); i++ ) {
+			map< int, TrackedMarker >::iterator previous = _tracked.find( ids[i] );
+			if( previous == _tracked.end() ) {
+				TrackedMarker &marker = _tracked[ ids[i] ];
+				marker.corners = corners[i];
+				marker.velocity = cv::Point2f( 0, 0 );
+				marker.seen = true;
+				continue;
+			}
+			
+			TrackedMarker &marker = previous->second;
+			marker.velocity = cv::Point2f( 0, 0 );
+			for( unsigned int c = 0; c < 4; c++ )
+				marker.velocity += corners[i][c] - marker.corners[c];
+			marker.velocity *= 0.25f;
+			marker.corners.assign( corners[i].begin(), corners[i].end() );
+			marker.seen = true;
+		}
+		
+		for( map< int, TrackedMarker >::iterator iter = _tracked.begin(); iter != _tracked.end(); ) {
+			if( !iter->second.seen )
+				_tracked.erase( iter++ );
+			else
+				++iter;
+		}
+	}
+	
+	void MarkerDetector::printStats() {
+		unsigned long numRoi = _numRoi;
+		printf( "[detector]: full-frame passes %lu  roi passes %lu (mean area %.0f%%)  roi misses %lu\n",
+				(unsigned long)_numFullFrame, numRoi, numRoi > 0 ? _roiAreaFraction / numRoi * 100.0 : 0.0, (unsigned long)_numMisses );
+		
+		unsigned long numCompared = _numCompared;
+		unsigned long numComparedMarkers = _numComparedMarkers;
+		if( numCompared > 0 ) {
+			printf( "[pyramid]: scale 1/%.0f  %.2fms vs %.2fms full resolution  corner error %.2fpx over %lu markers  missed %lu\n",
+					1.0 / getPyramidScale(),
+					_pyramidSeconds / numCompared * 1000.0, _fullResSeconds / numCompared * 1000.0,
+					numComparedMarkers > 0 ? _cornerError / numComparedMarkers : 0.0, numComparedMarkers,
+					(unsigned long)_numComparedMissed );
+		}
+		
+		unsigned long numTracked = _numTracked;
+		unsigned long numDetections = _numDetections;
+		if( _flowTracking ) {
+			printf( "[flow]: tracked %lu (%.2fms, worst error %.2fpx)  detected %lu (%.2fms)  tracking lost %lu (%lu wrong id)\n",
+					numTracked, numTracked > 0 ? _trackingSeconds / numTracked * 1000.0 : 0.0,
+					numTracked > 0 ? _trackingError / numTracked : 0.0,
+					numDetections, numDetections > 0 ? _detectionSeconds / numDetections * 1000.0 : 0.0,
+					(unsigned long)_numTrackingLost, (unsigned long)_numIdMismatches );
+		}
+		resetStats();
+	}
+	
+	void MarkerDetector::resetStats() {
+		_numFullFrame = 0;
+		_numRoi = 0;
+		_numMisses = 0;
+		_roiAreaFraction = 0;
+		_numCompared = 0;
+		_numComparedMarkers = 0;
+		_numComparedMissed = 0;
+		_pyramidSeconds = 0;
+		_fullResSeconds = 0;
+		_cornerError = 0;
+		_numTracked = 0;
+		_numTrackingLost = 0;
+		_numIdMismatches = 0;
+		_numDetections = 0;
+		_trackingSeconds = 0;
+		_detectionSeconds = 0;
+		_trackingError = 0;
+	}
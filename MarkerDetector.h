@@ -0,0 +1,143 @@
+#ifndef _MARKER_DETECTOR_H_
+#define _MARKER_DETECTOR_H_ 1
+
+#include <opencv2/aruco.hpp>
+#include <opencv2/core.hpp>
+
+#include "MarkerCodeTable.h"
+
+#include <atomic>
+#include <map>
+#include <vector>
+using namespace std;
+
+
+
+	/* finds markers in a frame; with ROI tracking enabled it searches only */
+	/* windows around where each marker is predicted to be, falling back to */
+	/* the whole frame periodically and whenever a tracked marker is lost; */
+	/* in pyramid mode candidates are found on a downscaled copy and their */
+	/* corners refined on the full resolution image; with flow tracking the */
+	/* corners are followed by optical flow between full detections, each */
+	/* tracked marker's bits read back and looked up to confirm its id */
+	class MarkerDetector {
+	public:
+		MarkerDetector();
+		
+		void setDictionary( cv::Ptr< cv::aruco::Dictionary > dictionary, cv::Ptr< cv::aruco::DetectorParameters > detectorParams );
+		
+		/* fullFrameInterval: frames between forced full-frame passes */
+		/* margin: how far each window extends past the predicted marker, */
+		/* as a fraction of the marker's size */
+		void setRoiTracking( bool enabled, unsigned int fullFrameInterval = 15, float margin = 0.5f );
+		
+		/* minMarkerSide: the smallest marker that must still be found, in */
+		/* full resolution pixels; the image is halved for as long as such */
+		/* a marker stays large enough to decode */
+		/* compareInterval: every so many frames also detect at full */
+		/* resolution and report the speed and corner error (0 disables) */
+		void setPyramid( bool enabled, float minMarkerSide = 48.0f, unsigned int compareInterval = 0 );
+		float getPyramidScale();
+		
+		/* never detect above this scale, pyramid or not; may be changed */
+		/* from another thread while detecting (the quality governor does) */
+		void setMaxScale( float maxScale );
+		
+		/* detectionInterval: frames between detections while tracking holds */
+		/* maxTrackingError: largest forward-backward flow error, in pixels, */
+		/* before tracking is abandoned for a detection */
+		void setFlowTracking( bool enabled, unsigned int detectionInterval = 10, float maxTrackingError = 1.0f );
+		
+		void detect( const cv::Mat &image, vector< vector< cv::Point2f > > &corners, vector< int > &ids );
+		
+		/* candidates the last detect() rejected, in full-frame coordinates; */
+		/* empty after a tracked frame */
+		const vector< vector< cv::Point2f > >& getRejected();
+		
+		void printStats();
+		void resetStats();
+		
+	private:
+		struct TrackedMarker {
+			vector< cv::Point2f > corners;
+			cv::Point2f velocity;			// pixels per frame, from the last two sightings
+			bool seen;
+		};
+		
+		cv::Ptr< cv::aruco::Dictionary > _dictionary;
+		cv::Ptr< cv::aruco::DetectorParameters > _detectorParams;
+		
+		bool _roiTracking;
+		unsigned int _fullFrameInterval;
+		float _roiMargin;
+		
+		bool _pyramid;
+		float _minMarkerSide;
+		unsigned int _compareInterval;
+		std::atomic< float > _maxScale;
+		
+		bool _flowTracking;
+		unsigned int _flowDetectionInterval;
+		float _maxTrackingError;
+		unsigned int _framesSinceDetection;
+		vector< cv::Mat > _flowPyramid;
+		vector< cv::Mat > _previousFlowPyramid;
+		vector< int > _flowIds;
+		vector< cv::Point2f > _flowPoints;
+		vector< cv::Point2f > _flowForward;
+		vector< cv::Point2f > _flowBackward;
+		vector< unsigned char > _flowStatus;
+		vector< unsigned char > _flowBackStatus;
+		vector< float > _flowError;
+		cv::Ptr< MarkerCodes > _codes;		// built on the first tracked frame
+		cv::Mat _codeBits;
+		cv::Mat _codeScratch;
+		
+		map< int, TrackedMarker > _tracked;
+		unsigned int _framesSinceFullFrame;
+		
+		cv::Mat _gray;
+		cv::Mat _small;
+		vector< cv::Rect > _rois;
+		vector< vector< cv::Point2f > > _roiCorners;
+		vector< int > _roiIds;
+		vector< vector< cv::Point2f > > _rejected;
+		vector< vector< cv::Point2f > > _candidateRejected;
+		
+		// read by printStats() from the render thread
+		std::atomic< unsigned long > _numFullFrame;
+		std::atomic< unsigned long > _numRoi;
+		std::atomic< unsigned long > _numMisses;
+		std::atomic< double > _roiAreaFraction;
+		
+		unsigned long _framesSinceCompare;
+		vector< vector< cv::Point2f > > _compareCorners;
+		vector< int > _compareIds;
+		std::atomic< unsigned long > _numCompared;
+		std::atomic< unsigned long > _numComparedMarkers;
+		std::atomic< unsigned long > _numComparedMissed;
+		std::atomic< double > _pyramidSeconds;
+		std::atomic< double > _fullResSeconds;
+		std::atomic< double > _cornerError;
+		
+		std::atomic< unsigned long > _numTracked;
+		std::atomic< unsigned long > _numTrackingLost;
+		std::atomic< unsigned long > _numIdMismatches;
+		std::atomic< unsigned long > _numDetections;
+		std::atomic< double > _trackingSeconds;
+		std::atomic< double > _detectionSeconds;
+		std::atomic< double > _trackingError;
+		
+		void detectMarkers( vector< vector< cv::Point2f > > &corners, vector< int > &ids );
+		bool trackCorners( vector< vector< cv::Point2f > > &corners, vector< int > &ids );
+		bool verifyIds( const vector< vector< cv::Point2f > > &corners, const vector< int > &ids );
+		void detectFullFrame( vector< vector< cv::Point2f > > &corners, vector< int > &ids );
+		bool detectInRois( vector< vector< cv::Point2f > > &corners, vector< int > &ids );
+		void detectCandidates( const cv::Mat &gray, vector< vector< cv::Point2f > > &corners, vector< int > &ids );
+		void compareFullResolution( const vector< vector< cv::Point2f > > &corners, const vector< int > &ids, double pyramidSeconds );
+		void predictRois( const cv::Size &imageSize );
+		void updateTracks( const vector< vector< cv::Point2f > > &corners, const vector< int > &ids );
+	};
+
+
+#endif
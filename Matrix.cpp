@@ -1,5 +1,6 @@
 #include "Matrix.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <sstream>
 
@@ -18,15 +19,21 @@
 		setupMatrix( rows, cols );
 	}
 	
+	Matrix::Matrix( const Mat4 &m ) {
+		_rows = 4;
+		_cols = 4;
+		_data.assign( m.data(), m.data() + 16 );
+	}
+	
 	void Matrix::setupMatrix( unsigned int rows, unsigned int cols ) {
 		_rows = rows;
 		_cols = cols;
-
-		for( unsigned int r = 0; r < getNumRows(); r++ ) {
-			for( unsigned int c = 0; c < getNumCols(); c++ ) {
-				_data.push_back(0.0);
-			}
-		}
+		_data.assign( rows * cols, 0.0 );
+	}
+	
+	Mat4 Matrix::toMat4() const {
+		assert( _rows == 4 && _cols == 4 );
+		return Mat4( &_data[0] );
 	}
 	
 	Matrix Matrix::eye() {
@@ -36,16 +43,16 @@
 		return m;
 	}
 		
-	double Matrix::get( unsigned int row, unsigned int col ) {
-		return _data[ col*getNumCols() + row ];
+	double Matrix::get( unsigned int row, unsigned int col ) const {
+		return _data[ col*_rows + row ];
 	}
 	
 	void Matrix::set( unsigned int row, unsigned int col, double val ) {
-		_data[ col*getNumCols()+ row ] = val;
+		_data[ col*_rows + row ] = val;
 	}
 	
-	unsigned int Matrix::getNumRows() { return _rows; }
-	unsigned int Matrix::getNumCols() { return _cols; }
+	unsigned int Matrix::getNumRows() const { return _rows; }
+	unsigned int Matrix::getNumCols() const { return _cols; }
 	
 	void Matrix::makeRotation( double theta, double x, double y, double z ) {
 		double c = cos( theta );
@@ -83,35 +90,176 @@
 	}
 	
 	void Matrix::transpose() {
-		for( unsigned int r = 0; r < getNumRows(); r++ ) {
-			for( unsigned int c = 0; c < getNumCols(); c++ ) {
-				double temp = get(r,c);
-				set( r, c, get(c,r) );
-				set( c, r, temp );
+		std::vector<double> transposed( _data.size() );
+		for( unsigned int r = 0; r < _rows; r++ )
+			for( unsigned int c = 0; c < _cols; c++ )
+				transposed[ r*_cols + c ] = get( r, c );
+		_data.swap( transposed );
+		std::swap( _rows, _cols );
+	}
+	
+	// panels of this many columns once the matrix is larger than two of them
+	static const unsigned int LU_BLOCK = 32;
+	
+	template< int N >
+	static FixedMatrix< double, N, N > toFixed( const Matrix &m ) {
+		FixedMatrix< double, N, N > f;
+		for( int r = 0; r < N; r++ )
+			for( int c = 0; c < N; c++ )
+				f( r, c ) = m.get( r, c );
+		return f;
+	}
+	
+	/*
+	 * In place LU of the n x n row-major matrix a, with partial pivoting:
+	 * afterwards a holds the unit lower L below the diagonal and U on and
+	 * above it, row k having been swapped with pivots[k].  Large matrices
+	 * are factored a panel of LU_BLOCK columns at a time, so the trailing
+	 * update, nearly all the work, streams through rows the cache holds.
+	 * False if a zero pivot makes the matrix singular.
+	 */
+	static bool decomposeLU( std::vector<double> &a, unsigned int n, std::vector<unsigned int> &pivots, int &sign ) {
+		pivots.resize( n );
+		sign = 1;
+		unsigned int block = n > 2 * LU_BLOCK ? LU_BLOCK : n;
+		
+		for( unsigned int k0 = 0; k0 < n; k0 += block ) {
+			unsigned int k1 = std::min( n, k0 + block );
+			
+			// factor the panel, swapping whole rows
+			for( unsigned int k = k0; k < k1; k++ ) {
+				unsigned int pivot = k;
+				for( unsigned int i = k + 1; i < n; i++ )
+					if( fabs( a[ i*n + k ] ) > fabs( a[ pivot*n + k ] ) )
+						pivot = i;
+				if( a[ pivot*n + k ] == 0.0 )
+					return false;
+				pivots[k] = pivot;
+				if( pivot != k ) {
+					std::swap_ranges( a.begin() + k*n, a.begin() + (k+1)*n, a.begin() + pivot*n );
+					sign = -sign;
+				}
+				double inverse = 1.0 / a[ k*n + k ];
+				for( unsigned int i = k + 1; i < n; i++ ) {
+					double l = a[ i*n + k ] *= inverse;
+					for( unsigned int j = k + 1; j < k1; j++ )
+						a[ i*n + j ] -= l * a[ k*n + j ];
+				}
 			}
+			if( k1 == n )
+				break;
+			
+			// the panel's rows of U right of it
+			for( unsigned int k = k0; k < k1; k++ )
+				for( unsigned int i = k + 1; i < k1; i++ ) {
+					double l = a[ i*n + k ];
+					for( unsigned int j = k1; j < n; j++ )
+						a[ i*n + j ] -= l * a[ k*n + j ];
+				}
+			
+			// and the trailing matrix, less L21 * U12
+			for( unsigned int i = k1; i < n; i++ )
+				for( unsigned int k = k0; k < k1; k++ ) {
+					double l = a[ i*n + k ];
+					for( unsigned int j = k1; j < n; j++ )
+						a[ i*n + j ] -= l * a[ k*n + j ];
+				}
 		}
+		return true;
 	}
 	
-	double Matrix::determinate() {
-		double det = 0;
+	double Matrix::determinate() const {
+		if( _rows != _cols )
+			return 0;
+		switch( _rows ) {
+			case 1: return get( 0, 0 );
+			case 2: return get( 0, 0 ) * get( 1, 1 ) - get( 0, 1 ) * get( 1, 0 );
+			case 3: return determinant( toFixed< 3 >( *this ) );
+			case 4: return determinant( toFixed< 4 >( *this ) );
+		}
 		
-		for( unsigned int c = 0; c < getNumCols(); c++ ) {
-			double diag = 1;
-			for( unsigned int r = 0; r < getNumRows(); r++ ) {
-				diag *= get( r, (c+r)%getNumCols() );
-			}
-			det += diag;
+		unsigned int n = _rows;
+		std::vector<double> lu( n * n );
+		for( unsigned int r = 0; r < n; r++ )
+			for( unsigned int c = 0; c < n; c++ )
+				lu[ r*n + c ] = get( r, c );
+		std::vector<unsigned int> pivots;
+		int sign;
+		if( !decomposeLU( lu, n, pivots, sign ) )
+			return 0;
+		double det = sign;
+		for( unsigned int i = 0; i < n; i++ )
+			det *= lu[ i*n + i ];
+		return det;
+	}
+	
+	bool Matrix::inverse( Matrix &result ) const {
+		if( _rows != _cols )
+			return false;
+		if( _rows == 3 ) {
+			Mat3 inverse;
+			if( !invert( toFixed< 3 >( *this ), inverse ) )
+				return false;
+			result = Matrix( 3, 3 );
+			for( unsigned int r = 0; r < 3; r++ )
+				for( unsigned int c = 0; c < 3; c++ )
+					result.set( r, c, inverse( r, c ) );
+			return true;
+		}
+		if( _rows == 4 ) {
+			Mat4 inverse;
+			if( !invert( toMat4(), inverse ) )
+				return false;
+			result = Matrix( inverse );
+			return true;
 		}
 		
-		for( int c = getNumCols()-1; c >= 0; c-- ) {
-			double diag = 1;
-			for( unsigned int r = 0; r < getNumRows(); r++ ) {
-				diag *= get( r, (c-r)%getNumCols() );
+		Matrix identity( _rows, _rows );
+		for( unsigned int i = 0; i < _rows; i++ )
+			identity.set( i, i, 1 );
+		return solve( identity, result );
+	}
+	
+	/*
+	 * Factor once, then per column of b: apply the row swaps, substitute
+	 * forward through L and back through U.
+	 */
+	bool Matrix::solve( const Matrix &b, Matrix &x ) const {
+		assert( _rows == _cols && b.getNumRows() == _rows );
+		unsigned int n = _rows;
+		std::vector<double> lu( n * n );
+		for( unsigned int r = 0; r < n; r++ )
+			for( unsigned int c = 0; c < n; c++ )
+				lu[ r*n + c ] = get( r, c );
+		std::vector<unsigned int> pivots;
+		int sign;
+		if( !decomposeLU( lu, n, pivots, sign ) )
+			return false;
+		
+		Matrix solution( n, b.getNumCols() );
+		std::vector<double> y( n );
+		for( unsigned int col = 0; col < b.getNumCols(); col++ ) {
+			for( unsigned int i = 0; i < n; i++ )
+				y[i] = b.get( i, col );
+			for( unsigned int i = 0; i < n; i++ )
+				std::swap( y[i], y[ pivots[i] ] );
+			for( unsigned int i = 0; i < n; i++ )
+				for( unsigned int k = 0; k < i; k++ )
+					y[i] -= lu[ i*n + k ] * y[k];
+			for( int i = n - 1; i >= 0; i-- ) {
+				for( unsigned int k = i + 1; k < n; k++ )
+					y[i] -= lu[ i*n + k ] * y[k];
+				y[i] /= lu[ i*n + i ];
 			}
-			det -= diag;
+			for( unsigned int i = 0; i < n; i++ )
+				solution.set( i, col, y[i] );
 		}
-		
-		return det;
+		x = solution;
+		return true;
+	}
+	
+	Matrix Matrix::rigidInverse() const {
+		return Matrix( invertRigid( toMat4() ) );
 	}
 	
 	double* Matrix::asArray() {
@@ -138,7 +286,7 @@
 		return ss.str().c_str();
 	}
 	
-	Matrix operator*(float f, Matrix a) {
+	Matrix operator*(float f, const Matrix &a) {
 		Matrix m( a.getNumRows(), a.getNumCols() );
 		for( unsigned int r = 0; r < a.getNumRows(); r++ ) {
 			for( unsigned int c = 0; c < a.getNumCols(); c++ ) {
@@ -148,12 +296,15 @@
 		return m;
 	}
 	
-	Matrix operator*(Matrix a, float f) {
+	Matrix operator*(const Matrix &a, float f) {
 		return f*a;
 	}
 	
-	Matrix operator*(Matrix a, Matrix b) {
+	Matrix operator*(const Matrix &a, const Matrix &b) {
 		assert( a.getNumCols() == b.getNumRows() );
+		if( a.getNumRows() == 4 && a.getNumCols() == 4 && b.getNumCols() == 4 )
+			return Matrix( a.toMat4() * b.toMat4() );
+		
 		Matrix m( a.getNumRows(), b.getNumCols() );
 		for( unsigned int r = 0; r < a.getNumRows(); r++ ) {
 			for( unsigned int c = 0; c < b.getNumCols(); c++ ) {
@@ -167,7 +318,7 @@
 		return m;
 	}
 	
-	Matrix operator+(Matrix a, Matrix b) {
+	Matrix operator+(const Matrix &a, const Matrix &b) {
 		assert( a.getNumRows() == b.getNumRows() && a.getNumCols() == b.getNumCols() );
 		Matrix m( a.getNumRows(), a.getNumCols() );
 		for( unsigned int r = 0; r < a.getNumRows(); r++ ) {
@@ -1,32 +1,53 @@
 #ifndef _MATRIX_H_
 #define _MATRIX_H_ 1
 
+#include "FixedMatrix.h"
+
 #include <vector>
 
 
 
+	/* any size, chosen at run time; 4x4 arithmetic is handed to Mat4, */
+	/* which new code should use directly */
 	class Matrix {
 	public:
 		
 		Matrix();
 		Matrix( unsigned int rows, unsigned int cols );
+		Matrix( const Mat4 &m );
 		
 		Matrix eye();
 		
-		double get( unsigned int row, unsigned int col );
+		double get( unsigned int row, unsigned int col ) const;
 		void set( unsigned int row, unsigned int col, double val );
 		
-		unsigned int getNumRows();
-		unsigned int getNumCols();
+		unsigned int getNumRows() const;
+		unsigned int getNumCols() const;
+		
+		/* must be 4x4 */
+		Mat4 toMat4() const;
 		
 		void makeRotation( double theta, double x, double y, double z );
 		void makeTranslation( double x, double y, double z );
 		
 		Matrix getSubMatrix( unsigned int rows, unsigned int cols );
 		
+		/* swaps rows and columns in place; the shape swaps too */
 		void transpose();
 		
-		double determinate();
+		/* closed form up to 4x4, LU with partial pivoting beyond; */
+		/* 0 for a singular or non-square matrix */
+		double determinate() const;
+		
+		/* false, result untouched, for a singular or non-square matrix */
+		bool inverse( Matrix &result ) const;
+		
+		/* x such that this * x = b, a column of x for each column of b; */
+		/* false if this is singular */
+		bool solve( const Matrix &b, Matrix &x ) const;
+		
+		/* only for a 4x4 rotation plus translation: [ R^T  -R^T t ] */
+		Matrix rigidInverse() const;
 				
 		double* asArray();
 		
@@ -40,10 +61,10 @@
 		void setupMatrix( unsigned int rows, unsigned int cols );
 	};
 
-	Matrix operator*(float f, Matrix a);
-	Matrix operator*(Matrix a, float f);
-	Matrix operator*(Matrix a, Matrix b);
-	Matrix operator+(Matrix a, Matrix b);	
+	Matrix operator*(float f, const Matrix &a);
+	Matrix operator*(const Matrix &a, float f);
+	Matrix operator*(const Matrix &a, const Matrix &b);
+	Matrix operator+(const Matrix &a, const Matrix &b);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,170 @@
+/*
+ * matrixBench: times a chain of dependent 4x4 products through each of
+ * the matrix types, and checks the SIMD products against the scalar one.
+ *
+ *   matrixBench [products]
+ *
+ * Compares, per product:
+ *   legacy   Matrix as it was before Mat4: arguments copied, storage
+ *            grown a push_back at a time
+ *   Matrix   the run time sized class, which hands 4x4 products to Mat4
+ *   scalar   the generic multiply template every size uses
+ *   Mat4     doubles, SSE2 (AVX with USING_AVX=1)
+ *   Mat4f    floats, SSE2
+ * Build once as is and once with USING_AVX=1 to compare the two paths;
+ * the header line says which one this binary uses.  The Makefile builds
+ * without optimisation, so pass CFLAGS with -O2 for representative times.
+ * Exits 1 if a SIMD product disagrees with the scalar one.
+ */
+
+#include "Matrix.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+using namespace std;
+
+
+/* the pre-Mat4 Matrix, kept here only as the baseline to beat */
+class LegacyMatrix {
+public:
+	LegacyMatrix( unsigned int rows, unsigned int cols ) : _rows( rows ), _cols( cols ) {
+		for( unsigned int i = 0; i < rows * cols; i++ )
+			_data.push_back( 0.0 );
+	}
+	double get( unsigned int row, unsigned int col ) { return _data[ col*_rows + row ]; }
+	void set( unsigned int row, unsigned int col, double val ) { _data[ col*_rows + row ] = val; }
+	unsigned int getNumRows() { return _rows; }
+	unsigned int getNumCols() { return _cols; }
+private:
+	vector< double > _data;
+	unsigned int _rows, _cols;
+};
+
+static LegacyMatrix operator*( LegacyMatrix a, LegacyMatrix b ) {
+	LegacyMatrix m( a.getNumRows(), b.getNumCols() );
+	for( unsigned int r = 0; r < a.getNumRows(); r++ )
+		for( unsigned int c = 0; c < b.getNumCols(); c++ ) {
+			double sum = 0;
+			for( unsigned int i = 0; i < b.getNumRows(); i++ )
+				sum += a.get( r, i ) * b.get( i, c );
+			m.set( r, c, sum );
+		}
+	return m;
+}
+
+static double now() {
+	return chrono::duration< double >( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static const char* simdPath() {
+#if defined(__AVX__)
+	return "AVX";
+#elif defined(__SSE2__)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+/* each product feeds the next, reset every few so the values stay finite */
+static const int RESET_EVERY = 8;
+
+int main( int argc, char* argv[] ) {
+	long products = argc > 1 ? atol( argv[1] ) : 2000000;
+	if( products <= 0 ) {
+		fprintf( stderr, "usage: %s [products]\n", argv[0] );
+		return 1;
+	}
+
+	srand( 441 );
+	Mat4 a;
+	Mat4f af;
+	for( int i = 0; i < 16; i++ ) {
+		a.data()[i] = rand() / (double)RAND_MAX - 0.5;
+		af.data()[i] = (float)a.data()[i];
+	}
+
+	// the SIMD products against the generic template
+	Mat4 scalar, simd;
+	multiply< double, 4, 4, 4 >( a, a, scalar );
+	multiply( a, a, simd );
+	Mat4f simdf = af * af;
+	double error = 0, errorf = 0;
+	for( int i = 0; i < 16; i++ ) {
+		error = fmax( error, fabs( simd.data()[i] - scalar.data()[i] ) );
+		errorf = fmax( errorf, fabs( simdf.data()[i] - scalar.data()[i] ) );
+	}
+	printf( "[matrixBench]: %s products, %ld each; worst difference from scalar %g (double) %g (float)\n",
+			simdPath(), products, error, errorf );
+	if( error > 1e-12 || errorf > 1e-5 ) {
+		fprintf( stderr, "[matrixBench]: SIMD product disagrees with the scalar one\n" );
+		return 1;
+	}
+
+	// the slow ones get a tenth of the products
+	long slowProducts = products / 10 > 0 ? products / 10 : 1;
+	double sum = 0;
+
+	LegacyMatrix legacy( 4, 4 ), legacyIdentity( 4, 4 ), legacyStep( 4, 4 );
+	for( int r = 0; r < 4; r++ )
+		for( int c = 0; c < 4; c++ ) {
+			legacyIdentity.set( r, c, r == c ? 1 : 0 );
+			legacyStep.set( r, c, a( r, c ) );
+		}
+	double start = now();
+	for( long i = 0; i < slowProducts; i++ ) {
+		if( i % RESET_EVERY == 0 )
+			legacy = legacyIdentity;
+		legacy = legacy * legacyStep;
+	}
+	double legacySeconds = now() - start;
+	sum += legacy.get( 0, 0 );
+
+	Matrix matrix, matrixIdentity( Mat4::identity() ), matrixStep( a );
+	start = now();
+	for( long i = 0; i < slowProducts; i++ ) {
+		if( i % RESET_EVERY == 0 )
+			matrix = matrixIdentity;
+		matrix = matrix * matrixStep;
+	}
+	double matrixSeconds = now() - start;
+	sum += matrix.get( 0, 0 );
+
+	Mat4 chain, next;
+	start = now();
+	for( long i = 0; i < products; i++ ) {
+		if( i % RESET_EVERY == 0 )
+			chain = Mat4::identity();
+		multiply< double, 4, 4, 4 >( chain, a, next );
+		chain = next;
+	}
+	double scalarSeconds = now() - start;
+	sum += chain( 0, 0 );
+
+	start = now();
+	for( long i = 0; i < products; i++ ) {
+		if( i % RESET_EVERY == 0 )
+			chain = Mat4::identity();
+		chain = chain * a;
+	}
+	double mat4Seconds = now() - start;
+	sum += chain( 0, 0 );
+
+	Mat4f chainf;
+	start = now();
+	for( long i = 0; i < products; i++ ) {
+		if( i % RESET_EVERY == 0 )
+			chainf = Mat4f::identity();
+		chainf = chainf * af;
+	}
+	double mat4fSeconds = now() - start;
+	sum += chainf( 0, 0 );
+
+	printf( "[matrixBench]: ns per product: legacy %.1f  Matrix %.1f  scalar %.1f  Mat4 %.1f  Mat4f %.1f  (%g)\n",
+			legacySeconds / slowProducts * 1e9, matrixSeconds / slowProducts * 1e9,
+			scalarSeconds / products * 1e9, mat4Seconds / products * 1e9, mat4fSeconds / products * 1e9, sum );
+	return 0;
+}
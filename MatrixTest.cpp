@@ -0,0 +1,199 @@
+/*
+ * matrixTest: checks Matrix's determinant, inverse and solve without a
+ * window or a camera, and times them.
+ *
+ *   matrixTest
+ *
+ * Every size from 1 to 150 is checked, which covers the closed forms (up
+ * to 4x4), the single panel LU and the blocked LU (above 2 * LU_BLOCK):
+ *   A * A^-1 = I, det(A^T) = det(A), and det(A) det(A^-1) = 1
+ * then singular matrices, a non-square transpose and rigidInverse.
+ *
+ * The timings compare solve against textbook Gaussian elimination with
+ * partial pivoting, one row at a time over the whole trailing matrix, as
+ * Matrix had no solver of its own before LU; and against multiplying b by
+ * the inverse.  Exits 1 if any check fails.
+ */
+
+#include "Matrix.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+using namespace std;
+
+
+static int failures = 0;
+
+static void check( bool passed, const char *what, unsigned int n ) {
+	if( !passed ) {
+		fprintf( stderr, "[matrixTest]: FAILED %s (n = %u)\n", what, n );
+		failures++;
+	}
+}
+
+static double now() {
+	return chrono::duration< double >( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+/* entries uniform in [-1, 1] */
+static Matrix randomMatrix( unsigned int rows, unsigned int cols ) {
+	Matrix m( rows, cols );
+	for( unsigned int r = 0; r < rows; r++ )
+		for( unsigned int c = 0; c < cols; c++ )
+			m.set( r, c, rand() / (double)RAND_MAX * 2.0 - 1.0 );
+	return m;
+}
+
+static double distanceFromIdentity( const Matrix &m ) {
+	double worst = 0;
+	for( unsigned int r = 0; r < m.getNumRows(); r++ )
+		for( unsigned int c = 0; c < m.getNumCols(); c++ )
+			worst = fmax( worst, fabs( m.get( r, c ) - ( r == c ? 1.0 : 0.0 ) ) );
+	return worst;
+}
+
+/* the unblocked elimination LU replaced, for a single right hand side */
+static bool solveByElimination( const Matrix &a, const vector< double > &b, vector< double > &x ) {
+	unsigned int n = a.getNumRows();
+	vector< double > m( n * n );
+	for( unsigned int r = 0; r < n; r++ )
+		for( unsigned int c = 0; c < n; c++ )
+			m[ r*n + c ] = a.get( r, c );
+	x = b;
+	for( unsigned int k = 0; k < n; k++ ) {
+		unsigned int pivot = k;
+		for( unsigned int i = k + 1; i < n; i++ )
+			if( fabs( m[ i*n + k ] ) > fabs( m[ pivot*n + k ] ) )
+				pivot = i;
+		if( m[ pivot*n + k ] == 0.0 )
+			return false;
+		for( unsigned int j = 0; j < n; j++ )
+			swap( m[ k*n + j ], m[ pivot*n + j ] );
+		swap( x[k], x[pivot] );
+		for( unsigned int i = k + 1; i < n; i++ ) {
+			double l = m[ i*n + k ] / m[ k*n + k ];
+			for( unsigned int j = k; j < n; j++ )
+				m[ i*n + j ] -= l * m[ k*n + j ];
+			x[i] -= l * x[k];
+		}
+	}
+	for( int i = n - 1; i >= 0; i-- ) {
+		for( unsigned int j = i + 1; j < n; j++ )
+			x[i] -= m[ i*n + j ] * x[j];
+		x[i] /= m[ i*n + i ];
+	}
+	return true;
+}
+
+static void checkSize( unsigned int n ) {
+	Matrix a = randomMatrix( n, n );
+	Matrix inverse;
+	check( a.inverse( inverse ), "inverse of a random matrix", n );
+	check( distanceFromIdentity( a * inverse ) < 1e-9 * n, "A * A^-1 = I", n );
+
+	Matrix transposed = a;
+	transposed.transpose();
+	double det = a.determinate();
+	check( fabs( transposed.determinate() - det ) <= 1e-10 * fabs( det ), "det(A^T) = det(A)", n );
+	check( fabs( det * inverse.determinate() - 1.0 ) < 1e-8, "det(A) det(A^-1) = 1", n );
+
+	// a zero column leaves an exactly zero pivot at every size
+	Matrix singular = a;
+	for( unsigned int r = 0; r < n; r++ )
+		singular.set( r, n / 2, 0.0 );
+	Matrix untouched;
+	check( singular.determinate() == 0.0, "singular determinant is 0", n );
+	check( !singular.inverse( untouched ), "singular inverse is refused", n );
+	check( !singular.solve( Matrix( n, 1 ), untouched ), "singular solve is refused", n );
+}
+
+static void checkTranspose() {
+	Matrix m = randomMatrix( 2, 3 );
+	Matrix t = m;
+	t.transpose();
+	check( t.getNumRows() == 3 && t.getNumCols() == 2, "2x3 transposes to 3x2", 2 );
+	bool same = true;
+	for( unsigned int r = 0; r < 2; r++ )
+		for( unsigned int c = 0; c < 3; c++ )
+			same = same && t.get( c, r ) == m.get( r, c );
+	check( same, "transposed entries", 2 );
+	t.transpose();
+	check( t.getNumRows() == 2 && t.getNumCols() == 3, "transposing twice restores the shape", 2 );
+}
+
+static void checkRigidInverse() {
+	Matrix rotation, translation;
+	double x = 0.36, y = 0.48, z = 0.8;			// unit axis
+	rotation.makeRotation( 1.1, x, y, z );
+	translation.makeTranslation( 0.3, -2.0, 5.5 );
+	for( unsigned int i = 0; i < 3; i++ )
+		translation.set( i, i, 1 );
+	Matrix pose = translation * rotation;
+
+	Matrix rigid = pose.rigidInverse(), general;
+	check( distanceFromIdentity( pose * rigid ) < 1e-12, "pose * rigidInverse = I", 4 );
+	check( pose.inverse( general ), "inverse of a pose", 4 );
+	double worst = 0;
+	for( unsigned int r = 0; r < 4; r++ )
+		for( unsigned int c = 0; c < 4; c++ )
+			worst = fmax( worst, fabs( rigid.get( r, c ) - general.get( r, c ) ) );
+	check( worst < 1e-12, "rigidInverse matches inverse", 4 );
+}
+
+static void timeSolve( unsigned int n ) {
+	Matrix a = randomMatrix( n, n );
+	Matrix b = randomMatrix( n, 1 );
+	vector< double > column( n ), reference;
+	for( unsigned int i = 0; i < n; i++ )
+		column[i] = b.get( i, 0 );
+
+	unsigned int repeats = 2000000 / ( n * n * n ) + 1;
+	Matrix x, inverse;
+	double start = now();
+	for( unsigned int i = 0; i < repeats; i++ )
+		a.solve( b, x );
+	double luSeconds = ( now() - start ) / repeats;
+
+	start = now();
+	for( unsigned int i = 0; i < repeats; i++ )
+		solveByElimination( a, column, reference );
+	double eliminationSeconds = ( now() - start ) / repeats;
+
+	start = now();
+	for( unsigned int i = 0; i < repeats; i++ ) {
+		a.inverse( inverse );
+		x = inverse * b;
+	}
+	double inverseSeconds = ( now() - start ) / repeats;
+
+	a.solve( b, x );
+	double worst = 0;
+	for( unsigned int i = 0; i < n; i++ )
+		worst = fmax( worst, fabs( x.get( i, 0 ) - reference[i] ) );
+	check( worst < 1e-8, "solve matches elimination", n );
+
+	printf( "[matrixTest]: n = %3u  solve %9.1f us  elimination %9.1f us  inverse * b %9.1f us\n",
+			n, luSeconds * 1e6, eliminationSeconds * 1e6, inverseSeconds * 1e6 );
+}
+
+int main( int argc, char* argv[] ) {
+	srand( 441 );
+	for( unsigned int n = 1; n <= 150; n++ )
+		checkSize( n );
+	checkTranspose();
+	checkRigidInverse();
+
+	unsigned int timedSizes[] = { 4, 10, 32, 64, 65, 100, 150, 300 };
+	for( unsigned int i = 0; i < sizeof( timedSizes ) / sizeof( timedSizes[0] ); i++ )
+		timeSolve( timedSizes[i] );
+
+	if( failures > 0 ) {
+		fprintf( stderr, "[matrixTest]: %d checks failed\n", failures );
+		return 1;
+	}
+	printf( "[matrixTest]: all checks passed\n" );
+	return 0;
+}
@@ -6,8 +6,11 @@
 #include "Point.h"
 #include "Vector.h"
 
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <unordered_map>
 using namespace std;
 
 #include <stdlib.h>
@@ -23,14 +26,17 @@ using namespace std;
 		init();
 	}
 
-	Object::Object( string filename ) : _objFile( filename ) {
+	Object::Object( string filename, bool useTextureAtlas, TextureCache *textureCache ) : _objFile( filename ) {
 		init();
+		_useTextureAtlas = useTextureAtlas;
+		_textureCache = textureCache;
 		loadObjectFile( filename );
 	}
 
 	Object::~Object() {
 		delete _materials;
 		delete _textureHandles;
+		delete _atlas;
 	}
 
 	bool Object::loadObjectFile( string filename, bool INFO, bool ERRORS ) {
@@ -63,6 +69,43 @@ using namespace std;
 		return result;
 	}
 
+	bool Object::drawInstances( const GLfloat *modelViews, unsigned int numInstances ) {
+		bool result = true;
+		
+		if( numInstances == 0 )
+			return result;
+		
+		glPushMatrix(); {
+			if( _batchPositions.empty() ) {
+				// formats without triangle batches replay the display list per instance
+				for( unsigned int i = 0; i < numInstances; i++ ) {
+					glLoadMatrixf( modelViews + 16*i );
+					glCallList( _objectDisplayList );
+				}
+			} else {
+				// bind the arrays and each material once, then only swap matrices
+				static Material solidWhiteMaterial( GOL_MATERIAL_WHITE );
+				
+				const ObjectLod *lod = _lod > 0 ? &_lods[ _lod - 1 ] : NULL;
+				const vector< ObjectBatch > &batches = lod != NULL ? lod->batches : _batches;
+				enableBatchArrays( lod );
+				for( unsigned int b = 0; b < batches.size(); b++ ) {
+					applyBatchState( batches[b], b > 0 ? &batches[b-1] : NULL );
+					for( unsigned int i = 0; i < numInstances; i++ ) {
+						glLoadMatrixf( modelViews + 16*i );
+						glDrawArrays( GL_TRIANGLES, batches[b].first, batches[b].count );
+					}
+				}
+				disableBatchArrays();
+				
+				setCurrentMaterial( &solidWhiteMaterial );
+				glDisable( GL_TEXTURE_2D );
+			}
+		}; glPopMatrix();
+		
+		return result;
+	}
+
 	Point* Object::getLocation() { 
 		return _location;
 	}
@@ -262,6 +305,11 @@ using namespace std;
 	void Object::init() {
 		objHasVertexTexCoords = false;
 		objHasVertexNormals = false;
+		_objectDisplayList = 0;
+		_lod = 0;
+		_useTextureAtlas = false;
+		_atlas = NULL;
+		_textureCache = NULL;
 
 		_location = new Point(0.0, 0.0, 0.0);
 		
@@ -291,216 +339,202 @@ using namespace std;
 		float minX = 999999, maxX = -999999, minY = 999999, maxY = -999999, minZ = 999999, maxZ = -999999;
 		string line;
 
-		Material *solidWhiteMaterial = new Material( GOL_MATERIAL_WHITE );
-
-	    _objectDisplayList = glGenLists(1);
+		Material *currMaterial = NULL;
+		GLuint currTexture = 0;
+		bool currSmooth = true;
+		
+		_batches.clear();
+		_batchPositions.clear();
+		_batchNormals.clear();
+		_batchTexCoords.clear();
+		
+		int progressCounter = 0;
 
-	    glNewList(_objectDisplayList, GL_COMPILE); {
+		while( getline( in, line ) ) {
+			line.erase( line.find_last_not_of( " \n\r\t" ) + 1 );
 			
-			int progressCounter = 0;
-
-			while( getline( in, line ) ) {
-				line.erase( line.find_last_not_of( " \n\r\t" ) + 1 );
+			vector< string > tokens = tokenizeString( line, " \t" );
+			if( tokens.size() < 1 ) continue;
+			
+			//the line should have a single character that lets us know if it's a...
+			if( !tokens[0].compare( "#" ) || tokens[0].find_first_of("#") == 0 ) {								// comment ignore
+			} else if( !tokens[0].compare( "o" ) ) {						// object name ignore
+			} else if( !tokens[0].compare( "g" ) ) {						// polygon group name ignore
+			} else if( !tokens[0].compare( "mtllib" ) ) {					// material library
+				_mtlFile = tokens[1];
+				loadMTLFile( INFO, ERRORS );
+			} else if( !tokens[0].compare( "usemtl" ) ) {					// use material library
+				map< string, Material* >::iterator materialIter = _materials->find( tokens[1] );
+				if( materialIter != _materials->end() ) {
+					currMaterial = materialIter->second;
+				}
 				
-				vector< string > tokens = tokenizeString( line, " \t" );
-				if( tokens.size() < 1 ) continue;
+				map< string, GLuint >::iterator textureIter = _textureHandles->find( tokens[1] );
+				if( textureIter != _textureHandles->end() ) {
+					currTexture = textureIter->second;
+				} else {
+					currTexture = 0;
+				}
+			} else if( !tokens[0].compare( "s" ) ) {						// smooth shading
+				if( !tokens[1].compare( "off" ) ) {
+					currSmooth = false;
+				} else {
+					currSmooth = true;
+				}
+			} else if( !tokens[0].compare( "v" ) ) {						//vertex
+				float x = atof( tokens[1].c_str() ),
+					  y = atof( tokens[2].c_str() ),
+					  z = atof( tokens[3].c_str() );
 				
-				//the line should have a single character that lets us know if it's a...
-				if( !tokens[0].compare( "#" ) || tokens[0].find_first_of("#") == 0 ) {								// comment ignore
-				} else if( !tokens[0].compare( "o" ) ) {						// object name ignore
-				} else if( !tokens[0].compare( "g" ) ) {						// polygon group name ignore
-				} else if( !tokens[0].compare( "mtllib" ) ) {					// material library
-					_mtlFile = tokens[1];
-					loadMTLFile( INFO, ERRORS );
-				} else if( !tokens[0].compare( "usemtl" ) ) {					// use material library
-					map< string, Material* >::iterator materialIter = _materials->find( tokens[1] );
-					if( materialIter != _materials->end() ) {
-						setCurrentMaterial( materialIter->second );
-					} else {
-
-					}
-					
-					map< string, GLuint >::iterator textureIter = _textureHandles->find( tokens[1] );
-					if( textureIter != _textureHandles->end() ) {
-						glEnable( GL_TEXTURE_2D );
-						glBindTexture( GL_TEXTURE_2D, textureIter->second );
-					} else {
-						glDisable( GL_TEXTURE_2D );
-					}
-				} else if( !tokens[0].compare( "s" ) ) {						// smooth shading
-					if( !tokens[1].compare( "off" ) ) {
-						glShadeModel( GL_FLAT );
-					} else {
-						glShadeModel( GL_SMOOTH );
-					}
-				} else if( !tokens[0].compare( "v" ) ) {						//vertex
-					float x = atof( tokens[1].c_str() ),
-						  y = atof( tokens[2].c_str() ),
-						  z = atof( tokens[3].c_str() );
-					
-					if( x < minX ) minX = x;
-					if( x > maxX ) maxX = x;
-					if( y < minY ) minY = y;
-					if( y > maxY ) maxY = y;
-					if( z < minZ ) minZ = z;
-					if( z > maxZ ) maxZ = z;
-					
-					vertices.push_back( x );
-					vertices.push_back( y );
-					vertices.push_back( z );
-				} else if( !tokens.at(0).compare( "vn" ) ) {                    //vertex normal
-					vertexNormals.push_back( atof( tokens[1].c_str() ) );
-					vertexNormals.push_back( atof( tokens[2].c_str() ) );
-					vertexNormals.push_back( atof( tokens[3].c_str() ) );
-				} else if( !tokens.at(0).compare( "vt" ) ) {                    //vertex tex coord
-					vertexTexCoords.push_back(atof(tokens[1].c_str()));
-					vertexTexCoords.push_back(atof(tokens[2].c_str()));
-				} else if( !tokens.at(0).compare( "f" ) ) {                     //face!
-					
-					//now, faces can be either quads or triangles (or maybe more?)
-					//split the string on spaces to get the number of verts+attrs.
-					vector<string> faceTokens = tokenizeString(line, " ");
+				if( x < minX ) minX = x;
+				if( x > maxX ) maxX = x;
+				if( y < minY ) minY = y;
+				if( y > maxY ) maxY = y;
+				if( z < minZ ) minZ = z;
+				if( z > maxZ ) maxZ = z;
+				
+				vertices.push_back( x );
+				vertices.push_back( y );
+				vertices.push_back( z );
+			} else if( !tokens.at(0).compare( "vn" ) ) {                    //vertex normal
+				vertexNormals.push_back( atof( tokens[1].c_str() ) );
+				vertexNormals.push_back( atof( tokens[2].c_str() ) );
+				vertexNormals.push_back( atof( tokens[3].c_str() ) );
+			} else if( !tokens.at(0).compare( "vt" ) ) {                    //vertex tex coord
+				vertexTexCoords.push_back(atof(tokens[1].c_str()));
+				vertexTexCoords.push_back(atof(tokens[2].c_str()));
+			} else if( !tokens.at(0).compare( "f" ) ) {                     //face!
+				
+				//now, faces can be either quads or triangles (or maybe more?)
+				//split the string on spaces to get the number of verts+attrs.
+				vector<string> faceTokens = tokenizeString(line, " ");
+				
+				//some local variables to hold the vertex+attribute indices we read in.
+				//we do it this way because we'll have to split quads into triangles ourselves.
+				vector<int> v, vn, vt;
+				
+				bool faceHasVertexTexCoords = false, faceHasVertexNormals = false;
+				
+				for(long unsigned int i = 1; i < faceTokens.size(); i++) {
+					//need to use both the tokens and number of slashes to determine what info is there.
+					vector<string> groupTokens = tokenizeString(faceTokens[i], "/");
+					int numSlashes = 0;
+					for(long unsigned int j = 0; j < faceTokens[i].length(); j++) { if(faceTokens[i][j] == '/') numSlashes++; }
 					
-					//some local variables to hold the vertex+attribute indices we read in.
-					//we do it this way because we'll have to split quads into triangles ourselves.
-					vector<int> v, vn, vt;
+					int vert = atoi(groupTokens[0].c_str());
+					if( vert < 0 )
+						vert = (vertices.size() / 3) + vert + 1;
 					
-					bool faceHasVertexTexCoords = false, faceHasVertexNormals = false;
+					//regardless, we always get a vertex index.
+					v.push_back( vert - 1 );
 					
-					for(long unsigned int i = 1; i < faceTokens.size(); i++) {
-						//need to use both the tokens and number of slashes to determine what info is there.
-						vector<string> groupTokens = tokenizeString(faceTokens[i], "/");
-						int numSlashes = 0;
-						for(long unsigned int j = 0; j < faceTokens[i].length(); j++) { if(faceTokens[i][j] == '/') numSlashes++; }
+					//based on combination of number of tokens and slashes, we can determine what we have.
+					if(groupTokens.size() == 2 && numSlashes == 1) {
+						int vtI = atoi(groupTokens[1].c_str());	
+						if( vtI < 0 )
+							vtI = (vertexTexCoords.size() / 2) + vtI + 1;
 						
-						int vert = atoi(groupTokens[0].c_str());
-						if( vert < 0 )
-							vert = (vertices.size() / 3) + vert + 1;
+						vtI--;
+						vt.push_back( vtI ); 
+						objHasVertexTexCoords = true; 
+						faceHasVertexTexCoords = true;
+					} else if(groupTokens.size() == 2 && numSlashes == 2) {
+						int vnI = atoi(groupTokens[1].c_str());
+						if( vnI < 0 )
+							vnI = vertexNormals.size() + vnI + 1;
 						
-						//regardless, we always get a vertex index.
-						v.push_back( vert - 1 );
+						vnI--;
+						vn.push_back( vnI ); 
+						objHasVertexNormals = true; 
+						faceHasVertexNormals = true;
+					} else if(groupTokens.size() == 3) {
+						int vtI = atoi(groupTokens[1].c_str());
+						if( vtI < 0 )
+							vtI = vertexTexCoords.size() + vtI + 1;
 						
-						//based on combination of number of tokens and slashes, we can determine what we have.
-						if(groupTokens.size() == 2 && numSlashes == 1) {
-							int vtI = atoi(groupTokens[1].c_str());	
-							if( vtI < 0 )
-								vtI = (vertexTexCoords.size() / 2) + vtI + 1;
-							
-							vtI--;
-							vt.push_back( vtI ); 
-							objHasVertexTexCoords = true; 
-							faceHasVertexTexCoords = true;
-						} else if(groupTokens.size() == 2 && numSlashes == 2) {
-							int vnI = atoi(groupTokens[1].c_str());
-							if( vnI < 0 )
-								vnI = vertexNormals.size() + vnI + 1;
-							
-							vnI--;
-							vn.push_back( vnI ); 
-							objHasVertexNormals = true; 
-							faceHasVertexNormals = true;
-						} else if(groupTokens.size() == 3) {
-							int vtI = atoi(groupTokens[1].c_str());
-							if( vtI < 0 )
-								vtI = vertexTexCoords.size() + vtI + 1;
-							
-							vtI--;
-							vt.push_back( vtI ); 
-							objHasVertexTexCoords = true; 
-							faceHasVertexTexCoords = true;
-							
-							int vnI = atoi(groupTokens[2].c_str());
-							if( vnI < 0 )
-								vnI = vertexNormals.size() + vnI + 1;
-
-							vnI--;
-							vn.push_back( vnI ); 
-							objHasVertexNormals = true; 
-							faceHasVertexNormals = true;					
-						} else if(groupTokens.size() != 1) {
-							if (ERRORS) fprintf(stderr, "[.obj]: [ERROR]: Malformed OBJ file, %s.\n", _objFile.c_str());
-							return false;
-						}
-					}    
+						vtI--;
+						vt.push_back( vtI ); 
+						objHasVertexTexCoords = true; 
+						faceHasVertexTexCoords = true;
+						
+						int vnI = atoi(groupTokens[2].c_str());
+						if( vnI < 0 )
+							vnI = vertexNormals.size() + vnI + 1;
+
+						vnI--;
+						vn.push_back( vnI ); 
+						objHasVertexNormals = true; 
+						faceHasVertexNormals = true;					
+					} else if(groupTokens.size() != 1) {
+						if (ERRORS) fprintf(stderr, "[.obj]: [ERROR]: Malformed OBJ file, %s.\n", _objFile.c_str());
+						return false;
+					}
+				}    
+				
+				//now the local variables have been filled up; push them onto our global 
+				//variables appropriately.
+				
+				beginBatch( currMaterial, currTexture, currSmooth );
+				for(long unsigned int i = 1; i < v.size()-1; i++) {
+					long unsigned int corners[3] = { 0, i, i+1 };
 					
-					//now the local variables have been filled up; push them onto our global 
-					//variables appropriately.
+					Vector faceNormal;
+					if( !faceHasVertexNormals ) {
+						Point v1 = Point( vertices.at( v[0]*3 ), vertices.at( v[0]*3+1 ), vertices.at( v[0]*3+2 ) );
+						Point v2 = Point( vertices.at( v[i]*3 ), vertices.at( v[i]*3+1 ), vertices.at( v[i]*3+2 ) );
+						Point v3 = Point( vertices.at( v[i+1]*3 ), vertices.at( v[i+1]*3+1 ), vertices.at( v[i+1]*3+2 ) );
+						faceNormal = cross( v2-v1, v3-v1 );
+						faceNormal.normalize();
+					}
 					
-					glBegin(GL_TRIANGLES); {
-						for(long unsigned int i = 1; i < v.size()-1; i++) {
-							
-							if( faceHasVertexNormals ) {
-								glNormal3f( vertexNormals.at( vn[0]*3 ), vertexNormals.at( vn[0]*3+1 ), vertexNormals.at( vn[0]*3+2) );
-							} else {
-								Point v1 = Point( vertices.at( v[0]*3 ), vertices.at( v[0]*3+1 ), vertices.at( v[0]*3+2 ) );
-								Point v2 = Point( vertices.at( v[i]*3 ), vertices.at( v[i]*3+1 ), vertices.at( v[i]*3+2 ) );
-								Point v3 = Point( vertices.at( v[i+1]*3 ), vertices.at( v[i+1]*3+1 ), vertices.at( v[i+1]*3+2 ) );
-								Vector normal = cross( v2-v1, v3-v1 );
-								normal.normalize();
-								glNormal3f( normal.getX(), normal.getY(), normal.getZ() );
-							}
-							if( faceHasVertexTexCoords )
-								glTexCoord2f( vertexTexCoords.at( vt[0]*2 ), vertexTexCoords.at( vt[0]*2+1 ) );
-							
-							glVertex3f( vertices.at( v[0]*3 ), vertices.at( v[0]*3+1 ), vertices.at( v[0]*3+2 ) );
-							
-							if( faceHasVertexNormals ) {
-								glNormal3f( vertexNormals.at( vn[i]*3 ), vertexNormals.at( vn[i]*3+1 ), vertexNormals.at( vn[i]*3+2 ) );
-							} else {
-								Point v1 = Point( vertices.at( v[0]*3 ), vertices.at( v[0]*3+1 ), vertices.at( v[0]*3+2 ) );
-								Point v2 = Point( vertices.at( v[i]*3 ), vertices.at( v[i]*3+1 ), vertices.at( v[i]*3+2 ) );
-								Point v3 = Point( vertices.at( v[i+1]*3 ), vertices.at( v[i+1]*3+1 ), vertices.at( v[i+1]*3+2 ) );
-								Vector normal = cross( v3-v2, v1-v2 );
-								normal.normalize();
-								glNormal3f( normal.getX(), normal.getY(), normal.getZ() );
-							}
-							if( faceHasVertexTexCoords )
-								glTexCoord2f( vertexTexCoords.at( vt[i]*2 ), vertexTexCoords.at( vt[i]*2+1 ) );
-							glVertex3f( vertices.at( v[i]*3 ), vertices.at( v[i]*3+1 ), vertices.at( v[i]*3+2 ) );
-							
-							if( faceHasVertexNormals ) {
-								glNormal3f( vertexNormals.at( vn[i+1]*3 ), vertexNormals.at( vn[i+1]*3+1 ), vertexNormals.at( vn[i+1]*3+2) );
-							} else {
-								Point v1 = Point( vertices.at( v[0]*3 ), vertices.at( v[0]*3+1 ), vertices.at( v[0]*3+2 ) );
-								Point v2 = Point( vertices.at( v[i]*3 ), vertices.at( v[i]*3+1 ), vertices.at( v[i]*3+2 ) );
-								Point v3 = Point( vertices.at( v[i+1]*3 ), vertices.at( v[i+1]*3+1 ), vertices.at( v[i+1]*3+2 ) );
-								Vector normal = cross( v1-v3, v2-v3 );
-								normal.normalize();
-								glNormal3f( normal.getX(), normal.getY(), normal.getZ() );
-							}
-							if( faceHasVertexTexCoords )
-								glTexCoord2f( vertexTexCoords.at( vt[i+1]*2 ), vertexTexCoords.at( vt[i+1]*2+1 ) );
-							glVertex3f( vertices.at( v[i+1]*3 ), vertices.at( v[i+1]*3+1 ), vertices.at( v[i+1]*3+2 ) );				
-							
-							numTriangles++;
-						} 
-					}; glEnd();
+					for( int k = 0; k < 3; k++ ) {
+						long unsigned int c = corners[k];
+						
+						GLfloat normal[3] = { (GLfloat)faceNormal.getX(), (GLfloat)faceNormal.getY(), (GLfloat)faceNormal.getZ() };
+						if( faceHasVertexNormals ) {
+							normal[0] = vertexNormals.at( vn[c]*3 );
+							normal[1] = vertexNormals.at( vn[c]*3+1 );
+							normal[2] = vertexNormals.at( vn[c]*3+2 );
+						}
+						
+						GLfloat texCoord[2] = { 0.0f, 0.0f };
+						if( faceHasVertexTexCoords ) {
+							texCoord[0] = vertexTexCoords.at( vt[c]*2 );
+							texCoord[1] = vertexTexCoords.at( vt[c]*2+1 );
+						}
+						
+						addBatchVertex( &vertices.at( v[c]*3 ), normal, texCoord );
+					}
 					
-					numFaces++;
-				} else {
-					if (INFO) cout << "[.obj]: ignoring line: " << line << endl;
+					numTriangles++;
 				}
 				
-				if (INFO) {
-					progressCounter++;
-					if( progressCounter % 5000 == 0 ) {					
-						printf("\33[2K\r");
-						switch( progressCounter ) {
-							case 5000:	printf("[.obj]: reading in %s...\\", _objFile.c_str());	break;
-							case 10000:	printf("[.obj]: reading in %s...|", _objFile.c_str());	break;
-							case 15000:	printf("[.obj]: reading in %s.../", _objFile.c_str());	break;
-							case 20000:	printf("[.obj]: reading in %s...-", _objFile.c_str());	break;
-						}
-						fflush(stdout);
+				numFaces++;
+			} else {
+				if (INFO) cout << "[.obj]: ignoring line: " << line << endl;
+			}
+			
+			if (INFO) {
+				progressCounter++;
+				if( progressCounter % 5000 == 0 ) {					
+					printf("\33[2K\r");
+					switch( progressCounter ) {
+						case 5000:	printf("[.obj]: reading in %s...\\", _objFile.c_str());	break;
+						case 10000:	printf("[.obj]: reading in %s...|", _objFile.c_str());	break;
+						case 15000:	printf("[.obj]: reading in %s.../", _objFile.c_str());	break;
+						case 20000:	printf("[.obj]: reading in %s...-", _objFile.c_str());	break;
 					}
-					if( progressCounter == 20000 )
-						progressCounter = 0;	   
+					fflush(stdout);
 				}
+				if( progressCounter == 20000 )
+					progressCounter = 0;	   
 			}
-			in.close();
-			setCurrentMaterial( solidWhiteMaterial );
-			glDisable( GL_TEXTURE_2D );
-		}; glEndList();
+		}
+		in.close();
+		
+		if( _useTextureAtlas )
+			buildTextureAtlas( INFO );
+		compileBatchDisplayList();
 		
 		time(&end);
 		double seconds = difftime( end, start );
@@ -520,6 +554,310 @@ using namespace std;
 		return result;
 	}
 
+	/*
+	 * Start a new run of triangles if the material, texture or shading
+	 * differs from the run currently being filled
+	 */
+	void Object::beginBatch( Material *material, GLuint textureHandle, bool smooth ) {
+		if( !_batches.empty() ) {
+			ObjectBatch &last = _batches.back();
+			if( last.material == material && last.textureHandle == textureHandle && last.smooth == smooth )
+				return;
+			if( last.count == 0 ) {
+				_batches.pop_back();
+			}
+		}
+		
+		ObjectBatch batch;
+		batch.material = material;
+		batch.textureHandle = textureHandle;
+		batch.smooth = smooth;
+		batch.first = _batchPositions.size() / 3;
+		batch.count = 0;
+		_batches.push_back( batch );
+	}
+
+	void Object::addBatchVertex( const GLfloat position[3], const GLfloat normal[3], const GLfloat texCoord[2] ) {
+		_batchPositions.insert( _batchPositions.end(), position, position + 3 );
+		_batchNormals.insert( _batchNormals.end(), normal, normal + 3 );
+		_batchTexCoords.insert( _batchTexCoords.end(), texCoord, texCoord + 2 );
+		_batches.back().count++;
+	}
+
+	/*
+	 * Set the GL state for batch, skipping whatever previous already set
+	 */
+	void Object::applyBatchState( const ObjectBatch &batch, const ObjectBatch *previous ) {
+		if( batch.material != NULL && (previous == NULL || previous->material != batch.material) )
+			setCurrentMaterial( batch.material );
+		
+		if( previous == NULL || previous->textureHandle != batch.textureHandle ) {
+			if( batch.textureHandle != 0 ) {
+				glEnable( GL_TEXTURE_2D );
+				glBindTexture( GL_TEXTURE_2D, batch.textureHandle );
+			} else {
+				glDisable( GL_TEXTURE_2D );
+			}
+		}
+		
+		if( previous == NULL || previous->smooth != batch.smooth )
+			glShadeModel( batch.smooth ? GL_SMOOTH : GL_FLAT );
+	}
+
+	void Object::enableBatchArrays( const ObjectLod *lod ) {
+		glEnableClientState( GL_VERTEX_ARRAY );
+		glEnableClientState( GL_NORMAL_ARRAY );
+		glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+		if( lod != NULL && !lod->positions.empty() ) {
+			glVertexPointer( 3, GL_FLOAT, 0, &lod->positions[0] );
+			glNormalPointer( GL_FLOAT, 0, &lod->normals[0] );
+			glTexCoordPointer( 2, GL_FLOAT, 0, &lod->texCoords[0] );
+		} else {
+			glVertexPointer( 3, GL_FLOAT, 0, &_batchPositions[0] );
+			glNormalPointer( GL_FLOAT, 0, &_batchNormals[0] );
+			glTexCoordPointer( 2, GL_FLOAT, 0, &_batchTexCoords[0] );
+		}
+	}
+	
+	/*
+	 * Vertex clustering: snap every vertex to the mean of the vertices that
+	 * share its grid cell and drop the triangles that collapse.  Level 1
+	 * uses 64 cells along the model's longest side, and each level after
+	 * halves that.  Normals and texture coordinates stay per corner, which
+	 * holds up well at the distances a coarser level is used from.
+	 */
+	void Object::buildLods( unsigned int numLevels, bool INFO ) {
+		_lods.clear();
+		_lod = 0;
+		if( _batchPositions.empty() )
+			return;
+		
+		unsigned int numVertices = _batchPositions.size() / 3;
+		GLfloat minCorner[3], maxCorner[3];
+		for( int axis = 0; axis < 3; axis++ )
+			minCorner[axis] = maxCorner[axis] = _batchPositions[axis];
+		for( unsigned int v = 1; v < numVertices; v++ ) {
+			for( int axis = 0; axis < 3; axis++ ) {
+				minCorner[axis] = min( minCorner[axis], _batchPositions[3*v + axis] );
+				maxCorner[axis] = max( maxCorner[axis], _batchPositions[3*v + axis] );
+			}
+		}
+		GLfloat extent = max( maxCorner[0] - minCorner[0], max( maxCorner[1] - minCorner[1], maxCorner[2] - minCorner[2] ) );
+		if( extent <= 0 )
+			return;
+		
+		vector< unsigned int > vertexCluster( numVertices );
+		vector< GLfloat > clusterPositions;
+		vector< unsigned int > clusterCounts;
+		unordered_map< unsigned long long, unsigned int > clusterIndex;
+		for( unsigned int level = 1; level <= numLevels; level++ ) {
+			unsigned int cells = 64 >> ( level - 1 );
+			if( cells < 2 )
+				break;
+			GLfloat cellSize = extent / cells;
+			
+			clusterIndex.clear();
+			clusterPositions.clear();
+			clusterCounts.clear();
+			for( unsigned int v = 0; v < numVertices; v++ ) {
+				unsigned long long key = 0;
+				for( int axis = 0; axis < 3; axis++ ) {
+					unsigned int cell = min( cells - 1, (unsigned int)( ( _batchPositions[3*v + axis] - minCorner[axis] ) / cellSize ) );
+					key = key * cells + cell;
+				}
+				unordered_map< unsigned long long, unsigned int >::iterator found = clusterIndex.find( key );
+				if( found == clusterIndex.end() ) {
+					found = clusterIndex.insert( make_pair( key, (unsigned int)clusterCounts.size() ) ).first;
+					clusterPositions.insert( clusterPositions.end(), 3, 0.0f );
+					clusterCounts.push_back( 0 );
+				}
+				vertexCluster[v] = found->second;
+				for( int axis = 0; axis < 3; axis++ )
+					clusterPositions[3*found->second + axis] += _batchPositions[3*v + axis];
+				clusterCounts[ found->second ]++;
+			}
+			for( unsigned int c = 0; c < clusterCounts.size(); c++ )
+				for( int axis = 0; axis < 3; axis++ )
+					clusterPositions[3*c + axis] /= clusterCounts[c];
+			
+			_lods.push_back( ObjectLod() );
+			ObjectLod &lod = _lods.back();
+			for( unsigned int b = 0; b < _batches.size(); b++ ) {
+				ObjectBatch batch = _batches[b];
+				batch.first = lod.positions.size() / 3;
+				batch.count = 0;
+				for( GLint t = _batches[b].first; t + 2 < _batches[b].first + _batches[b].count; t += 3 ) {
+					unsigned int c0 = vertexCluster[t], c1 = vertexCluster[t+1], c2 = vertexCluster[t+2];
+					if( c0 == c1 || c1 == c2 || c0 == c2 )
+						continue;
+					for( int corner = 0; corner < 3; corner++ ) {
+						const GLfloat *position = &clusterPositions[ 3 * vertexCluster[t + corner] ];
+						lod.positions.insert( lod.positions.end(), position, position + 3 );
+						lod.normals.insert( lod.normals.end(), &_batchNormals[3*(t + corner)], &_batchNormals[3*(t + corner)] + 3 );
+						lod.texCoords.insert( lod.texCoords.end(), &_batchTexCoords[2*(t + corner)], &_batchTexCoords[2*(t + corner)] + 2 );
+					}
+					batch.count += 3;
+				}
+				if( batch.count > 0 )
+					lod.batches.push_back( batch );
+			}
+			
+			if (INFO) printf( "[lod]: %s level %u: %u of %u triangles\n", _objFile.c_str(), level, getNumTriangles( level ), getNumTriangles( 0 ) );
+		}
+	}
+	
+	/*
+	 * Each interleaved array is split into coordinate streams, transformed
+	 * and interleaved again; the split costs far less than the per-point
+	 * Matrix arithmetic it replaces, and lets the kernels run SIMD wide.
+	 */
+	bool Object::transform( const Mat4f &m, WorkerPool *pool, bool INFO ) {
+		if( _batchPositions.empty() ) {
+			if (INFO) printf( "[object]: [WARNING]: %s has no triangle batches to transform\n", _objFile.c_str() );
+			return false;
+		}
+		
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		vector< XyzArrays > levels( 1 + _lods.size() );
+		for( unsigned int level = 0; level < levels.size(); level++ ) {
+			levels[level].positions = level == 0 ? &_batchPositions : &_lods[ level - 1 ].positions;
+			levels[level].normals = level == 0 ? &_batchNormals : &_lods[ level - 1 ].normals;
+		}
+		size_t numPoints = 0;
+		if( !transformArrays( m, levels, pool, &numPoints ) ) {
+			if (INFO) printf( "[object]: [ERROR]: singular transform, %s left as it was\n", _objFile.c_str() );
+			return false;
+		}
+		compileBatchDisplayList();
+		
+		double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+		if (INFO) printf( "[object]: transformed %s, %lu points and normals in %.2fms (%.1fM points/s)\n",
+						  _objFile.c_str(), (unsigned long)numPoints, seconds * 1000.0, seconds > 0 ? numPoints / seconds / 1e6 : 0.0 );
+		return true;
+	}
+	
+	unsigned int Object::getNumLods() { return 1 + _lods.size(); }
+	
+	unsigned int Object::getNumTriangles( unsigned int lod ) {
+		if( lod == 0 )
+			return _batchPositions.size() / 9;
+		return lod <= _lods.size() ? _lods[ lod - 1 ].positions.size() / 9 : 0;
+	}
+	
+	void Object::setLod( unsigned int lod ) {
+		_lod = min( lod, (unsigned int)_lods.size() );
+	}
+	
+	unsigned int Object::getLod() { return _lod; }
+
+	void Object::disableBatchArrays() {
+		glDisableClientState( GL_TEXTURE_COORD_ARRAY );
+		glDisableClientState( GL_NORMAL_ARRAY );
+		glDisableClientState( GL_VERTEX_ARRAY );
+	}
+
+	/*
+	 * Move every diffuse map that is only sampled inside [0,1] into shared
+	 * atlas pages and remap the texture coordinates that use it
+	 */
+	void Object::buildTextureAtlas( bool INFO ) {
+		if( _atlas == NULL || _atlasImages.empty() )
+			return;
+		
+		const GLfloat EPSILON = 0.001f;
+		
+		// maps that need GL_REPEAT, or that no triangle uses, keep their own texture
+		map< GLuint, bool > atlasable;
+		for( unsigned int b = 0; b < _batches.size(); b++ ) {
+			GLuint handle = _batches[b].textureHandle;
+			if( _atlasImages.find( handle ) == _atlasImages.end() )
+				continue;
+			if( atlasable.find( handle ) == atlasable.end() )
+				atlasable[ handle ] = true;
+			
+			for( GLint i = _batches[b].first*2; i < (_batches[b].first + _batches[b].count)*2; i++ ) {
+				if( _batchTexCoords[i] < -EPSILON || _batchTexCoords[i] > 1.0f + EPSILON ) {
+					atlasable[ handle ] = false;
+					break;
+				}
+			}
+		}
+		
+		map< GLuint, int >::iterator imageIter = _atlasImages.begin();
+		while( imageIter != _atlasImages.end() ) {
+			map< GLuint, bool >::iterator useIter = atlasable.find( imageIter->first );
+			if( useIter == atlasable.end() || !useIter->second ) {
+				_atlas->removeImage( imageIter->second );
+				_atlasImages.erase( imageIter++ );
+			} else {
+				++imageIter;
+			}
+		}
+		if( _atlasImages.empty() )
+			return;
+		
+		_atlas->pack();
+		_atlas->upload();
+		
+		for( unsigned int b = 0; b < _batches.size(); b++ ) {
+			imageIter = _atlasImages.find( _batches[b].textureHandle );
+			if( imageIter == _atlasImages.end() )
+				continue;
+			
+			int image = imageIter->second;
+			for( GLint v = _batches[b].first; v < _batches[b].first + _batches[b].count; v++ ) {
+				GLfloat s = min( max( _batchTexCoords[v*2], 0.0f ), 1.0f );
+				GLfloat t = min( max( _batchTexCoords[v*2+1], 0.0f ), 1.0f );
+				_atlas->remap( image, s, t );
+				_batchTexCoords[v*2] = s;
+				_batchTexCoords[v*2+1] = t;
+			}
+			_batches[b].textureHandle = _atlas->getPageHandle( _atlas->getPage( image ) );
+		}
+		
+		map< string, GLuint >::iterator handleIter;
+		for( handleIter = _textureHandles->begin(); handleIter != _textureHandles->end(); ++handleIter ) {
+			imageIter = _atlasImages.find( handleIter->second );
+			if( imageIter != _atlasImages.end() )
+				handleIter->second = _atlas->getPageHandle( _atlas->getPage( imageIter->second ) );
+		}
+		
+		for( imageIter = _atlasImages.begin(); imageIter != _atlasImages.end(); ++imageIter ) {
+			GLuint handle = imageIter->first;
+			glDeleteTextures( 1, &handle );
+		}
+		
+		if (INFO) cout << "[.obj]: Texture Atlas:\t" << _atlasImages.size() << " maps packed into "
+						<< _atlas->getNumPages() << " page(s)" << endl;
+		
+		_atlasImages.clear();
+	}
+
+	/*
+	 * (Re)build the display list from the triangle batches
+	 */
+	void Object::compileBatchDisplayList() {
+		static Material solidWhiteMaterial( GOL_MATERIAL_WHITE );
+		
+		if( _objectDisplayList != 0 )
+			glDeleteLists( _objectDisplayList, 1 );
+		
+		_objectDisplayList = glGenLists(1);
+		
+		glNewList(_objectDisplayList, GL_COMPILE); {
+			if( !_batchPositions.empty() ) {
+				enableBatchArrays();
+				for( unsigned int b = 0; b < _batches.size(); b++ ) {
+					applyBatchState( _batches[b], b > 0 ? &_batches[b-1] : NULL );
+					glDrawArrays( GL_TRIANGLES, _batches[b].first, _batches[b].count );
+				}
+				disableBatchArrays();
+			}
+			setCurrentMaterial( &solidWhiteMaterial );
+			glDisable( GL_TEXTURE_2D );
+		}; glEndList();
+	}
+
 	bool Object::loadMTLFile( bool INFO, bool ERRORS ) {
 		bool result = true;
 		
@@ -613,7 +951,24 @@ using namespace std;
 				if( imageHandles.find( tokens[1] ) != imageHandles.end() ) {
 					_textureHandles->insert( pair< string, GLuint >( materialName, imageHandles.find( tokens[1] )->second ) );
 				} else {
-					if( tokens[1].find( ".bmp" ) != string::npos || tokens[1].find( ".BMP" ) != string::npos ) {
+					// a cache hit skips decoding; masked textures are combined below and never cached
+					bool cached = false, haveCacheKey = false;
+					unsigned long long cacheKey = 0;
+					if( _textureCache != NULL && maskData == NULL ) {
+						haveCacheKey = TextureCache::hashFile( tokens[1], cacheKey )
+									|| TextureCache::hashFile( path + tokens[1], cacheKey );
+						if( haveCacheKey && _textureCache->lookup( cacheKey ) ) {
+							cached = true;
+							textureData = (unsigned char*)_textureCache->getBaseLevel();
+							texWidth = _textureCache->getBaseWidth();
+							texHeight = _textureCache->getBaseHeight();
+							textureChannels = 4;
+						}
+					}
+					
+					if( cached ) {
+						if (INFO) cout << "[.mtl]: Cached:    \t" << tokens[1] << endl;
+					} else if( tokens[1].find( ".bmp" ) != string::npos || tokens[1].find( ".BMP" ) != string::npos ) {
 						bool success = false;
 						textureData = loadBMP( (char*)tokens[1].c_str(), texWidth, texHeight, textureChannels, success, ERRORS, path );
 						if( !success ) {
@@ -675,13 +1030,27 @@ using namespace std;
 							glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 							glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 							
-							GLenum colorSpace = GL_RGB;
-							if( textureChannels == 4 )
-								colorSpace = GL_RGBA;
-							gluBuild2DMipmaps( GL_TEXTURE_2D, colorSpace, texWidth, texHeight, colorSpace, GL_UNSIGNED_BYTE, textureData );		
+							if( haveCacheKey ) {
+								if( !cached )
+									_textureCache->store( cacheKey, textureData, texWidth, texHeight, textureChannels );
+								_textureCache->upload();
+							} else {
+								GLenum colorSpace = GL_RGB;
+								if( textureChannels == 4 )
+									colorSpace = GL_RGBA;
+								gluBuild2DMipmaps( GL_TEXTURE_2D, colorSpace, texWidth, texHeight, colorSpace, GL_UNSIGNED_BYTE, textureData );		
+							}
 				
 							_textureHandles->insert( pair<string, GLuint>( materialName, textureHandle ) );
 							imageHandles.insert( pair<string, GLuint>( tokens[1], textureHandle ) );
+							
+							if( _useTextureAtlas ) {
+								if( _atlas == NULL )
+									_atlas = new TextureAtlas();
+								int image = _atlas->addImage( textureData, texWidth, texHeight, textureChannels );
+								if( image >= 0 )
+									_atlasImages[ textureHandle ] = image;
+							}
 						} else {					
 							fullData = createTransparentTexture( textureData, maskData, texWidth, texHeight, textureChannels, maskChannels );
 							
@@ -770,6 +1139,13 @@ using namespace std;
 							gluBuild2DMipmaps( GL_TEXTURE_2D, GL_RGBA, texWidth, texHeight, GL_RGBA, GL_UNSIGNED_BYTE, fullData );
 							
 							delete fullData;
+							
+							// the alpha mask changed the pixels, so this map keeps its own texture
+							map< GLuint, int >::iterator imageIter = _atlasImages.find( textureHandle );
+							if( imageIter != _atlasImages.end() ) {
+								_atlas->removeImage( imageIter->second );
+								_atlasImages.erase( imageIter );
+							}
 						}
 					}
 				}
@@ -1,9 +1,12 @@
 #ifndef _OPENGL_OBJECT_H_
 #define _OPENGL_OBJECT_H_
 
+#include "BatchTransform.h"
 #include "Face.h"
 #include "Material.h"
 #include "Point.h"
+#include "TextureAtlas.h"
+#include "TextureCache.h"
 
 #include <map>
 #include <string>
@@ -12,16 +15,55 @@ using namespace std;
 
 
 	
+	/* a run of triangles drawn with the same material, texture and shading */
+	struct ObjectBatch {
+		Material *material;
+		GLuint textureHandle;
+		bool smooth;
+		GLint first;
+		GLsizei count;
+	};
+
+	/* a decimated copy of an object's triangle batches */
+	struct ObjectLod {
+		vector< ObjectBatch > batches;
+		vector< GLfloat > positions;
+		vector< GLfloat > normals;
+		vector< GLfloat > texCoords;
+	};
+
 	class Object {
 	public:
 		Object();
-		Object( string filename );
+		/* useTextureAtlas packs diffuse maps into shared pages while loading */
+		/* textureCache, if given, supplies and stores decoded mip chains */
+		Object( string filename, bool useTextureAtlas = false, TextureCache *textureCache = NULL );
 		~Object();
 		
 		bool loadObjectFile( string filename, bool INFO = true, bool ERRORS = true );
 		
 		bool draw();
 		
+		/* draw the object once per column-major modelview matrix in modelViews */
+		/* material and texture state is set once per batch, not per instance */
+		bool drawInstances( const GLfloat *modelViews, unsigned int numInstances );
+		
+		/* build numLevels coarser copies of the triangle batches by vertex */
+		/* clustering, each on a grid half as fine as the last; level 0 is */
+		/* the model as loaded */
+		void buildLods( unsigned int numLevels, bool INFO = true );
+		unsigned int getNumLods();
+		unsigned int getNumTriangles( unsigned int lod );
+		/* the level drawInstances() uses; clamped to the levels built */
+		void setLod( unsigned int lod );
+		unsigned int getLod();
+		
+		/* bake m into the triangle batches and any levels built from them: */
+		/* positions by m, normals by its inverse-transpose; pool, if given, */
+		/* shares large models across its threads; false for formats */
+		/* drawn only from a display list, or a singular m */
+		bool transform( const Mat4f &m, WorkerPool *pool = NULL, bool INFO = true );
+		
 		Point* getLocation();
 
 		vector< Face* > *getFaces();
@@ -56,6 +98,30 @@ using namespace std;
 		vector< GLfloat > vertexTexCoords;
 		vector< GLfloat > vertexColors;
 		
+		/* de-indexed triangle data, grouped into batches by material */
+		vector< ObjectBatch > _batches;
+		vector< GLfloat > _batchPositions;
+		vector< GLfloat > _batchNormals;
+		vector< GLfloat > _batchTexCoords;
+		
+		void beginBatch( Material *material, GLuint textureHandle, bool smooth );
+		void addBatchVertex( const GLfloat position[3], const GLfloat normal[3], const GLfloat texCoord[2] );
+		void applyBatchState( const ObjectBatch &batch, const ObjectBatch *previous );
+		void enableBatchArrays( const ObjectLod *lod = NULL );
+		void disableBatchArrays();
+		void compileBatchDisplayList();
+		
+		vector< ObjectLod > _lods;			// levels 1 and up
+		unsigned int _lod;
+		
+		bool _useTextureAtlas;
+		TextureAtlas *_atlas;
+		map< GLuint, int > _atlasImages;		// texture handle -> atlas image
+		
+		void buildTextureAtlas( bool INFO );
+		
+		TextureCache *_textureCache;
+		
 		map< string, Material* >* _materials;
 		map< string, GLuint >* _textureHandles;
 
@@ -45,7 +45,7 @@
 	Point operator+(Point a, Vector b);
 	Point operator+(Vector a, Point b);
 	Point operator+(Point a, Point b);
-	Point operator*(Matrix m, Point a);
+	Point operator*(const Matrix &m, Point a);
 	bool operator==(Point a, Point b);
 	bool operator!=(Point a, Point b);
 
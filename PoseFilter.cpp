@@ -0,0 +1,188 @@
+#include "PoseFilter.h"
+
+#include <math.h>
+
+
+	// state: position (3), velocity (3), quaternion w x y z (4), quaternion rate (4)
+	// measurement: position (3), quaternion (4)
+	static const int STATE_SIZE = 14;
+	static const int MEASUREMENT_SIZE = 7;
+	static const int POS = 0, VEL = 3, QUAT = 6, QUAT_RATE = 10;
+	
+	static cv::Vec4d rotationToQuaternion( const cv::Vec3d &rvec ) {
+		double angle = cv::norm( rvec );
+		if( angle < 1e-12 )
+			return cv::Vec4d( 1, 0, 0, 0 );
+		double s = sin( angle * 0.5 ) / angle;
+		return cv::Vec4d( cos( angle * 0.5 ), rvec[0] * s, rvec[1] * s, rvec[2] * s );
+	}
+	
+	static cv::Vec3d quaternionToRotation( cv::Vec4d q ) {
+		q *= 1.0 / cv::norm( q );
+		if( q[0] < 0 )
+			q = -q;
+		double sinHalf = sqrt( q[1] * q[1] + q[2] * q[2] + q[3] * q[3] );
+		if( sinHalf < 1e-12 )
+			return cv::Vec3d( 0, 0, 0 );
+		double scale = 2.0 * atan2( sinHalf, q[0] ) / sinHalf;
+		return cv::Vec3d( q[1] * scale, q[2] * scale, q[3] * scale );
+	}
+	
+	PoseFilter::PoseFilter( double positionNoise, double rotationNoise,
+							double positionMeasurementNoise, double rotationMeasurementNoise )
+		: _kalman( STATE_SIZE, MEASUREMENT_SIZE, 0, CV_64F ) {
+		_positionNoise = positionNoise;
+		_rotationNoise = rotationNoise;
+		_initialized = false;
+		_lastTime = 0;
+		
+		_measurement.create( MEASUREMENT_SIZE, 1, CV_64F );
+		
+		_kalman.measurementMatrix = cv::Mat::zeros( MEASUREMENT_SIZE, STATE_SIZE, CV_64F );
+		for( int i = 0; i < 3; i++ )
+			_kalman.measurementMatrix.at< double >( i, POS + i ) = 1;
+		for( int i = 0; i < 4; i++ )
+			_kalman.measurementMatrix.at< double >( 3 + i, QUAT + i ) = 1;
+		
+		_kalman.measurementNoiseCov = cv::Mat::zeros( MEASUREMENT_SIZE, MEASUREMENT_SIZE, CV_64F );
+		for( int i = 0; i < 3; i++ )
+			_kalman.measurementNoiseCov.at< double >( i, i ) = positionMeasurementNoise * positionMeasurementNoise;
+		for( int i = 3; i < 7; i++ )
+			_kalman.measurementNoiseCov.at< double >( i, i ) = rotationMeasurementNoise * rotationMeasurementNoise;
+	}
+	
+	bool PoseFilter::isInitialized() { return _initialized; }
+	double PoseFilter::getLastUpdateTime() { return _lastTime; }
+	
+	/*
+	 * Each value integrates its rate over dt.  The process noise is the
+	 * usual white-acceleration model with the cross terms dropped: a rate
+	 * drifts by noise^2 * dt and its value by noise^2 * dt^3 / 3.  The
+	 * matrices are rewritten in place, every step.
+	 */
+	void PoseFilter::setTimeStep( double dt ) {
+		cv::setIdentity( _kalman.transitionMatrix );
+		for( int i = 0; i < 3; i++ )
+			_kalman.transitionMatrix.at< double >( POS + i, VEL + i ) = dt;
+		for( int i = 0; i < 4; i++ )
+			_kalman.transitionMatrix.at< double >( QUAT + i, QUAT_RATE + i ) = dt;
+		
+		_kalman.processNoiseCov.setTo( 0 );
+		double pos2 = _positionNoise * _positionNoise, rot2 = _rotationNoise * _rotationNoise;
+		for( int i = 0; i < 3; i++ ) {
+			_kalman.processNoiseCov.at< double >( POS + i, POS + i ) = pos2 * dt * dt * dt / 3.0;
+			_kalman.processNoiseCov.at< double >( VEL + i, VEL + i ) = pos2 * dt;
+		}
+		for( int i = 0; i < 4; i++ ) {
+			_kalman.processNoiseCov.at< double >( QUAT + i, QUAT + i ) = rot2 * dt * dt * dt / 3.0;
+			_kalman.processNoiseCov.at< double >( QUAT_RATE + i, QUAT_RATE + i ) = rot2 * dt;
+		}
+	}
+	
+	void PoseFilter::correct( const cv::Vec3d &rvec, const cv::Vec3d &tvec, double time ) {
+		cv::Vec4d q = rotationToQuaternion( rvec );
+		
+		if( !_initialized ) {
+			_kalman.statePost.setTo( 0 );
+			for( int i = 0; i < 3; i++ )
+				_kalman.statePost.at< double >( POS + i ) = tvec[i];
+			for( int i = 0; i < 4; i++ )
+				_kalman.statePost.at< double >( QUAT + i ) = q[i];
+			
+			// trust the first pose as much as any measurement, and know
+			// nothing of the rates yet
+			cv::setIdentity( _kalman.errorCovPost );
+			for( int i = 0; i < MEASUREMENT_SIZE; i++ ) {
+				int s = i < 3 ? POS + i : QUAT + i - 3;
+				_kalman.errorCovPost.at< double >( s, s ) = _kalman.measurementNoiseCov.at< double >( i, i );
+			}
+			
+			_initialized = true;
+			_lastTime = time;
+			return;
+		}
+		
+		double dt = time - _lastTime;
+		if( dt < 0 )
+			dt = 0;
+		setTimeStep( dt );
+		_kalman.predict();
+		
+		// q and -q are the same rotation; measure the one nearest the prediction
+		double dot = 0;
+		for( int i = 0; i < 4; i++ )
+			dot += q[i] * _kalman.statePre.at< double >( QUAT + i );
+		if( dot < 0 )
+			q = -q;
+		
+		for( int i = 0; i < 3; i++ )
+			_measurement.at< double >( i ) = tvec[i];
+		for( int i = 0; i < 4; i++ )
+			_measurement.at< double >( 3 + i ) = q[i];
+		_kalman.correct( _measurement );
+		
+		// keep the quaternion on the unit sphere
+		double length = 0;
+		for( int i = 0; i < 4; i++ )
+			length += _kalman.statePost.at< double >( QUAT + i ) * _kalman.statePost.at< double >( QUAT + i );
+		length = sqrt( length );
+		for( int i = 0; i < 4; i++ )
+			_kalman.statePost.at< double >( QUAT + i ) /= length;
+		
+		_lastTime = time;
+	}
+	
+	void PoseFilter::predict( double time, cv::Vec3d &rvec, cv::Vec3d &tvec ) {
+		double dt = time - _lastTime;
+		if( dt < 0 )
+			dt = 0;
+		
+		const cv::Mat &state = _kalman.statePost;
+		cv::Vec4d q;
+		for( int i = 0; i < 3; i++ )
+			tvec[i] = state.at< double >( POS + i ) + state.at< double >( VEL + i ) * dt;
+		for( int i = 0; i < 4; i++ )
+			q[i] = state.at< double >( QUAT + i ) + state.at< double >( QUAT_RATE + i ) * dt;
+		rvec = quaternionToRotation( q );
+	}
+	
+	
+	PoseFilterSet::PoseFilterSet( unsigned int maxMissedDetections ) {
+		// a marker is always kept through the pass that saw it
+		_maxMissedDetections = maxMissedDetections > 0 ? maxMissedDetections : 1;
+	}
+	
+	void PoseFilterSet::correct( const vector< int > &ids, const vector< cv::Vec3d > &rvecs, const vector< cv::Vec3d > &tvecs, double time ) {
+		for( map< int, Entry >::iterator iter = _filters.begin(); iter != _filters.end(); ++iter )
+			iter->second.missed++;
+		
+		for( unsigned int i = 0; i < ids.size(); i++ ) {
+			Entry &entry = _filters[ ids[i] ];
+			entry.filter.correct( rvecs[i], tvecs[i], time );
+			entry.missed = 0;
+		}
+		
+		for( map< int, Entry >::iterator iter = _filters.begin(); iter != _filters.end(); ) {
+			if( iter->second.missed >= _maxMissedDetections )
+				_filters.erase( iter++ );
+			else
+				++iter;
+		}
+	}
+	
+	void PoseFilterSet::predict( double time, vector< int > &ids, vector< cv::Vec3d > &rvecs, vector< cv::Vec3d > &tvecs ) {
+		ids.clear();
+		rvecs.clear();
+		tvecs.clear();
+		for( map< int, Entry >::iterator iter = _filters.begin(); iter != _filters.end(); ++iter ) {
+			cv::Vec3d rvec, tvec;
+			iter->second.filter.predict( time, rvec, tvec );
+			ids.push_back( iter->first );
+			rvecs.push_back( rvec );
+			tvecs.push_back( tvec );
+		}
+	}
+	
+	void PoseFilterSet::clear() {
+		_filters.clear();
+	}
@@ -0,0 +1,69 @@
+#ifndef _POSE_FILTER_H_
+#define _POSE_FILTER_H_ 1
+
+#include <opencv2/core.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include <map>
+#include <vector>
+using namespace std;
+
+
+
+	/* constant velocity Kalman filter over one marker's pose: position and */
+	/* orientation quaternion, each with its rate of change; smooths the */
+	/* measured poses and predicts the pose at times between them */
+	class PoseFilter {
+	public:
+		/* positionNoise / rotationNoise: how fast the true motion may change */
+		/* (process noise); measurementNoise: how much the measured */
+		/* translation / quaternion jitter */
+		PoseFilter( double positionNoise = 50.0, double rotationNoise = 5.0,
+					double positionMeasurementNoise = 0.05, double rotationMeasurementNoise = 0.01 );
+		
+		bool isInitialized();
+		double getLastUpdateTime();
+		
+		/* fold in a measured pose taken at time (seconds) */
+		void correct( const cv::Vec3d &rvec, const cv::Vec3d &tvec, double time );
+		
+		/* the filtered pose extrapolated to time, without changing the filter */
+		void predict( double time, cv::Vec3d &rvec, cv::Vec3d &tvec );
+		
+	private:
+		cv::KalmanFilter _kalman;
+		cv::Mat _measurement;
+		double _positionNoise;
+		double _rotationNoise;
+		bool _initialized;
+		double _lastTime;
+		
+		void setTimeStep( double dt );
+	};
+
+	/* one PoseFilter per marker id, dropping markers that stop being seen */
+	class PoseFilterSet {
+	public:
+		PoseFilterSet( unsigned int maxMissedDetections = 2 );
+		
+		/* fold in one detection pass; markers missing from maxMissedDetections */
+		/* passes in a row are forgotten */
+		void correct( const vector< int > &ids, const vector< cv::Vec3d > &rvecs, const vector< cv::Vec3d > &tvecs, double time );
+		
+		/* every live marker's pose at time */
+		void predict( double time, vector< int > &ids, vector< cv::Vec3d > &rvecs, vector< cv::Vec3d > &tvecs );
+		
+		void clear();
+		
+	private:
+		struct Entry {
+			PoseFilter filter;
+			unsigned int missed;
+		};
+		
+		map< int, Entry > _filters;
+		unsigned int _maxMissedDetections;
+	};
+
+
+#endif
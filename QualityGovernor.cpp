@@ -0,0 +1,140 @@
+#include "QualityGovernor.h"
+
+#include "FrameRing.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+
+	/* detection ladder: scale and detection interval at each level */
+	static const float DETECTION_SCALES[] = { 1.0f, 0.5f, 0.5f, 0.25f, 0.25f };
+	static const unsigned int DETECTION_INTERVALS[] = { 1, 1, 2, 2, 3 };
+	static const unsigned int DETECTION_LEVELS = 5;
+	
+	/* render ladder: level 0 draws overlays on the full model, level 1 */
+	/* drops the overlays, and each level after uses the next model LOD */
+	
+	/* frames per decision, and the hysteresis: a side steps down after */
+	/* WINDOWS_TO_DEGRADE windows over HIGH_WATER of the budget, and only */
+	/* steps back up after WINDOWS_TO_RECOVER windows under LOW_WATER, with */
+	/* at least MIN_SECONDS_BETWEEN_CHANGES after any change.  A step up */
+	/* that is undone within RECOVERY_HOLD_SECONDS doubles the wait before */
+	/* the next try, up to MAX_WINDOWS_TO_RECOVER */
+	static const unsigned int WINDOW_FRAMES = 30;
+	static const double HIGH_WATER = 0.9;
+	static const double LOW_WATER = 0.5;
+	static const unsigned int WINDOWS_TO_DEGRADE = 2;
+	static const unsigned int WINDOWS_TO_RECOVER = 6;
+	static const unsigned int MAX_WINDOWS_TO_RECOVER = 96;
+	static const double MIN_SECONDS_BETWEEN_CHANGES = 1.0;
+	static const double RECOVERY_HOLD_SECONDS = 10.0;
+	
+	QualityGovernor::QualityGovernor( double targetFps ) {
+		setTargetFps( targetFps );
+		_numModelLods = 1;
+		_windowFrames = 0;
+		_lastChange = 0;
+		
+		Side side = { "", 0, 0, 0, 0, 0, WINDOWS_TO_RECOVER, -RECOVERY_HOLD_SECONDS, 0, 0 };
+		_detection = side;
+		_detection.name = "detection";
+		_detection.maxLevel = DETECTION_LEVELS - 1;
+		_render = side;
+		_render.name = "render";
+		_render.maxLevel = 1;
+	}
+	
+	void QualityGovernor::setTargetFps( double targetFps ) {
+		_budget = 1.0 / ( targetFps > 0 ? targetFps : 30.0 );
+	}
+	
+	void QualityGovernor::setNumModelLods( unsigned int numModelLods ) {
+		_numModelLods = numModelLods > 0 ? numModelLods : 1;
+		_render.maxLevel = _numModelLods;
+		if( _render.level > _render.maxLevel )
+			_render.level = _render.maxLevel;
+	}
+	
+	float QualityGovernor::getDetectionScale() { return DETECTION_SCALES[ _detection.level ]; }
+	unsigned int QualityGovernor::getDetectionInterval() { return DETECTION_INTERVALS[ _detection.level ]; }
+	unsigned int QualityGovernor::getModelLod() { return _render.level > 1 ? _render.level - 1 : 0; }
+	bool QualityGovernor::getOverlays() { return _render.level == 0; }
+	
+	/*
+	 * Detection and rendering run on different threads, so each has the
+	 * whole frame budget to itself.  Frames that skipped detection count as
+	 * zero, so a longer detection interval shows up as a lower mean.  The
+	 * buffer swap is left out: it waits for the display, not for work.
+	 */
+	bool QualityGovernor::update( const FrameTimings &timings ) {
+		_detection.totalSeconds += timings.seconds[ STAGE_UNDISTORT ] + timings.seconds[ STAGE_DETECT ] + timings.seconds[ STAGE_POSE ];
+		_render.totalSeconds += timings.seconds[ STAGE_UPLOAD ] + timings.seconds[ STAGE_OVERLAY ] + timings.seconds[ STAGE_DRAW ];
+		if( ++_windowFrames < WINDOW_FRAMES )
+			return false;
+		
+		double now = FrameRing::now();
+		// at most one change per window, detection first as it usually
+		// costs the most
+		bool changed = step( _detection, _detection.totalSeconds / _windowFrames, now );
+		if( !changed )
+			changed = step( _render, _render.totalSeconds / _windowFrames, now );
+		
+		_detection.totalSeconds = 0;
+		_render.totalSeconds = 0;
+		_windowFrames = 0;
+		return changed;
+	}
+	
+	bool QualityGovernor::step( Side &side, double meanSeconds, double now ) {
+		if( meanSeconds > HIGH_WATER * _budget ) {
+			side.windowsOver++;
+			side.windowsUnder = 0;
+		} else if( meanSeconds < LOW_WATER * _budget ) {
+			side.windowsUnder++;
+			side.windowsOver = 0;
+		} else {
+			side.windowsOver = 0;
+			side.windowsUnder = 0;
+		}
+		if( now - _lastChange < MIN_SECONDS_BETWEEN_CHANGES )
+			return false;
+		
+		unsigned int from = side.level;
+		if( side.windowsOver >= WINDOWS_TO_DEGRADE && side.level < side.maxLevel ) {
+			side.level++;
+			side.stepsDown++;
+			if( now - side.lastStepUp < RECOVERY_HOLD_SECONDS )
+				side.windowsToRecover = min( 2 * side.windowsToRecover, MAX_WINDOWS_TO_RECOVER );
+			else
+				side.windowsToRecover = WINDOWS_TO_RECOVER;
+		} else if( side.windowsUnder >= side.windowsToRecover && side.level > 0 ) {
+			side.level--;
+			side.stepsUp++;
+			side.lastStepUp = now;
+		} else {
+			return false;
+		}
+		
+		printf( "[governor]: %s %.1fms/frame against a %.1fms budget: level %u -> %u (%s)\n",
+				side.name, meanSeconds * 1000.0, _budget * 1000.0, from, side.level, describeLevel( side, side.level ).c_str() );
+		side.windowsOver = 0;
+		side.windowsUnder = 0;
+		_lastChange = now;
+		return true;
+	}
+	
+	string QualityGovernor::describeLevel( const Side &side, unsigned int level ) {
+		char description[64];
+		if( &side == &_detection )
+			sprintf( description, "scale %.2f, every %u frame%s", DETECTION_SCALES[level], DETECTION_INTERVALS[level],
+					 DETECTION_INTERVALS[level] > 1 ? "s" : "" );
+		else
+			sprintf( description, "overlays %s, model lod %u", level == 0 ? "on" : "off", level > 1 ? level - 1 : 0 );
+		return description;
+	}
+	
+	void QualityGovernor::printStats() {
+		printf( "[governor]: detection level %u (%s, %lu down %lu up)  render level %u (%s, %lu down %lu up)\n",
+				_detection.level, describeLevel( _detection, _detection.level ).c_str(), _detection.stepsDown, _detection.stepsUp,
+				_render.level, describeLevel( _render, _render.level ).c_str(), _render.stepsDown, _render.stepsUp );
+	}
@@ -0,0 +1,63 @@
+#ifndef _QUALITY_GOVERNOR_H_
+#define _QUALITY_GOVERNOR_H_ 1
+
+#include "FrameProfiler.h"
+
+#include <string>
+using namespace std;
+
+
+
+	/* holds a target frame rate by trading quality for time: watches the */
+	/* displayed frames' stage timings and steps detection (resolution, */
+	/* then frequency) and rendering (overlays, then model detail) down a */
+	/* ladder when their share of the frame budget runs over, and back up */
+	/* once there is clear headroom; every step is logged */
+	class QualityGovernor {
+	public:
+		QualityGovernor( double targetFps = 30.0 );
+		
+		void setTargetFps( double targetFps );
+		/* levels of model detail available; 1 means only the full model */
+		void setNumModelLods( unsigned int numModelLods );
+		
+		/* call once per displayed frame; true when a setting changed */
+		bool update( const FrameTimings &timings );
+		
+		float getDetectionScale();
+		unsigned int getDetectionInterval();
+		unsigned int getModelLod();
+		bool getOverlays();
+		
+		void printStats();
+		
+	private:
+		/* one side of the frame: which stages it pays for, and where on */
+		/* its ladder it stands */
+		struct Side {
+			const char *name;
+			unsigned int level;
+			unsigned int maxLevel;
+			double totalSeconds;		// this window's stage time
+			unsigned int windowsOver;	// consecutive windows above the high water mark
+			unsigned int windowsUnder;	// consecutive windows below the low water mark
+			unsigned int windowsToRecover;	// grows each time a step up doesn't hold
+			double lastStepUp;
+			unsigned long stepsDown;
+			unsigned long stepsUp;
+		};
+		
+		double _budget;					// seconds per frame
+		unsigned int _numModelLods;
+		unsigned int _windowFrames;
+		double _lastChange;
+		
+		Side _detection;
+		Side _render;
+		
+		bool step( Side &side, double meanSeconds, double now );
+		string describeLevel( const Side &side, unsigned int level );
+	};
+
+
+#endif
@@ -0,0 +1,333 @@
+#include "SquarePoseSolver.h"
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <math.h>
+
+
+	/* marker corners in the marker's own frame, as aruco orders them: top */
+	/* left, top right, bottom right, bottom left, z = 0; times half the side */
+	static const double OBJECT_X[4] = { -1, 1, 1, -1 };
+	static const double OBJECT_Y[4] = { 1, 1, -1, -1 };
+
+	SquarePoseSolver::SquarePoseSolver() {
+		_fx = _fy = 1;
+		_cx = _cy = 0;
+		_halfLength = 0.5;
+		_refine = false;
+	}
+
+	void SquarePoseSolver::setCamera( cv::Mat cameraMatrix, cv::Mat distCoeffs, float markerLength ) {
+		cameraMatrix.convertTo( _cameraMatrix, CV_64F );
+		_fx = _cameraMatrix.at< double >( 0, 0 );
+		_fy = _cameraMatrix.at< double >( 1, 1 );
+		_cx = _cameraMatrix.at< double >( 0, 2 );
+		_cy = _cameraMatrix.at< double >( 1, 2 );
+		_distCoeffs = !distCoeffs.empty() && cv::countNonZero( distCoeffs ) > 0 ? distCoeffs : cv::Mat();
+		_halfLength = 0.5 * markerLength;
+	}
+
+	void SquarePoseSolver::setRefinement( bool refine ) { _refine = refine; }
+
+	/* closed-form log of a rotation matrix; cv::Rodrigues allocates */
+	static cv::Vec3d rotationToVector( const cv::Matx33d &R ) {
+		double cosAngle = 0.5 * ( R( 0, 0 ) + R( 1, 1 ) + R( 2, 2 ) - 1.0 );
+		cosAngle = cosAngle > 1.0 ? 1.0 : ( cosAngle < -1.0 ? -1.0 : cosAngle );
+		double angle = acos( cosAngle );
+		cv::Vec3d axis( R( 2, 1 ) - R( 1, 2 ), R( 0, 2 ) - R( 2, 0 ), R( 1, 0 ) - R( 0, 1 ) );
+		if( angle < 1e-6 )
+			return 0.5 * axis;
+		if( angle > M_PI - 1e-4 ) {
+			// near a half turn the skew part vanishes; take the axis from
+			// the diagonal instead
+			cv::Vec3d rvec;
+			cv::Rodrigues( R, rvec );
+			return rvec;
+		}
+		return axis * ( angle / ( 2.0 * sin( angle ) ) );
+	}
+
+	static cv::Matx33d vectorToRotation( const cv::Vec3d &rvec ) {
+		double angle = sqrt( rvec.dot( rvec ) );
+		if( angle < 1e-12 )
+			return cv::Matx33d::eye();
+		cv::Vec3d u = rvec * ( 1.0 / angle );
+		double c = cos( angle ), s = sin( angle ), v = 1.0 - c;
+		return cv::Matx33d( c + u[0]*u[0]*v,      u[0]*u[1]*v - u[2]*s, u[0]*u[2]*v + u[1]*s,
+							u[1]*u[0]*v + u[2]*s, c + u[1]*u[1]*v,      u[1]*u[2]*v - u[0]*s,
+							u[2]*u[0]*v - u[1]*s, u[2]*u[1]*v + u[0]*s, c + u[2]*u[2]*v );
+	}
+
+	/*
+	 * Heckbert's square-to-quad projective mapping: the homography taking
+	 * (0,0), (1,0), (1,1), (0,1) to the four points, with no linear solve.
+	 */
+	static cv::Matx33d squareToQuad( const double x[4], const double y[4] ) {
+		double sx = x[0] - x[1] + x[2] - x[3];
+		double sy = y[0] - y[1] + y[2] - y[3];
+		double dx1 = x[1] - x[2], dx2 = x[3] - x[2];
+		double dy1 = y[1] - y[2], dy2 = y[3] - y[2];
+		double den = dx1 * dy2 - dx2 * dy1;
+		double g = 0, h = 0;
+		if( fabs( den ) > 1e-15 ) {
+			g = ( sx * dy2 - dx2 * sy ) / den;
+			h = ( dx1 * sy - sx * dy1 ) / den;
+		}
+		return cv::Matx33d( x[1] - x[0] + g * x[1], x[3] - x[0] + h * x[3], x[0],
+							y[1] - y[0] + g * y[1], y[3] - y[0] + h * y[3], y[0],
+							g,                      h,                      1.0 );
+	}
+
+	/* the rotation taking the direction of (p, q, 1) onto the z axis */
+	static cv::Matx33d rotateToZAxis( double p, double q ) {
+		double norm = sqrt( p * p + q * q + 1.0 );
+		double ax = p / norm, ay = q / norm, c = 1.0 / norm;
+		double d = 1.0 / ( 1.0 + c );
+		return cv::Matx33d( 1.0 - ax * ax * d, -ax * ay * d,      -ax,
+							-ax * ay * d,      1.0 - ay * ay * d, -ay,
+							ax,                ay,                1.0 - ( ax * ax + ay * ay ) * d );
+	}
+
+	/*
+	 * IPPE: the homography's Jacobian J at the marker centre, seen along
+	 * the ray (p, q, 1) through that centre, fixes the first two columns of
+	 * the rotation up to the sign of their z components.  Both signs are
+	 * returned; the two poses are the planar ambiguity and one reprojects
+	 * better than the other.  False if J is degenerate.
+	 */
+	static bool ippeRotations( double j00, double j01, double j10, double j11, double p, double q,
+							   cv::Matx33d &R1, cv::Matx33d &R2 ) {
+		cv::Matx33d Rv = rotateToZAxis( p, q ).t();
+
+		double b00 = Rv( 0, 0 ) - p * Rv( 2, 0 ), b01 = Rv( 0, 1 ) - p * Rv( 2, 1 );
+		double b10 = Rv( 1, 0 ) - q * Rv( 2, 0 ), b11 = Rv( 1, 1 ) - q * Rv( 2, 1 );
+		double det = b00 * b11 - b01 * b10;
+		if( fabs( det ) < 1e-15 )
+			return false;
+		double binv00 = b11 / det, binv01 = -b01 / det, binv10 = -b10 / det, binv11 = b00 / det;
+
+		double a00 = binv00 * j00 + binv01 * j10, a01 = binv00 * j01 + binv01 * j11;
+		double a10 = binv10 * j00 + binv11 * j10, a11 = binv10 * j01 + binv11 * j11;
+
+		// the largest singular value of A scales it back to a rotation's
+		double ata00 = a00 * a00 + a01 * a01;
+		double ata01 = a00 * a10 + a01 * a11;
+		double ata11 = a10 * a10 + a11 * a11;
+		double gamma = sqrt( 0.5 * ( ata00 + ata11 + sqrt( ( ata00 - ata11 ) * ( ata00 - ata11 ) + 4.0 * ata01 * ata01 ) ) );
+		if( gamma < 1e-12 )
+			return false;
+
+		double r00 = a00 / gamma, r01 = a01 / gamma, r10 = a10 / gamma, r11 = a11 / gamma;
+		double b0 = sqrt( max( 0.0, 1.0 - r00 * r00 - r10 * r10 ) );
+		double b1 = sqrt( max( 0.0, 1.0 - r01 * r01 - r11 * r11 ) );
+		if( -r00 * r01 - r10 * r11 < 0 )
+			b1 = -b1;
+
+		for( int solution = 0; solution < 2; solution++ ) {
+			double sign = solution == 0 ? 1.0 : -1.0;
+			cv::Vec3d column0( r00, r10, sign * b0 );
+			cv::Vec3d column1( r01, r11, sign * b1 );
+			cv::Vec3d column2 = column0.cross( column1 );
+			cv::Matx33d local( column0[0], column1[0], column2[0],
+							   column0[1], column1[1], column2[1],
+							   column0[2], column1[2], column2[2] );
+			( solution == 0 ? R1 : R2 ) = Rv * local;
+		}
+		return true;
+	}
+
+	/*
+	 * With the rotation fixed each corner gives two equations linear in t:
+	 *   tx - u tz = u (R X)z - (R X)x,   ty - v tz = v (R X)z - (R X)y
+	 * solved in the least squares sense through the 3x3 normal equations.
+	 */
+	static cv::Vec3d solveTranslation( const double u[4], const double v[4], double halfLength, const cv::Matx33d &R ) {
+		double n00 = 0, n02 = 0, n11 = 0, n12 = 0, n22 = 0;
+		double r0 = 0, r1 = 0, r2 = 0;
+		for( int c = 0; c < 4; c++ ) {
+			double X = OBJECT_X[c] * halfLength, Y = OBJECT_Y[c] * halfLength;
+			double px = R( 0, 0 ) * X + R( 0, 1 ) * Y;
+			double py = R( 1, 0 ) * X + R( 1, 1 ) * Y;
+			double pz = R( 2, 0 ) * X + R( 2, 1 ) * Y;
+			double bx = u[c] * pz - px, by = v[c] * pz - py;
+			n00 += 1;      n02 -= u[c];
+			n11 += 1;      n12 -= v[c];
+			n22 += u[c] * u[c] + v[c] * v[c];
+			r0 += bx;
+			r1 += by;
+			r2 -= u[c] * bx + v[c] * by;
+		}
+		// N = [ n00 0 n02; 0 n11 n12; n02 n12 n22 ], eliminate tx and ty
+		double s = n22 - n02 * n02 / n00 - n12 * n12 / n11;
+		double tz = ( r2 - n02 * r0 / n00 - n12 * r1 / n11 ) / s;
+		return cv::Vec3d( ( r0 - n02 * tz ) / n00, ( r1 - n12 * tz ) / n11, tz );
+	}
+
+	double SquarePoseSolver::squaredError( const double u[4], const double v[4], const cv::Matx33d &R, const cv::Vec3d &t ) {
+		double error = 0;
+		for( int c = 0; c < 4; c++ ) {
+			double X = OBJECT_X[c] * _halfLength, Y = OBJECT_Y[c] * _halfLength;
+			double px = R( 0, 0 ) * X + R( 0, 1 ) * Y + t[0];
+			double py = R( 1, 0 ) * X + R( 1, 1 ) * Y + t[1];
+			double pz = R( 2, 0 ) * X + R( 2, 1 ) * Y + t[2];
+			double du = ( px / pz - u[c] ) * _fx, dv = ( py / pz - v[c] ) * _fy;
+			error += du * du + dv * dv;
+		}
+		return error;
+	}
+
+	void SquarePoseSolver::solveMarker( const double u[4], const double v[4], cv::Matx33d &rotation, cv::Vec3d &translation ) {
+		// plane to image: the unit square's homography after mapping the
+		// marker's corners onto the unit square's
+		cv::Matx33d toSquare( 0.5 / _halfLength, 0,                    0.5,
+							  0,                 -0.5 / _halfLength,   0.5,
+							  0,                 0,                    1 );
+		cv::Matx33d H = squareToQuad( u, v ) * toSquare;
+		H *= 1.0 / H( 2, 2 );
+
+		// the marker centre projects to (p, q); J is dH at the centre
+		double p = H( 0, 2 ), q = H( 1, 2 );
+		double j00 = H( 0, 0 ) - H( 2, 0 ) * p, j01 = H( 0, 1 ) - H( 2, 1 ) * p;
+		double j10 = H( 1, 0 ) - H( 2, 0 ) * q, j11 = H( 1, 1 ) - H( 2, 1 ) * q;
+
+		cv::Matx33d R1, R2;
+		if( !ippeRotations( j00, j01, j10, j11, p, q, R1, R2 ) ) {
+			rotation = cv::Matx33d::eye();
+			translation = cv::Vec3d( 0, 0, -1 );
+			return;
+		}
+		cv::Vec3d t1 = solveTranslation( u, v, _halfLength, R1 );
+		cv::Vec3d t2 = solveTranslation( u, v, _halfLength, R2 );
+		if( squaredError( u, v, R1, t1 ) <= squaredError( u, v, R2, t2 ) ) {
+			rotation = R1;
+			translation = t1;
+		} else {
+			rotation = R2;
+			translation = t2;
+		}
+	}
+
+	/*
+	 * One Gauss-Newton step on the pixel reprojection error over the six
+	 * pose parameters, the rotation perturbed on the left: R <- exp(w) R.
+	 * The 6x6 normal equations are solved by Cholesky on the stack.
+	 */
+	void SquarePoseSolver::refine( const double u[4], const double v[4], cv::Matx33d &R, cv::Vec3d &t ) {
+		double JtJ[6][6] = { { 0 } }, Jtr[6] = { 0 };
+		for( int c = 0; c < 4; c++ ) {
+			double X = OBJECT_X[c] * _halfLength, Y = OBJECT_Y[c] * _halfLength;
+			double rx = R( 0, 0 ) * X + R( 0, 1 ) * Y;
+			double ry = R( 1, 0 ) * X + R( 1, 1 ) * Y;
+			double rz = R( 2, 0 ) * X + R( 2, 1 ) * Y;
+			double px = rx + t[0], py = ry + t[1], pz = rz + t[2];
+			double iz = 1.0 / pz;
+			double residual[2] = { ( px * iz - u[c] ) * _fx, ( py * iz - v[c] ) * _fy };
+
+			// d(projection)/dP, then dP/dw = -[RX]x and dP/dt = I
+			double du[3] = { _fx * iz, 0, -_fx * px * iz * iz };
+			double dv[3] = { 0, _fy * iz, -_fy * py * iz * iz };
+			double J[2][6] = {
+				{ ry * du[2] - rz * du[1], rz * du[0] - rx * du[2], rx * du[1] - ry * du[0], du[0], du[1], du[2] },
+				{ ry * dv[2] - rz * dv[1], rz * dv[0] - rx * dv[2], rx * dv[1] - ry * dv[0], dv[0], dv[1], dv[2] } };
+			for( int row = 0; row < 2; row++ ) {
+				for( int i = 0; i < 6; i++ ) {
+					Jtr[i] += J[row][i] * residual[row];
+					for( int j = 0; j <= i; j++ )
+						JtJ[i][j] += J[row][i] * J[row][j];
+				}
+			}
+		}
+
+		// Cholesky: JtJ = L L^T in the lower triangle
+		for( int i = 0; i < 6; i++ ) {
+			for( int j = 0; j <= i; j++ ) {
+				double sum = JtJ[i][j];
+				for( int k = 0; k < j; k++ )
+					sum -= JtJ[i][k] * JtJ[j][k];
+				if( i == j ) {
+					if( sum <= 1e-18 )
+						return;				// a degenerate view; keep the closed-form pose
+					JtJ[i][i] = sqrt( sum );
+				} else {
+					JtJ[i][j] = sum / JtJ[j][j];
+				}
+			}
+		}
+		double delta[6];
+		for( int i = 0; i < 6; i++ ) {
+			double sum = -Jtr[i];
+			for( int k = 0; k < i; k++ )
+				sum -= JtJ[i][k] * delta[k];
+			delta[i] = sum / JtJ[i][i];
+		}
+		for( int i = 5; i >= 0; i-- ) {
+			double sum = delta[i];
+			for( int k = i + 1; k < 6; k++ )
+				sum -= JtJ[k][i] * delta[k];
+			delta[i] = sum / JtJ[i][i];
+		}
+
+		cv::Matx33d stepR = vectorToRotation( cv::Vec3d( delta[0], delta[1], delta[2] ) ) * R;
+		cv::Vec3d stepT = t + cv::Vec3d( delta[3], delta[4], delta[5] );
+		if( squaredError( u, v, stepR, stepT ) < squaredError( u, v, R, t ) ) {
+			R = stepR;
+			t = stepT;
+		}
+	}
+
+	/* pixels to normalised coordinates for every corner of every marker */
+	void SquarePoseSolver::normalise( const vector< vector< cv::Point2f > > &corners ) {
+		unsigned int n = corners.size();
+		for( int c = 0; c < 4; c++ ) {
+			_u[c].resize( n );
+			_v[c].resize( n );
+		}
+		if( _distCoeffs.empty() ) {
+			double ifx = 1.0 / _fx, ify = 1.0 / _fy;
+			for( unsigned int m = 0; m < n; m++ ) {
+				for( int c = 0; c < 4; c++ ) {
+					_u[c][m] = ( corners[m][c].x - _cx ) * ifx;
+					_v[c][m] = ( corners[m][c].y - _cy ) * ify;
+				}
+			}
+			return;
+		}
+
+		_distorted.resize( 4 * n );
+		for( unsigned int m = 0; m < n; m++ )
+			for( int c = 0; c < 4; c++ )
+				_distorted[4*m + c] = corners[m][c];
+		cv::undistortPoints( _distorted, _undistorted, _cameraMatrix, _distCoeffs );
+		for( unsigned int m = 0; m < n; m++ ) {
+			for( int c = 0; c < 4; c++ ) {
+				_u[c][m] = _undistorted[4*m + c].x;
+				_v[c][m] = _undistorted[4*m + c].y;
+			}
+		}
+	}
+
+	void SquarePoseSolver::solve( const vector< vector< cv::Point2f > > &corners, vector< cv::Vec3d > &rvecs, vector< cv::Vec3d > &tvecs ) {
+		unsigned int n = corners.size();
+		rvecs.resize( n );
+		tvecs.resize( n );
+		normalise( corners );
+
+		for( unsigned int m = 0; m < n; m++ ) {
+			double u[4] = { _u[0][m], _u[1][m], _u[2][m], _u[3][m] };
+			double v[4] = { _v[0][m], _v[1][m], _v[2][m], _v[3][m] };
+			cv::Matx33d rotation;
+			solveMarker( u, v, rotation, tvecs[m] );
+			if( _refine )
+				refine( u, v, rotation, tvecs[m] );
+			rvecs[m] = rotationToVector( rotation );
+		}
+	}
+
+	double SquarePoseSolver::getReprojectionError( const vector< cv::Point2f > &corners, const cv::Vec3d &rvec, const cv::Vec3d &tvec ) {
+		vector< vector< cv::Point2f > > one( 1, corners );
+		normalise( one );
+		double u[4] = { _u[0][0], _u[1][0], _u[2][0], _u[3][0] };
+		double v[4] = { _v[0][0], _v[1][0], _v[2][0], _v[3][0] };
+		return sqrt( squaredError( u, v, vectorToRotation( rvec ), tvec ) / 4.0 );
+	}
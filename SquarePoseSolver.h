@@ -0,0 +1,54 @@
+#ifndef _SQUARE_POSE_SOLVER_H_
+#define _SQUARE_POSE_SOLVER_H_ 1
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+using namespace std;
+
+
+
+	/* how single-marker poses are solved: OpenCV's iterative solvePnP per */
+	/* marker, or SquarePoseSolver with or without its refinement step */
+	enum PoseMethod { POSE_ITERATIVE, POSE_IPPE, POSE_IPPE_REFINED };
+
+	/* poses of square markers of one known size, all of a frame's markers */
+	/* at once: a closed-form square-to-quad homography per marker, the */
+	/* IPPE planar pose from it (Collins & Bartoli, 2014), and optionally */
+	/* one Gauss-Newton step on the reprojection error; a drop-in for */
+	/* cv::aruco::estimatePoseSingleMarkers, with the same object frame */
+	class SquarePoseSolver {
+	public:
+		SquarePoseSolver();
+
+		/* distCoeffs may be empty; otherwise the corners are undistorted, */
+		/* all in one call, before solving */
+		void setCamera( cv::Mat cameraMatrix, cv::Mat distCoeffs, float markerLength );
+		void setRefinement( bool refine );
+
+		void solve( const vector< vector< cv::Point2f > > &corners, vector< cv::Vec3d > &rvecs, vector< cv::Vec3d > &tvecs );
+
+		/* RMS distance, in pixels, between the corners and the marker's */
+		/* corners reprojected from a pose; for comparing solvers */
+		double getReprojectionError( const vector< cv::Point2f > &corners, const cv::Vec3d &rvec, const cv::Vec3d &tvec );
+
+	private:
+		double _fx, _fy, _cx, _cy;
+		cv::Mat _cameraMatrix;
+		cv::Mat _distCoeffs;
+		double _halfLength;
+		bool _refine;
+
+		/* normalised image coordinates, structure of arrays: corner c of */
+		/* marker m is ( _u[c][m], _v[c][m] ) */
+		vector< double > _u[4], _v[4];
+		vector< cv::Point2f > _distorted, _undistorted;
+
+		void normalise( const vector< vector< cv::Point2f > > &corners );
+		void solveMarker( const double u[4], const double v[4], cv::Matx33d &rotation, cv::Vec3d &translation );
+		void refine( const double u[4], const double v[4], cv::Matx33d &rotation, cv::Vec3d &translation );
+		double squaredError( const double u[4], const double v[4], const cv::Matx33d &rotation, const cv::Vec3d &translation );
+	};
+
+
+#endif
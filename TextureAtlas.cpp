@@ -0,0 +1,205 @@
+#include "TextureAtlas.h"
+
+#include <GL/glu.h>
+
+#include <algorithm>
+
+
+	TextureAtlas::TextureAtlas( int pageSize, int padding ) {
+		_pageSize = pageSize;
+		_padding = padding;
+	}
+	
+	TextureAtlas::~TextureAtlas() {
+		if( !_pageHandles.empty() )
+			glDeleteTextures( _pageHandles.size(), &_pageHandles[0] );
+	}
+	
+	int TextureAtlas::addImage( const unsigned char *data, int width, int height, int channels ) {
+		if( width + 2*_padding > _pageSize || height + 2*_padding > _pageSize )
+			return -1;
+		
+		AtlasImage image;
+		image.width = width;
+		image.height = height;
+		image.page = -1;
+		image.x = image.y = 0;
+		image.rgba.resize( width*height*4 );
+		
+		for( int i = 0; i < width*height; i++ ) {
+			const unsigned char *src = data + i*channels;
+			unsigned char *dst = &image.rgba[i*4];
+			switch( channels ) {
+				case 1:	dst[0] = dst[1] = dst[2] = src[0];	dst[3] = 255;		break;
+				case 2:	dst[0] = dst[1] = dst[2] = src[0];	dst[3] = src[1];	break;
+				case 3:	dst[0] = src[0];	dst[1] = src[1];	dst[2] = src[2];	dst[3] = 255;		break;
+				default:	dst[0] = src[0];	dst[1] = src[1];	dst[2] = src[2];	dst[3] = src[3];	break;
+			}
+		}
+		
+		_images.push_back( image );
+		return _images.size() - 1;
+	}
+	
+	void TextureAtlas::removeImage( int image ) {
+		_images[image].page = -2;
+		vector< unsigned char >().swap( _images[image].rgba );
+	}
+	
+	static bool tallerImageFirst( const pair< int, int > &a, const pair< int, int > &b ) {
+		return a.first > b.first;
+	}
+	
+	void TextureAtlas::pack() {
+		_skylines.clear();
+		_pages.clear();
+		
+		// packing the tallest images first keeps the skyline flat
+		vector< pair< int, int > > order;
+		for( unsigned int i = 0; i < _images.size(); i++ )
+			if( _images[i].page != -2 )
+				order.push_back( pair< int, int >( _images[i].height, i ) );
+		stable_sort( order.begin(), order.end(), tallerImageFirst );
+		
+		for( unsigned int o = 0; o < order.size(); o++ ) {
+			AtlasImage &image = _images[ order[o].second ];
+			int width = image.width + 2*_padding;
+			int height = image.height + 2*_padding;
+			
+			int page = -1, node = -1, x = 0, y = 0;
+			for( unsigned int p = 0; p < _skylines.size() && page == -1; p++ ) {
+				if( findPosition( _skylines[p], width, height, node, x, y ) )
+					page = p;
+			}
+			
+			if( page == -1 ) {
+				SkylineNode ground = { 0, 0, _pageSize };
+				_skylines.push_back( vector< SkylineNode >( 1, ground ) );
+				_pages.push_back( vector< unsigned char >( _pageSize*_pageSize*4, 0 ) );
+				page = _skylines.size() - 1;
+				findPosition( _skylines[page], width, height, node, x, y );
+			}
+			
+			placeRect( _skylines[page], node, x, y, width, height );
+			image.page = page;
+			image.x = x + _padding;
+			image.y = y + _padding;
+			blit( image );
+		}
+	}
+	
+	/*
+	 * Find the lowest (then leftmost) spot on the skyline where a
+	 * width x height rectangle fits
+	 */
+	bool TextureAtlas::findPosition( vector< SkylineNode > &skyline, int width, int height, int &bestNode, int &bestX, int &bestY ) {
+		bool found = false;
+		
+		for( unsigned int i = 0; i < skyline.size(); i++ ) {
+			int x = skyline[i].x;
+			if( x + width > _pageSize )
+				break;
+			
+			// the rectangle rests on the highest node it spans
+			int y = 0, spanned = 0;
+			for( unsigned int j = i; j < skyline.size() && spanned < width; j++ ) {
+				y = max( y, skyline[j].y );
+				spanned += skyline[j].width;
+			}
+			if( y + height > _pageSize )
+				continue;
+			
+			if( !found || y < bestY || (y == bestY && x < bestX) ) {
+				found = true;
+				bestNode = i;
+				bestX = x;
+				bestY = y;
+			}
+		}
+		
+		return found;
+	}
+	
+	void TextureAtlas::placeRect( vector< SkylineNode > &skyline, int node, int x, int y, int width, int height ) {
+		SkylineNode top = { x, y + height, width };
+		skyline.insert( skyline.begin() + node, top );
+		
+		// trim or remove the nodes now hidden underneath the new one
+		for( unsigned int i = node + 1; i < skyline.size(); i++ ) {
+			int covered = top.x + top.width - skyline[i].x;
+			if( covered <= 0 )
+				break;
+			if( covered >= skyline[i].width ) {
+				skyline.erase( skyline.begin() + i );
+				i--;
+			} else {
+				skyline[i].x += covered;
+				skyline[i].width -= covered;
+				break;
+			}
+		}
+		
+		// merge neighbors at the same height
+		for( unsigned int i = 0; i + 1 < skyline.size(); i++ ) {
+			if( skyline[i].y == skyline[i+1].y ) {
+				skyline[i].width += skyline[i+1].width;
+				skyline.erase( skyline.begin() + i + 1 );
+				i--;
+			}
+		}
+	}
+	
+	/*
+	 * Copy an image into its page and repeat its edge pixels out into
+	 * the padding so filtering near the border stays inside the image
+	 */
+	void TextureAtlas::blit( const AtlasImage &image ) {
+		vector< unsigned char > &page = _pages[ image.page ];
+		
+		for( int py = -_padding; py < image.height + _padding; py++ ) {
+			int sy = min( max( py, 0 ), image.height - 1 );
+			for( int px = -_padding; px < image.width + _padding; px++ ) {
+				int sx = min( max( px, 0 ), image.width - 1 );
+				const unsigned char *src = &image.rgba[ (sy*image.width + sx)*4 ];
+				unsigned char *dst = &page[ ((image.y + py)*_pageSize + image.x + px)*4 ];
+				dst[0] = src[0];	dst[1] = src[1];	dst[2] = src[2];	dst[3] = src[3];
+			}
+		}
+	}
+	
+	void TextureAtlas::upload() {
+		_pageHandles.resize( _pages.size(), 0 );
+		if( _pages.empty() )
+			return;
+		
+		glGenTextures( _pages.size(), &_pageHandles[0] );
+		for( unsigned int p = 0; p < _pages.size(); p++ ) {
+			glBindTexture( GL_TEXTURE_2D, _pageHandles[p] );
+			
+			glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+			
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			
+			gluBuild2DMipmaps( GL_TEXTURE_2D, GL_RGBA, _pageSize, _pageSize, GL_RGBA, GL_UNSIGNED_BYTE, &_pages[p][0] );
+		}
+		
+		// the pixels live on the GPU now
+		_pages.clear();
+		for( unsigned int i = 0; i < _images.size(); i++ )
+			vector< unsigned char >().swap( _images[i].rgba );
+	}
+	
+	int TextureAtlas::getNumImages() { return _images.size(); }
+	int TextureAtlas::getNumPages() { return _skylines.size(); }
+	int TextureAtlas::getPage( int image ) { return _images[image].page; }
+	GLuint TextureAtlas::getPageHandle( int page ) { return _pageHandles[page]; }
+	
+	void TextureAtlas::remap( int image, GLfloat &s, GLfloat &t ) {
+		const AtlasImage &img = _images[image];
+		s = ( img.x + s*img.width ) / (GLfloat)_pageSize;
+		t = ( img.y + t*img.height ) / (GLfloat)_pageSize;
+	}
@@ -0,0 +1,65 @@
+#ifndef _TEXTURE_ATLAS_H_
+#define _TEXTURE_ATLAS_H_ 1
+
+#include <GL/glew.h>
+
+#include <vector>
+using namespace std;
+
+
+
+	/* packs many small RGBA images into a few large texture pages */
+	class TextureAtlas {
+	public:
+		/* pageSize is the width and height of each page, padding the border */
+		/* (in pixels) repeated around every image so mipmaps do not bleed */
+		TextureAtlas( int pageSize = 2048, int padding = 8 );
+		~TextureAtlas();
+		
+		/* copy an image with 1 to 4 channels into the atlas as RGBA */
+		/* returns the image index, or -1 if it can never fit on a page */
+		int addImage( const unsigned char *data, int width, int height, int channels );
+		
+		/* drop an image before packing; its index stays valid but unplaced */
+		void removeImage( int image );
+		
+		/* place every image with skyline bottom-left packing */
+		void pack();
+		
+		/* upload each page as a mipmapped texture */
+		void upload();
+		
+		int getNumImages();
+		int getNumPages();
+		int getPage( int image );
+		GLuint getPageHandle( int page );
+		
+		/* map a texture coordinate in [0,1] of an image into its page */
+		void remap( int image, GLfloat &s, GLfloat &t );
+		
+	private:
+		struct AtlasImage {
+			int width, height;
+			vector< unsigned char > rgba;
+			int page, x, y;
+		};
+		
+		struct SkylineNode {
+			int x, y, width;
+		};
+		
+		int _pageSize;
+		int _padding;
+		
+		vector< AtlasImage > _images;
+		vector< vector< SkylineNode > > _skylines;
+		vector< vector< unsigned char > > _pages;
+		vector< GLuint > _pageHandles;
+		
+		bool findPosition( vector< SkylineNode > &skyline, int width, int height, int &bestNode, int &bestX, int &bestY );
+		void placeRect( vector< SkylineNode > &skyline, int node, int x, int y, int width, int height );
+		void blit( const AtlasImage &image );
+	};
+
+
+#endif
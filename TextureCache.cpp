@@ -0,0 +1,251 @@
+#include "TextureCache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <direct.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+	/* cache file layout: header, then each level's RGBA rows back to back */
+	struct TextureCacheHeader {
+		char magic[4];
+		unsigned int version;
+		unsigned int width;
+		unsigned int height;
+		unsigned int numLevels;
+		unsigned int reserved;
+	};
+
+	static const char CACHE_MAGIC[4] = { 'T', 'X', 'C', 'M' };
+	static const unsigned int CACHE_VERSION = 1;
+
+	static int countLevels( int width, int height ) {
+		int levels = 1;
+		while( width > 1 || height > 1 ) {
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+			levels++;
+		}
+		return levels;
+	}
+
+	static size_t chainSize( int width, int height ) {
+		size_t size = 0;
+		for( int level = countLevels( width, height ); level > 0; level-- ) {
+			size += (size_t)width * height * 4;
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+		}
+		return size;
+	}
+
+	TextureCache::TextureCache( string directory ) {
+		_directory = directory;
+		_mapping = NULL;
+		_mappingSize = 0;
+		_levels = NULL;
+		_width = _height = _numLevels = 0;
+		
+	#ifdef _WIN32
+		_mkdir( _directory.c_str() );
+	#else
+		mkdir( _directory.c_str(), 0755 );
+	#endif
+	}
+	
+	TextureCache::~TextureCache() {
+		release();
+	}
+	
+	bool TextureCache::hashFile( string filename, unsigned long long &key ) {
+		FILE *fp = fopen( filename.c_str(), "rb" );
+		if( fp == NULL )
+			return false;
+		
+		unsigned long long hash = 14695981039346656037ULL;
+		unsigned char buffer[65536];
+		size_t numRead;
+		while( (numRead = fread( buffer, 1, sizeof(buffer), fp )) > 0 ) {
+			for( size_t i = 0; i < numRead; i++ ) {
+				hash ^= buffer[i];
+				hash *= 1099511628211ULL;
+			}
+		}
+		fclose( fp );
+		
+		key = hash;
+		return true;
+	}
+	
+	string TextureCache::entryFilename( unsigned long long key ) {
+		char name[32];
+		sprintf( name, "/%016llx.mip", key );
+		return _directory + name;
+	}
+	
+	void TextureCache::release() {
+		if( _mapping != NULL ) {
+		#ifdef _WIN32
+			UnmapViewOfFile( _mapping );
+		#else
+			munmap( _mapping, _mappingSize );
+		#endif
+		}
+		_mapping = NULL;
+		_mappingSize = 0;
+		_built.clear();
+		_levels = NULL;
+		_width = _height = _numLevels = 0;
+	}
+	
+	bool TextureCache::lookup( unsigned long long key ) {
+		release();
+		
+		string filename = entryFilename( key );
+		
+	#ifdef _WIN32
+		HANDLE file = CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+		if( file == INVALID_HANDLE_VALUE )
+			return false;
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx( file, &fileSize );
+		HANDLE mappingHandle = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+		CloseHandle( file );
+		if( mappingHandle == NULL )
+			return false;
+		_mapping = MapViewOfFile( mappingHandle, FILE_MAP_READ, 0, 0, 0 );
+		CloseHandle( mappingHandle );
+		_mappingSize = (size_t)fileSize.QuadPart;
+	#else
+		int fd = open( filename.c_str(), O_RDONLY );
+		if( fd < 0 )
+			return false;
+		struct stat fileStat;
+		if( fstat( fd, &fileStat ) != 0 ) {
+			close( fd );
+			return false;
+		}
+		_mappingSize = fileStat.st_size;
+		_mapping = mmap( NULL, _mappingSize, PROT_READ, MAP_PRIVATE, fd, 0 );
+		close( fd );
+		if( _mapping == MAP_FAILED )
+			_mapping = NULL;
+	#endif
+		
+		if( _mapping == NULL || _mappingSize < sizeof(TextureCacheHeader) ) {
+			release();
+			return false;
+		}
+		
+		// reject entries written by another version or cut short
+		const TextureCacheHeader *header = (const TextureCacheHeader*)_mapping;
+		if( memcmp( header->magic, CACHE_MAGIC, 4 ) != 0 || header->version != CACHE_VERSION
+		   || header->width == 0 || header->height == 0
+		   || (int)header->numLevels != countLevels( header->width, header->height )
+		   || _mappingSize != sizeof(TextureCacheHeader) + chainSize( header->width, header->height ) ) {
+			release();
+			return false;
+		}
+		
+		_width = header->width;
+		_height = header->height;
+		_numLevels = header->numLevels;
+		_levels = (const unsigned char*)_mapping + sizeof(TextureCacheHeader);
+		return true;
+	}
+	
+	void TextureCache::store( unsigned long long key, const unsigned char *data, int width, int height, int channels ) {
+		release();
+		
+		_width = width;
+		_height = height;
+		_numLevels = countLevels( width, height );
+		_built.resize( chainSize( width, height ) );
+		
+		// level 0 is the image expanded to RGBA
+		unsigned char *level = &_built[0];
+		for( int i = 0; i < width*height; i++ ) {
+			const unsigned char *src = data + i*channels;
+			unsigned char *dst = level + i*4;
+			switch( channels ) {
+				case 1:	dst[0] = dst[1] = dst[2] = src[0];	dst[3] = 255;		break;
+				case 2:	dst[0] = dst[1] = dst[2] = src[0];	dst[3] = src[1];	break;
+				case 3:	dst[0] = src[0];	dst[1] = src[1];	dst[2] = src[2];	dst[3] = 255;		break;
+				default:	dst[0] = src[0];	dst[1] = src[1];	dst[2] = src[2];	dst[3] = src[3];	break;
+			}
+		}
+		
+		// every further level box filters the one above it
+		int w = width, h = height;
+		for( int l = 1; l < _numLevels; l++ ) {
+			unsigned char *next = level + (size_t)w*h*4;
+			int nw = w > 1 ? w / 2 : 1;
+			int nh = h > 1 ? h / 2 : 1;
+			for( int y = 0; y < nh; y++ ) {
+				int y0 = h > 1 ? y*2 : 0, y1 = h > 1 ? y*2 + 1 : 0;
+				for( int x = 0; x < nw; x++ ) {
+					int x0 = w > 1 ? x*2 : 0, x1 = w > 1 ? x*2 + 1 : 0;
+					for( int c = 0; c < 4; c++ ) {
+						int sum = level[(y0*w + x0)*4 + c] + level[(y0*w + x1)*4 + c]
+								+ level[(y1*w + x0)*4 + c] + level[(y1*w + x1)*4 + c];
+						next[(y*nw + x)*4 + c] = (unsigned char)( (sum + 2) / 4 );
+					}
+				}
+			}
+			level = next;
+			w = nw;
+			h = nh;
+		}
+		_levels = &_built[0];
+		
+		// write through a temporary file so a crash never leaves a torn entry
+		TextureCacheHeader header;
+		memcpy( header.magic, CACHE_MAGIC, 4 );
+		header.version = CACHE_VERSION;
+		header.width = width;
+		header.height = height;
+		header.numLevels = _numLevels;
+		header.reserved = 0;
+		
+		string filename = entryFilename( key );
+		string tempFilename = filename + ".tmp";
+		FILE *fp = fopen( tempFilename.c_str(), "wb" );
+		if( fp == NULL ) {
+			fprintf( stderr, "[.mip]: [ERROR]: could not write texture cache entry %s\n", tempFilename.c_str() );
+			return;
+		}
+		bool written = fwrite( &header, sizeof(header), 1, fp ) == 1
+					&& fwrite( &_built[0], _built.size(), 1, fp ) == 1;
+		fclose( fp );
+		
+		remove( filename.c_str() );
+		if( !written || rename( tempFilename.c_str(), filename.c_str() ) != 0 ) {
+			fprintf( stderr, "[.mip]: [ERROR]: could not write texture cache entry %s\n", filename.c_str() );
+			remove( tempFilename.c_str() );
+		}
+	}
+	
+	void TextureCache::upload() {
+		if( _levels == NULL )
+			return;
+		
+		const unsigned char *level = _levels;
+		int w = _width, h = _height;
+		for( int l = 0; l < _numLevels; l++ ) {
+			glTexImage2D( GL_TEXTURE_2D, l, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, level );
+			level += (size_t)w*h*4;
+			w = w > 1 ? w / 2 : 1;
+			h = h > 1 ? h / 2 : 1;
+		}
+	}
+	
+	const unsigned char* TextureCache::getBaseLevel() { return _levels; }
+	int TextureCache::getBaseWidth() { return _width; }
+	int TextureCache::getBaseHeight() { return _height; }
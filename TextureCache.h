@@ -0,0 +1,53 @@
+#ifndef _TEXTURE_CACHE_H_
+#define _TEXTURE_CACHE_H_ 1
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+
+
+	/* on-disk cache of decoded textures and their full mip chains, keyed by */
+	/* a hash of the source image file so edits to the file invalidate it */
+	class TextureCache {
+	public:
+		TextureCache( string directory = ".texcache" );
+		~TextureCache();
+		
+		/* 64-bit FNV-1a hash of a file's contents; false if it can't be read */
+		static bool hashFile( string filename, unsigned long long &key );
+		
+		/* map the cached mip chain for key into memory; false on a miss */
+		bool lookup( unsigned long long key );
+		
+		/* build the mip chain for a decoded 1 to 4 channel image, write it */
+		/* to the cache and make it the current entry */
+		void store( unsigned long long key, const unsigned char *data, int width, int height, int channels );
+		
+		/* upload every level of the current entry into the bound texture */
+		void upload();
+		
+		/* RGBA pixels of the current entry's full resolution level; valid */
+		/* until the next lookup() or store() */
+		const unsigned char* getBaseLevel();
+		int getBaseWidth();
+		int getBaseHeight();
+		
+	private:
+		string _directory;
+		
+		/* current entry: either a mapped cache file or freshly built levels */
+		void *_mapping;
+		size_t _mappingSize;
+		vector< unsigned char > _built;
+		const unsigned char *_levels;
+		int _width, _height, _numLevels;
+		
+		string entryFilename( unsigned long long key );
+		void release();
+	};
+
+
+#endif
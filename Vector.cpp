@@ -40,7 +40,7 @@
 		return Vector(a.getX()*f,a.getY()*f,a.getZ()*f);
 	}
 	
-	Vector operator*(Matrix m, Vector a) {
+	Vector operator*(const Matrix &m, Vector a) {
 		assert( (m.getNumRows() == 3 || m.getNumRows() == 4) && m.getNumCols() == 4 );
 		return Vector( m.get(0,0)*a.getX() + m.get(0,1)*a.getY() + m.get(0,2)*a.getZ() + m.get(0,3)*a.getW(),
 					   m.get(1,0)*a.getX() + m.get(1,1)*a.getY() + m.get(1,2)*a.getZ() + m.get(1,3)*a.getW(),
@@ -37,7 +37,7 @@
 	Vector operator*(Vector a, float f);
 	Vector operator/(Vector a, float f);
 	Vector operator*(float f, Vector a);
-	Vector operator*(Matrix m, Vector a);
+	Vector operator*(const Matrix &m, Vector a);
 	Vector operator+(Vector a, Vector b);
 	Vector operator-(Vector a, Vector b);
 	bool operator==(Vector a, Vector b);
@@ -0,0 +1,104 @@
+#include "WorkerPool.h"
+
+#include <stdio.h>
+
+
+	WorkerPool::WorkerPool( unsigned int numThreads ) {
+		if( numThreads == 0 )
+			numThreads = std::thread::hardware_concurrency();
+		if( numThreads == 0 )
+			numThreads = 2;
+		
+		_nextWorker = 0;
+		_pending = 0;
+		_running = true;
+		
+		for( unsigned int i = 0; i < numThreads; i++ ) {
+			Worker *worker = new Worker();
+			worker->executed = 0;
+			worker->stolen = 0;
+			_workers.push_back( worker );
+		}
+		for( unsigned int i = 0; i < numThreads; i++ )
+			_workers[i]->thread = std::thread( &WorkerPool::run, this, i );
+	}
+	
+	WorkerPool::~WorkerPool() {
+		{
+			std::lock_guard< std::mutex > lock( _idleMutex );
+			_running = false;
+		}
+		_idle.notify_all();
+		for( unsigned int i = 0; i < _workers.size(); i++ ) {
+			_workers[i]->thread.join();
+			delete _workers[i];
+		}
+	}
+	
+	unsigned int WorkerPool::getNumThreads() { return _workers.size(); }
+	
+	void WorkerPool::submit( std::function< void() > task ) {
+		Worker *worker = _workers[ _nextWorker++ % _workers.size() ];
+		{
+			std::lock_guard< std::mutex > lock( worker->mutex );
+			worker->tasks.push_back( std::move( task ) );
+		}
+		{
+			std::lock_guard< std::mutex > lock( _idleMutex );
+			_pending++;
+		}
+		_idle.notify_one();
+	}
+	
+	/*
+	 * A worker runs its own queue first, then tries every other queue in
+	 * turn.  Both take the oldest task: tasks here are whole frames, and
+	 * running them in submission order is what keeps sessions fair.
+	 */
+	bool WorkerPool::takeTask( unsigned int index, std::function< void() > &task ) {
+		for( unsigned int i = 0; i < _workers.size(); i++ ) {
+			Worker *worker = _workers[ ( index + i ) % _workers.size() ];
+			std::lock_guard< std::mutex > lock( worker->mutex );
+			if( worker->tasks.empty() )
+				continue;
+			task = std::move( worker->tasks.front() );
+			worker->tasks.pop_front();
+			if( i > 0 )
+				_workers[ index ]->stolen++;
+			return true;
+		}
+		return false;
+	}
+	
+	void WorkerPool::run( unsigned int index ) {
+		std::function< void() > task;
+		
+		while( true ) {
+			{
+				std::unique_lock< std::mutex > lock( _idleMutex );
+				_idle.wait( lock, [this] { return !_running || _pending > 0; } );
+				if( !_running )
+					return;
+				_pending--;
+			}
+			
+			// each pending count is added after its task is queued, so there
+			// is always one to find
+			if( !takeTask( index, task ) )
+				continue;
+			
+			task();
+			task = nullptr;
+			_workers[ index ]->executed++;
+		}
+	}
+	
+	void WorkerPool::printStats() {
+		printf( "[pool]: %u workers", (unsigned int)_workers.size() );
+		for( unsigned int i = 0; i < _workers.size(); i++ ) {
+			printf( "  #%u ran %lu (stole %lu)", i, (unsigned long)_workers[i]->executed, (unsigned long)_workers[i]->stolen );
+			_workers[i]->executed = 0;
+			_workers[i]->stolen = 0;
+		}
+		printf( "\n" );
+	}
@@ -0,0 +1,53 @@
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_ 1
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+
+
+	/* a fixed set of threads, each with its own task queue; submitted */
+	/* tasks are dealt out round-robin and a worker whose queue runs dry */
+	/* steals from the others, so no thread idles while work is queued */
+	class WorkerPool {
+	public:
+		/* numThreads 0 means one per hardware thread */
+		WorkerPool( unsigned int numThreads = 0 );
+		~WorkerPool();
+		
+		void submit( std::function< void() > task );
+		
+		unsigned int getNumThreads();
+		
+		void printStats();
+		
+	private:
+		struct Worker {
+			std::mutex mutex;
+			std::deque< std::function< void() > > tasks;
+			std::thread thread;
+			std::atomic< unsigned long > executed;
+			std::atomic< unsigned long > stolen;
+		};
+		
+		vector< Worker* > _workers;
+		std::atomic< unsigned int > _nextWorker;
+		std::atomic< bool > _running;
+		
+		// idle workers sleep here until a task is submitted
+		std::mutex _idleMutex;
+		std::condition_variable _idle;
+		std::atomic< unsigned int > _pending;
+		
+		void run( unsigned int index );
+		bool takeTask( unsigned int index, std::function< void() > &task );
+	};
+
+
+#endif
@@ -15,6 +15,18 @@
 #include <GL/glu.h>
 
 
+#include "AllocationCounter.h"
+#include "ArSession.h"
+#include "CaptureThread.h"
+#include "DetectionPipeline.h"
+#include "DetectorProfile.h"
+#include "FrameProfiler.h"
+#include "FrameRing.h"
+#include "FrameScheduler.h"
+#include "InstanceRenderer.h"
+#include "PoseFilter.h"
+#include "QualityGovernor.h"
+#include "WorkerPool.h"
 #include "Object.h"
 #define M_PI   3.14159265358979323846264338327950288
 #define KEY_ESCAPE                  27
@@ -29,6 +41,15 @@ GLvoid OnReshape(GLint w, GLint h);
 GLvoid OnKeyPress(unsigned char key, GLint x, GLint y);
 GLvoid OnIdle();
 
+void uploadFrame();
+void reportLatency();
+void drawHud();
+void drawOverlays();
+void applyGovernor();
+
+Object* modelForMarker(int markerId);
+void markerPoseToModelView(const cv::Vec3d &rvec, const cv::Vec3d &tvec, GLfloat modelView[16]);
+
 
 int windowWidth = 512, windowHeight = 512;
 GLint g_hWindow;
@@ -39,10 +60,12 @@ GLint g_hWindow;
 cv::Ptr<cv::aruco::Dictionary> dictionary = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_100);
 cv::Ptr<cv::aruco::DetectorParameters> detectorParams = cv::aruco::DetectorParameters::create();
 
-std::vector< int > markerIds;
-std::vector< std::vector<cv::Point2f> > markerCorners, rejectedCandidates;
-
-cv::VideoCapture cap(0);
+std::vector< ArSession* > sessions;         // one per camera: capture -> detect/pose, feeding the renderer
+unsigned int displayedSession = 0;          // cycled with 'c'
+WorkerPool *workerPool = NULL;              // shared detection threads when there are several cameras
+FrameResult currentFrame;                   // the frame being displayed
+GLuint videoTexture = 0;
+int videoTextureWidth = 0, videoTextureHeight = 0;
 
 double K_[3][3] =
 { { 675, 0, 320 },
@@ -53,11 +76,30 @@ const float markerLength = 1.75;
 // Distortion coeffs (fill in your actual values here).
 double dist_[] = { 0, 0, 0, 0, 0 };
 cv::Mat distCoeffs = cv::Mat(5, 1, CV_64F, dist_).clone();
-cv::Mat imageMat;
-
-Mat viewMatrix = cv::Mat::zeros(4, 4, CV_32F);
 
-Object *obj;                                // actual object
+Object *defaultModel;                       // drawn on every marker without its own model
+std::map< std::string, Object* > loadedModels;  // filename -> model, each loaded once
+std::map< int, Object* > markerModels;      // marker id -> model overrides
+InstanceRenderer instances;                 // this frame's (model, pose) list
+PoseFilterSet poseFilters;                  // smooths and predicts marker poses
+bool filterPoses = false;
+std::vector< int > filteredIds;             // reused every frame
+std::vector< cv::Vec3d > filteredRvecs, filteredTvecs;
+
+FrameScheduler scheduler;                   // wakes the render loop
+bool printStats = false;
+bool printLatency = false;                  // report each displayed frame's latency
+double latencyTotal = 0;
+unsigned long latencyFrames = 0;
+FrameProfiler profiler;                     // per-stage timings of displayed frames
+bool showHud = false;                       // toggled with 'h'
+bool showOverlays = true;                   // marker outlines and axes, toggled with 'o'
+QualityGovernor *governor = NULL;           // trades quality for frame rate, with --governor
+int detectionInterval = 1;                  // --detect-every, before the governor's share
+std::vector< std::string > hudLines;
+unsigned long hudFrames = 0;
+unsigned long long renderAllocations = 0;   // with COUNT_ALLOCATIONS
+unsigned long renderFrames = 0;
 
 using namespace std;
 
@@ -72,11 +114,225 @@ int main(int argc, char* argv[])
 
 	g_hWindow = glutCreateWindow("Video Texture");
 
-	obj = new Object(argv[1]);
+	// options start with "--", everything else names a model
+	bool useTextureAtlas = false;
+	TextureCache *textureCache = NULL;
+	unsigned int pipelineDepth = 2;
+	std::vector< std::string > inputs;
+	int numWorkers = -1;
+	std::vector< CameraCalibration* > calibrations;
+	unsigned int numModelLods = 4;
+	bool undistortFrames = false;
+	CaptureThread::ReplayMode replayMode = CaptureThread::REPLAY_PACED;
+	bool loopReplay = false;
+	double imageFps = 30.0;
+	int roiInterval = 0;
+	int flowInterval = 0;
+	int boardX = 0, boardY = 0;
+	float boardMarkerLength = 0, boardSeparation = 0, charucoSquareLength = 0;
+	bool charuco = false;
+	float pyramidMinMarker = 0;
+	int pyramidCompare = 0;
+	PoseMethod poseMethod = POSE_ITERATIVE;
+	float modelRotation[3] = { 0, 0, 0 }, modelScale = 1;
+	bool transformModels = false;
+	std::vector< std::string > modelArgs;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--atlas")
+			useTextureAtlas = true;
+		else if (arg == "--texture-cache")
+			textureCache = new TextureCache();
+		else if (arg.compare(0, 16, "--texture-cache=") == 0)
+			textureCache = new TextureCache(arg.substr(16));
+		else if (arg.compare(0, 14, "--display-fps=") == 0)
+			scheduler.setDisplayFps(atof(arg.substr(14).c_str()));
+		else if (arg == "--stats")
+			printStats = true;
+		else if (arg.compare(0, 8, "--input=") == 0)
+			inputs.push_back(arg.substr(8));
+		else if (arg.compare(0, 14, "--calibration=") == 0) {
+			CameraCalibration *calibration = new CameraCalibration(K, distCoeffs);
+			if (!calibration->load(arg.substr(14)))
+				return 1;
+			calibrations.push_back(calibration);
+		}
+		else if (arg == "--undistort")
+			undistortFrames = true;
+		else if (arg.compare(0, 10, "--workers=") == 0)
+			numWorkers = atoi(arg.substr(10).c_str());
+		else if (arg == "--replay=fast")
+			replayMode = CaptureThread::REPLAY_FAST;
+		else if (arg == "--replay=paced")
+			replayMode = CaptureThread::REPLAY_PACED;
+		else if (arg == "--loop")
+			loopReplay = true;
+		else if (arg.compare(0, 12, "--image-fps=") == 0)
+			imageFps = atof(arg.substr(12).c_str());
+		else if (arg == "--governor")
+			governor = new QualityGovernor();
+		else if (arg.compare(0, 11, "--governor=") == 0)
+			governor = new QualityGovernor(atof(arg.substr(11).c_str()));
+		else if (arg.compare(0, 18, "--model-transform=") == 0) {
+			sscanf(arg.c_str() + 18, "%f,%f,%f,%f", &modelRotation[0], &modelRotation[1], &modelRotation[2], &modelScale);
+			transformModels = true;
+		}
+		else if (arg.compare(0, 13, "--model-lods=") == 0)
+			numModelLods = atoi(arg.substr(13).c_str());
+		else if (arg == "--no-overlays")
+			showOverlays = false;
+		else if (arg == "--hud")
+			showHud = true;
+		else if (arg.compare(0, 13, "--timing-log=") == 0) {
+			if (!profiler.openLog(arg.substr(13)))
+				return 1;
+		}
+		else if (arg == "--latency")
+			printLatency = true;
+		else if (arg.compare(0, 17, "--pipeline-depth=") == 0)
+			pipelineDepth = atoi(arg.substr(17).c_str());
+		else if (arg == "--roi")
+			roiInterval = 15;
+		else if (arg.compare(0, 6, "--roi=") == 0)
+			roiInterval = atoi(arg.substr(6).c_str());
+		else if (arg == "--filter")
+			filterPoses = true;
+		else if (arg.compare(0, 15, "--detect-every=") == 0)
+			detectionInterval = atoi(arg.substr(15).c_str());
+		else if (arg == "--flow")
+			flowInterval = 10;
+		else if (arg.compare(0, 7, "--flow=") == 0)
+			flowInterval = atoi(arg.substr(7).c_str());
+		else if (arg.compare(0, 8, "--board=") == 0)
+			sscanf(arg.c_str() + 8, "%dx%d,%f,%f", &boardX, &boardY, &boardMarkerLength, &boardSeparation);
+		else if (arg.compare(0, 10, "--charuco=") == 0) {
+			sscanf(arg.c_str() + 10, "%dx%d,%f,%f", &boardX, &boardY, &charucoSquareLength, &boardMarkerLength);
+			charuco = true;
+		}
+		else if (arg.compare(0, 19, "--detector-profile=") == 0) {
+			detectorParams = DetectorProfile::loadSpec(arg.substr(19));
+			if (detectorParams.empty())
+				return 1;
+		}
+		else if (arg == "--pyramid")
+			pyramidMinMarker = 48;
+		else if (arg.compare(0, 10, "--pyramid=") == 0)
+			pyramidMinMarker = atof(arg.substr(10).c_str());
+		else if (arg == "--pyramid-compare")
+			pyramidCompare = 30;
+		else if (arg == "--pose-solver=iterative")
+			poseMethod = POSE_ITERATIVE;
+		else if (arg == "--pose-solver=ippe")
+			poseMethod = POSE_IPPE;
+		else if (arg == "--pose-solver=ippe-refine")
+			poseMethod = POSE_IPPE_REFINED;
+		else
+			modelArgs.push_back(arg);
+	}
+	if (modelArgs.empty()) {
+		cerr << "usage: " << argv[0] << " [options] <model file> [<markerId>=<model file> ...]" << endl
+			<< "  input:     [--input=<camera index | video file | image directory> ...] [--replay=paced|fast] [--loop] [--image-fps=<fps>]" << endl
+			<< "  camera:    [--calibration=<file.yml> ...] [--undistort]" << endl
+			<< "  models:    [--atlas] [--texture-cache[=<dir>]] [--model-transform=<x deg>,<y deg>,<z deg>[,<scale>]]" << endl
+			<< "  pipeline:  [--display-fps=<fps>] [--pipeline-depth=<frames>] [--detect-every=<frames>] [--filter] [--workers=<threads>] [--no-overlays]" << endl
+			<< "             [--governor[=<target fps>]] [--model-lods=<levels>]" << endl
+			<< "  detection: [--detector-profile=<profiles.yml>[:fast|balanced|robust]]" << endl
+			<< "             [--roi[=<full-frame interval>]] [--pyramid[=<min marker pixels>]] [--pyramid-compare] [--flow[=<detection interval>]]" << endl
+			<< "             [--pose-solver=iterative|ippe|ippe-refine]" << endl
+			<< "             [--board=<X>x<Y>,<marker length>,<separation> | --charuco=<X>x<Y>,<square length>,<marker length>]" << endl
+			<< "  reporting: [--stats] [--latency] [--hud] [--timing-log=<file.csv | file.jsonl>]" << endl;
+		return 1;
+	}
+
+	defaultModel = new Object(modelArgs[0], useTextureAtlas, textureCache);
+
+	// any further arguments of the form <markerId>=<model file> give that marker its own model
+	// (in board mode the board's pose id is -1)
+	loadedModels[modelArgs[0]] = defaultModel;
+	for (unsigned int i = 1; i < modelArgs.size(); i++) {
+		size_t eq = modelArgs[i].find('=');
+		if (eq == std::string::npos) {
+			cerr << "ignoring argument " << modelArgs[i] << ", expected <markerId>=<model file>" << endl;
+			continue;
+		}
+		std::string filename = modelArgs[i].substr(eq + 1);
+		if (loadedModels.find(filename) == loadedModels.end())
+			loadedModels[filename] = new Object(filename, useTextureAtlas, textureCache);
+		markerModels[atoi(modelArgs[i].substr(0, eq).c_str())] = loadedModels[filename];
+	}
+
+	// reorient and rescale the models once, instead of in every modelview
+	if (transformModels) {
+		Matrix rotations[3];
+		for (int axis = 0; axis < 3; axis++)
+			rotations[axis].makeRotation(modelRotation[axis] * M_PI / 180.0, axis == 0, axis == 1, axis == 2);
+		// cv has a Mat4f of its own
+		::Mat4 rotation = (rotations[2] * rotations[1] * rotations[0]).toMat4();
+		::Mat4f modelTransform = ::Mat4f::identity();
+		for (int row = 0; row < 3; row++)
+			for (int col = 0; col < 3; col++)
+				modelTransform(row, col) = (float)(rotation(row, col) * modelScale);
+		WorkerPool transformPool;
+		for (std::map< std::string, Object* >::iterator iter = loadedModels.begin(); iter != loadedModels.end(); ++iter)
+			iter->second->transform(modelTransform, &transformPool);
+	}
+
+	// the governor can fall back to coarser models, as far as every model goes
+	if (governor != NULL) {
+		unsigned int availableLods = numModelLods;
+		for (std::map< std::string, Object* >::iterator iter = loadedModels.begin(); iter != loadedModels.end(); ++iter) {
+			iter->second->buildLods(numModelLods > 0 ? numModelLods - 1 : 0);
+			availableLods = std::min(availableLods, iter->second->getNumLods());
+		}
+		governor->setNumModelLods(availableLods);
+	}
 
 	// Initialize OpenGL
 	InitGL();
 
+	// capture -> detect/pose -> render; a single camera gets its own detection
+	// thread, several share a pool sized to the machine unless --workers says otherwise
+	if (inputs.empty())
+		inputs.push_back("0");
+	// the i-th --calibration goes with the i-th --input, the last one with any after it
+	if (calibrations.empty())
+		calibrations.push_back(new CameraCalibration(K, distCoeffs));
+	if (inputs.size() > 1 || numWorkers >= 0)
+		workerPool = new WorkerPool(numWorkers > 0 ? numWorkers : 0);
+	for (unsigned int i = 0; i < inputs.size(); i++) {
+		FrameSource *source = FrameSource::open(inputs[i], imageFps);
+		ArSession *session = new ArSession(inputs[i], source, &scheduler, pipelineDepth);
+		if (!session->isOpened()) {
+			cerr << "could not open " << source->describe() << endl;
+			return 1;
+		}
+		session->getCapture()->setReplay(replayMode, loopReplay);
+
+		DetectionPipeline *pipeline = session->getPipeline();
+		pipeline->setDictionary(dictionary, detectorParams);
+		CameraCalibration *calibration = calibrations[std::min< size_t >(i, calibrations.size() - 1)];
+		session->setCalibration(calibration, markerLength, undistortFrames);
+		cout << inputs[i] << ": " << calibration->describe() << (undistortFrames ? ", undistorted before detection" : "") << endl;
+		pipeline->setDetectionInterval(detectionInterval);
+		pipeline->setPoseMethod(poseMethod);
+		if (roiInterval > 0)
+			pipeline->getDetector()->setRoiTracking(true, roiInterval);
+		if (boardX > 0 && boardY > 0) {
+			if (charuco)
+				pipeline->setCharucoBoard(boardX, boardY, charucoSquareLength, boardMarkerLength);
+			else
+				pipeline->setGridBoard(boardX, boardY, boardMarkerLength, boardSeparation);
+		}
+		if (flowInterval > 0)
+			pipeline->getDetector()->setFlowTracking(true, flowInterval);
+		if (pyramidMinMarker > 0)
+			pipeline->getDetector()->setPyramid(true, pyramidMinMarker, pyramidCompare);
+		sessions.push_back(session);
+	}
+	for (unsigned int i = 0; i < sessions.size(); i++)
+		sessions[i]->start(workerPool);
+	glutSetWindowTitle(sessions[displayedSession]->getName().c_str());
+
 	glutMainLoop();
 
 	return 0;
@@ -104,6 +360,14 @@ GLvoid InitGL()
 	glLightfv(GL_LIGHT0, GL_SPECULAR, specularLightCol);
 	glLightfv(GL_LIGHT0, GL_AMBIENT, ambientCol);
 
+	// the video is replaced every frame, so it gets no mipmaps
+	glGenTextures(1, &videoTexture);
+	glBindTexture(GL_TEXTURE_2D, videoTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
 
 
 	glutDisplayFunc(OnDisplay);
@@ -115,8 +379,19 @@ GLvoid InitGL()
 
 GLvoid OnDisplay(void)
 {
+	scheduler.beginBusy();
+	unsigned long long allocations = AllocationCounter::getThreadCount();
+
+	// Take the next detected frame, if there is one; otherwise redraw the last
+	double uploadStart = FrameRing::now();
+	bool newFrame = sessions[displayedSession]->takeResult(currentFrame);
+	if (newFrame)
+		uploadFrame();
+	double drawStart = FrameRing::now();
+
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, videoTexture);
 
 
 	//Draw the 2D section for the video display
@@ -137,6 +412,11 @@ GLvoid OnDisplay(void)
 	glTexCoord2f(0.0f, 1.0f); glVertex2f(0.0f, windowHeight);
 	glEnd();
 
+	double overlayStart = FrameRing::now();
+	if (showOverlays && (governor == NULL || governor->getOverlays()) && currentFrame.detected)
+		drawOverlays();
+	double overlayEnd = FrameRing::now();
+
 
 	//draw the 3d section
 	glDisable(GL_TEXTURE_2D);
@@ -148,98 +428,20 @@ GLvoid OnDisplay(void)
 	glLoadIdentity();
 	gluPerspective(45.0, aspectRatio, 0.1, 100000);
 
-	// Capture next frame
-	cap >> imageMat; // get image from camera
-
-	IplImage *image;
-
-	cv::aruco::detectMarkers(
-		imageMat,		// input image
-		dictionary,		// type of markers that will be searched for
-		markerCorners,	// output vector of marker corners
-		markerIds,		// detected marker IDs
-		detectorParams,	// algorithm parameters
-		rejectedCandidates);
-
-	if (markerIds.size() > 0) {
-		// Draw all detected markers.
-		cv::aruco::drawDetectedMarkers(imageMat, markerCorners, markerIds);
-
-		std::vector< cv::Vec3d > rvecs, tvecs;
-		cv::aruco::estimatePoseSingleMarkers(
-			markerCorners,	// vector of already detected markers corners
-			markerLength,	// length of the marker's side
-			K,				// input 3x3 floating-point instrinsic camera matrix K
-			distCoeffs,		// vector of distortion coefficients of 4, 5, 8 or 12 elements
-			rvecs,			// array of output rotation vectors 
-			tvecs);			// array of output translation vectors
-
-		for (unsigned int i = 0; i < markerIds.size(); i++) {
-			cv::Vec3d r = rvecs[i];
-			cv::Vec3d t = tvecs[i];
-			if (markerIds[i] == 0) {
-				Mat rot;
-				Rodrigues(rvecs[i], rot);
-				for (unsigned int row = 0; row < 3; ++row)
-				{
-					for (unsigned int col = 0; col < 3; ++col)
-					{
-						viewMatrix.at<float>(row, col) = (float)rot.at<double>(row, col);
-					}
-					viewMatrix.at<float>(row, 3) = (float)tvecs[i][row] * 0.1f;
-				}
-				viewMatrix.at<float>(3, 3) = 1.0f;
-
-				cv::Mat cvToGl = cv::Mat::zeros(4, 4, CV_32F);
-				cvToGl.at<float>(0, 0) = 1.0f;
-				cvToGl.at<float>(1, 1) = -1.0f; // Invert the y axis 
-				cvToGl.at<float>(2, 2) = -1.0f; // invert the z axis 
-				cvToGl.at<float>(3, 3) = 1.0f;
-				viewMatrix = cvToGl * viewMatrix;
-				cv::transpose(viewMatrix, viewMatrix);
-				viewMatrix.at<float>(0, 3) = 0;
-				viewMatrix.at<float>(1, 3) = 0;
-				viewMatrix.at<float>(2, 3) = 0;
-				viewMatrix.at<float>(3, 3) = 1;
-
-			}
-
-			// Draw coordinate axes.
-			cv::aruco::drawAxis(imageMat,
-				K, distCoeffs,			// camera parameters
-				r, t,					// marker pose
-				0.5*markerLength);		// length of the axes to be drawn
-
-										// Draw a symbol in the upper right corner of the detected marker.
-		}
-	}
-
-	IplImage copy = imageMat;
-	image = &copy;
-
-
-	// Convert to RGB
-	cvCvtColor(image, image, CV_BGR2RGB);
-
-	// Create Texture
-	gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGB, image->width, image->height, GL_RGB, GL_UNSIGNED_BYTE, image->imageData);
-
-
-
 
 	glMatrixMode(GL_MODELVIEW);
 
 	glColor3f(1, 0, 0);
-	glPushMatrix(); {
-		glLoadMatrixf((float*)viewMatrix.data);
-		glScalef(.5, .5, .5);
-		obj->draw();
-	}glPopMatrix();
+	instances.draw();
 
+	if (showHud)
+		drawHud();
 
 
 	glFlush();
+	double swapStart = FrameRing::now();
 	glutSwapBuffers();
+	double swapEnd = FrameRing::now();
 
 
 	//Check for errors
@@ -251,7 +453,253 @@ GLvoid OnDisplay(void)
 		printf("glError %s\n",gluErrorString(glErr));
 	}
 
+	if (newFrame) {
+		FrameTimings &timings = currentFrame.timings;
+		timings.seconds[STAGE_UPLOAD] = drawStart - uploadStart;
+		timings.seconds[STAGE_OVERLAY] = overlayEnd - overlayStart;
+		timings.seconds[STAGE_DRAW] = swapStart - drawStart - timings.seconds[STAGE_OVERLAY];
+		timings.seconds[STAGE_SWAP] = swapEnd - swapStart;
+		timings.seconds[STAGE_TOTAL] = swapEnd - currentFrame.captureTime;
+		profiler.addFrame(timings);
+		if (governor != NULL && governor->update(timings))
+			applyGovernor();
+		reportLatency();
+	}
+
+	renderAllocations += AllocationCounter::getThreadCount() - allocations;
+	renderFrames++;
+	scheduler.endBusy();
+
+
+}
+
 
+// Queues a model instance for each marker in currentFrame and uploads the
+// annotated frame as the video texture.  With pose filtering the instances
+// come from the filters, predicted to the moment the frame was captured, so
+// frames that skipped detection still get a pose that matches the image.
+void uploadFrame()
+{
+	if (filterPoses) {
+		if (currentFrame.detected)
+			poseFilters.correct(currentFrame.poseIds, currentFrame.rvecs, currentFrame.tvecs, currentFrame.captureTime);
+
+		poseFilters.predict(currentFrame.captureTime, filteredIds, filteredRvecs, filteredTvecs);
+
+		instances.clear();
+		for (unsigned int i = 0; i < filteredIds.size(); i++) {
+			GLfloat modelView[16];
+			markerPoseToModelView(filteredRvecs[i], filteredTvecs[i], modelView);
+			instances.addInstance(modelForMarker(filteredIds[i]), modelView);
+		}
+	}
+	else if (currentFrame.detected) {
+		// frames without detection keep the last detected instances
+		instances.clear();
+		for (unsigned int i = 0; i < currentFrame.poseIds.size(); i++) {
+			GLfloat modelView[16];
+			markerPoseToModelView(currentFrame.rvecs[i], currentFrame.tvecs[i], modelView);
+			instances.addInstance(modelForMarker(currentFrame.poseIds[i]), modelView);
+		}
+	}
+
+	// Update the texture in place, straight from the camera's BGR buffer;
+	// it is only reallocated when the frame size changes
+	const cv::Mat &image = currentFrame.image;
+	glBindTexture(GL_TEXTURE_2D, videoTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (image.cols != videoTextureWidth || image.rows != videoTextureHeight) {
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.cols, image.rows, 0, GL_BGR, GL_UNSIGNED_BYTE, image.data);
+		videoTextureWidth = image.cols;
+		videoTextureHeight = image.rows;
+	}
+	else {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.cols, image.rows, GL_BGR, GL_UNSIGNED_BYTE, image.data);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// Hands the governor's current settings to every camera and model.  The
+// detection interval multiplies --detect-every rather than replacing it.
+void applyGovernor()
+{
+	for (unsigned int i = 0; i < sessions.size(); i++) {
+		DetectionPipeline *pipeline = sessions[i]->getPipeline();
+		pipeline->setDetectionInterval(detectionInterval * governor->getDetectionInterval());
+		pipeline->getDetector()->setMaxScale(governor->getDetectionScale());
+	}
+	for (std::map< std::string, Object* >::iterator iter = loadedModels.begin(); iter != loadedModels.end(); ++iter)
+		iter->second->setLod(governor->getModelLod());
+}
+
+// Marker outlines, ids and pose axes drawn as lines over the video quad,
+// in the same colours cv::aruco::drawDetectedMarkers and drawAxis used when
+// they were drawn into the frame: green outlines with the first corner
+// marked in red, blue ids, and red/green/blue x/y/z axes.  Expects the 2D
+// projection the video quad was drawn with.
+void drawOverlays()
+{
+	if (videoTextureWidth == 0 || videoTextureHeight == 0)
+		return;
+	glDisable(GL_TEXTURE_2D);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+
+	// frame pixels to window coordinates
+	glPushMatrix();
+	glScalef(windowWidth / (float)videoTextureWidth, windowHeight / (float)videoTextureHeight, 1.0f);
+	glLineWidth(2.0f);
+
+	const std::vector< std::vector< cv::Point2f > > &corners = currentFrame.markerCorners;
+	glColor3f(0.0f, 1.0f, 0.0f);
+	for (unsigned int i = 0; i < corners.size(); i++) {
+		glBegin(GL_LINE_LOOP);
+		for (int c = 0; c < 4; c++)
+			glVertex2f(corners[i][c].x, corners[i][c].y);
+		glEnd();
+	}
+	glColor3f(1.0f, 0.0f, 0.0f);
+	glBegin(GL_LINES);
+	for (unsigned int i = 0; i < corners.size(); i++) {
+		const cv::Point2f &first = corners[i][0];
+		glVertex2f(first.x - 3, first.y - 3); glVertex2f(first.x + 3, first.y - 3);
+		glVertex2f(first.x + 3, first.y - 3); glVertex2f(first.x + 3, first.y + 3);
+		glVertex2f(first.x + 3, first.y + 3); glVertex2f(first.x - 3, first.y + 3);
+		glVertex2f(first.x - 3, first.y + 3); glVertex2f(first.x - 3, first.y - 3);
+	}
+	glEnd();
+
+	const std::vector< cv::Point2f > &axes = currentFrame.axisPoints;
+	static const float axisColours[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+	glBegin(GL_LINES);
+	for (unsigned int p = 0; p + 3 < axes.size(); p += 4) {
+		for (int axis = 0; axis < 3; axis++) {
+			glColor3fv(axisColours[axis]);
+			glVertex2f(axes[p].x, axes[p].y);
+			glVertex2f(axes[p + 1 + axis].x, axes[p + 1 + axis].y);
+		}
+	}
+	glEnd();
+	glLineWidth(1.0f);
+
+	// raster positions go through the same scale, so the ids land on the markers
+	char id[16];
+	glColor3f(0.0f, 0.0f, 1.0f);
+	for (unsigned int i = 0; i < corners.size() && i < currentFrame.markerIds.size(); i++) {
+		cv::Point2f centre = 0.25f * (corners[i][0] + corners[i][1] + corners[i][2] + corners[i][3]);
+		sprintf(id, "id=%d", currentFrame.markerIds[i]);
+		glRasterPos2f(centre.x, centre.y);
+		for (const char *c = id; *c; c++)
+			glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
+	}
+
+	glPopMatrix();
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_LIGHTING);
+}
+
+// Per-stage p50/p95/p99 in the top left corner, over the video and models.
+// The table is only re-sorted every 15 frames; the text still redraws every
+// frame.
+void drawHud()
+{
+	if (hudFrames++ % 15 == 0)
+		profiler.formatTable(hudLines);
+
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	gluOrtho2D(0, windowWidth, windowHeight, 0);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	// a dark backing keeps the text readable over any video
+	const int lineHeight = 14;
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glColor4f(0.0f, 0.0f, 0.0f, 0.6f);
+	glBegin(GL_QUADS);
+	glVertex2i(4, 4);
+	glVertex2i(4 + 8 * 33, 4);
+	glVertex2i(4 + 8 * 33, 8 + lineHeight * (int)hudLines.size());
+	glVertex2i(4, 8 + lineHeight * (int)hudLines.size());
+	glEnd();
+	glDisable(GL_BLEND);
+
+	glColor3f(1.0f, 1.0f, 0.0f);
+	for (unsigned int i = 0; i < hudLines.size(); i++) {
+		glRasterPos2i(8, 4 + lineHeight * (i + 1));
+		for (unsigned int c = 0; c < hudLines[i].size(); c++)
+			glutBitmapCharacter(GLUT_BITMAP_8_BY_13, hudLines[i][c]);
+	}
+
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_LIGHTING);
+}
+
+// End-to-end latency of the frame just displayed, from camera capture to
+// buffer swap, split into time waiting for detection, detecting, and
+// waiting for/being drawn by the renderer.
+void reportLatency()
+{
+	double displayTime = FrameRing::now();
+	double latency = displayTime - currentFrame.captureTime;
+	latencyTotal += latency;
+	latencyFrames++;
+
+	if (printLatency) {
+		printf("[latency]: %.1fms (queue %.1fms, detect %.1fms, render %.1fms)\n",
+			latency * 1000.0,
+			(currentFrame.detectStartTime - currentFrame.captureTime) * 1000.0,
+			(currentFrame.detectEndTime - currentFrame.detectStartTime) * 1000.0,
+			(displayTime - currentFrame.detectEndTime) * 1000.0);
+	}
+}
+
+
+Object* modelForMarker(int markerId)
+{
+	std::map< int, Object* >::iterator iter = markerModels.find(markerId);
+	if (iter != markerModels.end())
+		return iter->second;
+	return defaultModel;
+}
+
+// Builds the column-major GL modelview for a marker from its OpenCV pose:
+// flips the y and z axes into GL's camera frame and applies the model scale.
+// The rotation vector is expanded with the closed-form Rodrigues formula,
+// which unlike cv::Rodrigues never touches the heap.
+void markerPoseToModelView(const cv::Vec3d &rvec, const cv::Vec3d &tvec, GLfloat modelView[16])
+{
+	static const float flip[3] = { 1.0f, -1.0f, -1.0f };
+	const float modelScale = 0.5f;
+
+	cv::Matx33d rot = cv::Matx33d::eye();
+	double angle = sqrt(rvec.dot(rvec));
+	if (angle > 1e-12) {
+		cv::Vec3d k = rvec * (1.0 / angle);
+		double c = cos(angle), s = sin(angle), v = 1.0 - c;
+		rot = cv::Matx33d(
+			c + k[0] * k[0] * v,		k[0] * k[1] * v - k[2] * s,	k[0] * k[2] * v + k[1] * s,
+			k[1] * k[0] * v + k[2] * s,	c + k[1] * k[1] * v,		k[1] * k[2] * v - k[0] * s,
+			k[2] * k[0] * v - k[1] * s,	k[2] * k[1] * v + k[0] * s,	c + k[2] * k[2] * v);
+	}
+
+	for (unsigned int col = 0; col < 3; ++col)
+	{
+		for (unsigned int row = 0; row < 3; ++row)
+		{
+			modelView[col * 4 + row] = flip[row] * (float)rot(row, col) * modelScale;
+		}
+		modelView[col * 4 + 3] = 0.0f;
+	}
+	for (unsigned int row = 0; row < 3; ++row)
+	{
+		modelView[12 + row] = flip[row] * (float)tvec[row] * 0.1f;
+	}
+	modelView[15] = 1.0f;
 }
 
 
@@ -263,7 +711,22 @@ GLvoid OnReshape(GLint w, GLint h)
 GLvoid OnKeyPress(unsigned char key, int x, int y)
 {
 	switch (key) {
+	case 'h':
+		showHud = !showHud;
+		break;
+	case 'o':
+		showOverlays = !showOverlays;
+		break;
+	case 'c':
+		// show the next camera; its markers start with fresh filters
+		displayedSession = (displayedSession + 1) % sessions.size();
+		poseFilters.clear();
+		glutSetWindowTitle(sessions[displayedSession]->getName().c_str());
+		break;
 	case KEY_ESCAPE:
+		for (unsigned int i = 0; i < sessions.size(); i++)
+			sessions[i]->stop();
+		profiler.closeLog();
 		glutDestroyWindow(g_hWindow);
 		exit(0);
 		break;
@@ -274,6 +737,28 @@ GLvoid OnKeyPress(unsigned char key, int x, int y)
 
 GLvoid OnIdle()
 {
+	// Sleep until a new frame is ready or the display interval passes
+	scheduler.waitForWork();
+
+	if (printStats && scheduler.getBusySeconds() + scheduler.getIdleSeconds() >= 5.0) {
+		scheduler.printStats();
+		for (unsigned int i = 0; i < sessions.size(); i++)
+			sessions[i]->printStats();
+		if (workerPool != NULL)
+			workerPool->printStats();
+		profiler.printStats();
+		if (governor != NULL)
+			governor->printStats();
+		if (latencyFrames > 0)
+			printf("[latency]: mean %.1fms over %lu frames\n", latencyTotal / latencyFrames * 1000.0, latencyFrames);
+		latencyTotal = 0;
+		latencyFrames = 0;
+		if (AllocationCounter::isEnabled() && renderFrames > 0)
+			printf("[alloc]: render %.1f allocations/frame\n", (double)renderAllocations / renderFrames);
+		renderAllocations = 0;
+		renderFrames = 0;
+	}
+
 	// Update View port
 	glutPostRedisplay();
 }